@@ -0,0 +1,136 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _CMAP_H_
+#define _CMAP_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#define CMAP_DEFAULT_SIZE 64
+#define CMAP_DEFAULT_UPPER_BOUND 100
+#define CMAP_DEFAULT_STRIPES 64
+
+/*
+ * Hash map for sharing between threads.
+ * Readers don't take any lock: they walk the bucket chains while writers
+ * replace the chain pointers atomically. Writers serialize on one of
+ * 'stripes' locks, chosen by the hash of the key, so writers on
+ * different stripes don't block each other. Growing the table locks
+ * all stripes and publishes a copy of the table.
+ * 
+ * Removed entries and replaced tables are reclaimed after a grace period:
+ * every reader announces itself in the counter of the current epoch and
+ * the epoch only advances once the readers of the previous one are gone.
+ * Entries retired two epochs ago are then freed. Writers only try to
+ * advance the epoch and never wait for readers.
+ */
+struct cmap_config {
+    unsigned int size;
+    
+    /* average chain length in percent before the table doubles */
+    unsigned int upper_bound;
+    
+    /* number of writer locks, rounded up to a power of two */
+    unsigned int stripes;
+    
+    int (*key_compare)(const void *, const void *);
+    unsigned int (*key_hash)(const void *);
+    /* only called once no reader can see the entry anymore */
+    void (*data_delete)(void *);
+};
+
+struct cmap_table;
+struct cmap_stripe;
+struct cmap_reader;
+struct cmap_node;
+
+struct cmap {
+    struct cmap_table *table;
+    unsigned long size;
+    
+    struct cmap_stripe *stripes;
+    unsigned int stripe_mask;
+    
+    struct cmap_reader *readers;
+    unsigned long epoch;
+    
+    pthread_mutex_t mutex_resize;
+    
+    pthread_mutex_t mutex_retired;
+    struct cmap_node *retired_pending;
+    struct cmap_node *retired_waiting;
+    unsigned int retired_count;
+    
+    unsigned int upper_bound;
+    
+    int (*key_compare)(const void *, const void *);
+    unsigned int (*key_hash)(const void *);
+    void (*data_delete)(void *);
+};
+
+struct cmap *cmap_new(const struct cmap_config *__restrict conf);
+
+void cmap_delete(struct cmap *__restrict map);
+
+int cmap_init(struct cmap *__restrict map,
+              const struct cmap_config *__restrict conf);
+
+/* not thread-safe, no other thread may use 'map' anymore */
+void cmap_destroy(struct cmap *__restrict map);
+
+/* returns -EEXIST if 'key' is already in the map */
+int cmap_insert(struct cmap *__restrict map, const void *key, void *data);
+
+void *cmap_retrieve(struct cmap *__restrict map, const void *key);
+
+bool cmap_contains(struct cmap *__restrict map, const void *key);
+
+/* the caller owns the returned data, 'data_delete' isn't called for it */
+void *cmap_take(struct cmap *__restrict map, const void *key);
+
+/* 
+ * Removes 'key' and passes its data to 'data_delete' after the grace 
+ * period, so concurrent readers may still use it until they unlock.
+ */
+int cmap_remove(struct cmap *__restrict map, const void *key);
+
+unsigned long cmap_size(const struct cmap *__restrict map);
+
+/* 
+ * Entries can't be reclaimed while a read lock is held, which keeps the
+ * data returned by cmap_retrieve() alive. Pass the returned ticket to
+ * cmap_read_unlock(). Read locks nest and never block.
+ */
+unsigned int cmap_read_lock(struct cmap *__restrict map);
+
+void cmap_read_unlock(struct cmap *__restrict map, unsigned int ticket);
+
+/* 
+ * Waits for all readers that hold a read lock right now and frees
+ * everything retired before. Must not be called while holding a read lock.
+ */
+void cmap_synchronize(struct cmap *__restrict map);
+
+#endif /* _CMAP_H_ */
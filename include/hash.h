@@ -25,6 +25,8 @@
 #ifndef _HASH_H_
 #define _HASH_H_
 
+#include <stddef.h>
+
 unsigned int hash_char(const void *key);
 
 unsigned int hash_uchar(const void *key);
@@ -43,4 +45,26 @@ unsigned int hash_ulong(const void *key);
 
 unsigned int hash_string(const void *key);
 
+/* for keys which aren't NUL-terminated */
+unsigned int hash_bytes(const void *ptr, size_t len);
+
+/* 64 bit hash_bytes() with an explicit seed instead of the process one */
+unsigned long hash_bytes_seed(const void *ptr, size_t len, unsigned long seed);
+
+/* full 64 bit mixer, the hash_*() functions of integers fold it to 32 bit */
+unsigned long hash_mix(unsigned long x);
+
+/*
+ * All hash functions depend on a per-process seed, which is 0 by default.
+ * A random seed keeps others from choosing keys which collide (hash
+ * flooding). Change it only while no map holds hashed keys, they won't
+ * be found anymore otherwise.
+ */
+void hash_set_seed(unsigned long seed);
+
+unsigned long hash_get_seed(void);
+
+/* seeds from /dev/urandom */
+int hash_seed_random(void);
+
 #endif /* _HASH_H_ */
\ No newline at end of file
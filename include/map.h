@@ -45,6 +45,23 @@ struct entry {
     enum map_data_state state;
 };
 
+enum map_engine {
+    /* quadratic probing over 'table' */
+    MAP_ENGINE_QUADRATIC,
+    /* 
+     * SwissTable-style probing over a separate array of control bytes,
+     * 16 of them are matched at once. Grows at 7/8 load regardless of 
+     * 'upper_bound'.
+     */
+    MAP_ENGINE_SWISS,
+    /* 
+     * Robin Hood hashing with linear probing and backward-shift deletion.
+     * Probe lengths vary little and misses end early. map_take() may move
+     * other entries, so don't take while iterating with map_for_each().
+     */
+    MAP_ENGINE_ROBIN_HOOD,
+};
+
 struct map_config {
     unsigned int size;
     
@@ -56,6 +73,15 @@ struct map_config {
     int (*key_compare)(const void *, const void *);
     unsigned int (*key_hash)(const void *);
     void (*data_delete)(void *);
+    
+    enum map_engine engine;
+    
+    /* 
+     * Spread the work of a resize over the following operations instead
+     * of rehashing everything at once, which bounds the worst-case latency
+     * of map_insert() and map_take().
+     */
+    bool incremental_resize;
 };
 
 struct map {
@@ -63,16 +89,50 @@ struct map {
     unsigned int size;
     unsigned int capacity;
     
+    enum map_engine engine;
+    
+    /* removed entries still occupying a slot */
+    unsigned int tombstones;
+    
+    /* only used by MAP_ENGINE_SWISS */
+    unsigned char *ctrl;
+    
+    /* only used by MAP_ENGINE_ROBIN_HOOD */
+    unsigned int *dist;
+    
     unsigned int lower_bound;
     unsigned int upper_bound;
     
     bool static_size;
+    
+    /* resize step by step instead of rehashing all at once */
+    bool incremental;
+    /* table being migrated by an incremental resize, or NULL */
+    struct map *old;
+    unsigned int migrate_pos;
 
     int (*key_compare)(const void *, const void *);
     unsigned int (*key_hash)(const void *);
     void (*data_delete)(void *);
 };
 
+/* 
+ * Probe lengths count slots for MAP_ENGINE_QUADRATIC and 
+ * MAP_ENGINE_ROBIN_HOOD and groups of 16 slots for MAP_ENGINE_SWISS.
+ */
+struct map_stats {
+    unsigned int size;
+    unsigned int capacity;
+    unsigned int tombstones;
+    
+    /* probes until an entry is found */
+    double probe_avg;
+    unsigned int probe_max;
+    
+    /* probes until a key is known to be missing */
+    double probe_miss_avg;
+};
+
 struct map *map_new(const struct map_config *__restrict conf);
 
 void map_delete(struct map *__restrict map);
@@ -88,8 +148,26 @@ int map_rehash(struct map *__restrict map, unsigned int size);
 
 int map_insert(struct map *__restrict map, const void *key, void *data);
 
+/* 
+ * Inserts 'keys[i]' -> 'data[i]' for all 'n' keys, overlapping the cache 
+ * misses of up to 16 keys at a time. Stops at the first error.
+ */
+int map_insert_batch(struct map *__restrict map, 
+                     const void **keys, 
+                     void **data, 
+                     unsigned int n);
+
 void *map_retrieve(struct map *__restrict map, const void *key);
 
+/* 
+ * Stores the data of 'keys[i]' or NULL in 'data[i]', 
+ * returns the number of keys found.
+ */
+unsigned int map_retrieve_batch(struct map *__restrict map, 
+                                const void **keys, 
+                                void **data, 
+                                unsigned int n);
+
 void *map_take(struct map *__restrict map, const void *key);
 
 bool map_contains(const struct map *__restrict map, const void *key);
@@ -102,15 +180,43 @@ void map_set_static_size(struct map *__restrict map, bool static_size);
 
 bool map_static_size(const struct map *__restrict map);
 
+/*
+ * Visits the entries of at least one home bucket and returns the cursor
+ * for the next call, 0 once the scan is complete. Start with 0.
+ * Entries which are in the map during the whole scan are visited at
+ * least once even if the map resizes between two calls, some of them
+ * may be visited twice. 'fn' must not change the map. If it returns true,
+ * the entry is taken out and its data handed to 'data_delete'.
+ */
+unsigned long map_scan(struct map *__restrict map, 
+                       unsigned long cursor,
+                       bool (*fn)(const void *key, void *data, void *arg),
+                       void *arg);
+
+/* 
+ * Walks the whole table, meant for diagnostics. During an incremental
+ * resize the numbers cover both the new and the old table.
+ */
+void map_stats(const struct map *__restrict map, 
+               struct map_stats *__restrict stats);
+
 const void *entry_key(struct entry *__restrict e);
 
 void *entry_data(struct entry *__restrict e);
 
 
+/* steps from the end of 'table' into the old table of a running resize */
+#define __map_next_entry(map, entry)                                           \
+    (((entry) + 1 == (map)->table + (map)->capacity)                           \
+        ? (((map)->old) ? (map)->old->table : NULL)                            \
+        : ((map)->old && (entry) + 1 == (map)->old->table +                    \
+                                        (map)->old->capacity)                  \
+        ? NULL : (entry) + 1)
+
 #define map_for_each(map, entry)                                               \
     for((entry) = (map)->table;                                                \
-        (entry) < (map)->table + (map)->capacity;                              \
-        (entry) += 1)                                                          \
+        (entry) != NULL;                                                       \
+        (entry) = __map_next_entry(map, entry))                                \
         if((entry)->state != MAP_DATA_STATE_AVAILABLE)                         \
             continue;                                                          \
         else
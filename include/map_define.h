@@ -0,0 +1,302 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _MAP_DEFINE_H_
+#define _MAP_DEFINE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+
+/*
+ * MAP_DEFINE(name, key_t, val_t, hash_fn, eq_fn) generates 'struct name' 
+ * together with name_init(), name_destroy(), name_clear(), name_insert(), 
+ * name_retrieve(), name_take(), name_contains() and name_size().
+ * Keys and values are stored inline and 'hash_fn' and 'eq_fn' can be 
+ * macros or functions, both are inlined instead of being called through 
+ * a function pointer.
+ * 'hash_fn(key)' returns an unsigned int, 'eq_fn(a, b)' is true if the 
+ * keys are equal. Every key exists at most once, inserting an existing 
+ * key replaces its value.
+ *
+ * Slots are probed triangularly, a control byte per slot holds 7 bits of 
+ * the hash so most mismatches are rejected without calling 'eq_fn'.
+ */
+
+#define MAP_DEFINE_DEFAULT_SIZE 16
+
+#define MAP_DEFINE_CTRL_EMPTY 0x00
+#define MAP_DEFINE_CTRL_DELETED 0x01
+#define MAP_DEFINE_CTRL_FULL 0x80
+
+#define MAP_DEFINE_EQ(a, b)                                                    \
+    ((a) == (b))
+
+#define MAP_DEFINE_EQ_STRING(a, b)                                             \
+    (strcmp((a), (b)) == 0)
+
+/* hashes get mixed before use, integer keys can be their own hash */
+#define MAP_DEFINE_HASH_INT(k)                                                 \
+    ((unsigned int) (k))
+
+/* the low bits select the slot, the high bits go into the control byte */
+#define __map_define_tag(h)                                                    \
+    (MAP_DEFINE_CTRL_FULL | ((h) >> 25))
+
+#define map_define_for_each(map, i)                                            \
+    for ((i) = 0; (i) < (map)->capacity; ++(i))                                \
+        if (!((map)->ctrl[(i)] & MAP_DEFINE_CTRL_FULL))                        \
+            continue;                                                          \
+        else
+
+#define MAP_DEFINE(name, key_t, val_t, hash_fn, eq_fn)                         \
+                                                                               \
+struct name##_entry {                                                          \
+    key_t key;                                                                 \
+    val_t val;                                                                 \
+};                                                                             \
+                                                                               \
+struct name {                                                                  \
+    struct name##_entry *entries;                                              \
+    unsigned char *ctrl;                                                       \
+    unsigned int size;                                                         \
+    unsigned int tombstones;                                                   \
+    unsigned int capacity;                                                     \
+};                                                                             \
+                                                                               \
+/* murmur3 finalizer */                                                        \
+static inline unsigned int name##_hash(key_t key)                              \
+{                                                                              \
+    unsigned int h = hash_fn(key);                                             \
+                                                                               \
+    h ^= h >> 16;                                                              \
+    h *= 0x85ebca6bu;                                                          \
+    h ^= h >> 13;                                                              \
+    h *= 0xc2b2ae35u;                                                          \
+    h ^= h >> 16;                                                              \
+                                                                               \
+    return h;                                                                  \
+}                                                                              \
+                                                                               \
+static inline int name##_init(struct name *__restrict map, unsigned int size)  \
+{                                                                              \
+    unsigned int capacity = MAP_DEFINE_DEFAULT_SIZE;                           \
+                                                                               \
+    while (capacity < size + (size >> 1))                                      \
+        capacity <<= 1;                                                        \
+                                                                               \
+    map->entries = malloc(capacity * sizeof(*map->entries));                   \
+    map->ctrl    = calloc(capacity, sizeof(*map->ctrl));                       \
+    if (!map->entries || !map->ctrl) {                                         \
+        free(map->entries);                                                    \
+        free(map->ctrl);                                                       \
+        return -ENOMEM;                                                        \
+    }                                                                          \
+                                                                               \
+    map->size       = 0;                                                       \
+    map->tombstones = 0;                                                       \
+    map->capacity   = capacity;                                                \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline void name##_destroy(struct name *__restrict map)                 \
+{                                                                              \
+    free(map->entries);                                                        \
+    free(map->ctrl);                                                           \
+}                                                                              \
+                                                                               \
+static inline void name##_clear(struct name *__restrict map)                   \
+{                                                                              \
+    memset(map->ctrl, MAP_DEFINE_CTRL_EMPTY, map->capacity);                   \
+    map->size       = 0;                                                       \
+    map->tombstones = 0;                                                       \
+}                                                                              \
+                                                                               \
+/* returns 'capacity' if 'key' isn't in the map */                             \
+static inline unsigned int name##_find(const struct name *__restrict map,      \
+                                       key_t key,                              \
+                                       unsigned int hash)                      \
+{                                                                              \
+    unsigned int mask = map->capacity - 1;                                     \
+    unsigned int i = hash & mask;                                              \
+    unsigned int step = 0;                                                     \
+    unsigned char tag = __map_define_tag(hash);                                \
+                                                                               \
+    for (;;) {                                                                 \
+        if (map->ctrl[i] == tag && eq_fn(map->entries[i].key, key))            \
+            return i;                                                          \
+                                                                               \
+        if (map->ctrl[i] == MAP_DEFINE_CTRL_EMPTY)                             \
+            return map->capacity;                                              \
+                                                                               \
+        i = (i + ++step) & mask;                                               \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline void name##_place(struct name *__restrict map,                   \
+                                key_t key,                                     \
+                                val_t val,                                     \
+                                unsigned int hash)                             \
+{                                                                              \
+    unsigned int mask = map->capacity - 1;                                     \
+    unsigned int i = hash & mask;                                              \
+    unsigned int step = 0;                                                     \
+                                                                               \
+    while (map->ctrl[i] & MAP_DEFINE_CTRL_FULL)                                \
+        i = (i + ++step) & mask;                                               \
+                                                                               \
+    if (map->ctrl[i] == MAP_DEFINE_CTRL_DELETED)                               \
+        map->tombstones -= 1;                                                  \
+                                                                               \
+    map->ctrl[i]        = __map_define_tag(hash);                              \
+    map->entries[i].key = key;                                                 \
+    map->entries[i].val = val;                                                 \
+    map->size          += 1;                                                   \
+}                                                                              \
+                                                                               \
+static inline int name##_resize(struct name *__restrict map,                   \
+                                unsigned int capacity)                         \
+{                                                                              \
+    struct name##_entry *entries = map->entries;                               \
+    unsigned char *ctrl = map->ctrl;                                           \
+    unsigned int i, old_capacity = map->capacity;                              \
+                                                                               \
+    map->entries = malloc(capacity * sizeof(*map->entries));                   \
+    map->ctrl    = calloc(capacity, sizeof(*map->ctrl));                       \
+    if (!map->entries || !map->ctrl) {                                         \
+        free(map->entries);                                                    \
+        free(map->ctrl);                                                       \
+        map->entries = entries;                                                \
+        map->ctrl    = ctrl;                                                   \
+        return -ENOMEM;                                                        \
+    }                                                                          \
+                                                                               \
+    map->size       = 0;                                                       \
+    map->tombstones = 0;                                                       \
+    map->capacity   = capacity;                                                \
+                                                                               \
+    for (i = 0; i < old_capacity; ++i) {                                       \
+        if (ctrl[i] & MAP_DEFINE_CTRL_FULL)                                    \
+            name##_place(map, entries[i].key, entries[i].val,                  \
+                         name##_hash(entries[i].key));                         \
+    }                                                                          \
+                                                                               \
+    free(entries);                                                             \
+    free(ctrl);                                                                \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline int name##_insert(struct name *__restrict map,                   \
+                                key_t key,                                     \
+                                val_t val)                                     \
+{                                                                              \
+    unsigned int hash = name##_hash(key);                                      \
+    unsigned int mask = map->capacity - 1;                                     \
+    unsigned int i = hash & mask;                                              \
+    unsigned int step = 0;                                                     \
+    unsigned int slot = map->capacity;                                         \
+    unsigned char tag = __map_define_tag(hash);                                \
+    int err;                                                                   \
+                                                                               \
+    /* look for 'key' and remember the first free slot on the way */           \
+    for (;;) {                                                                 \
+        if (map->ctrl[i] == tag && eq_fn(map->entries[i].key, key)) {          \
+            map->entries[i].val = val;                                         \
+            return 0;                                                          \
+        }                                                                      \
+                                                                               \
+        if (map->ctrl[i] == MAP_DEFINE_CTRL_EMPTY)                             \
+            break;                                                             \
+                                                                               \
+        if (map->ctrl[i] == MAP_DEFINE_CTRL_DELETED && slot == map->capacity)  \
+            slot = i;                                                          \
+                                                                               \
+        i = (i + ++step) & mask;                                               \
+    }                                                                          \
+                                                                               \
+    if (slot != map->capacity) {                                               \
+        map->tombstones -= 1;                                                  \
+        i = slot;                                                              \
+    } else if (4 * (map->size + map->tombstones + 1) > 3 * map->capacity) {    \
+        /* at most 3/4 of the slots may be in use, tombstones included */      \
+        err = name##_resize(map, (2 * (map->size + 1) > map->capacity)         \
+                                 ? map->capacity << 1 : map->capacity);        \
+        if (err < 0)                                                           \
+            return err;                                                        \
+                                                                               \
+        name##_place(map, key, val, hash);                                     \
+        return 0;                                                              \
+    }                                                                          \
+                                                                               \
+    map->ctrl[i]        = tag;                                                 \
+    map->entries[i].key = key;                                                 \
+    map->entries[i].val = val;                                                 \
+    map->size          += 1;                                                   \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline val_t *name##_retrieve(struct name *__restrict map, key_t key)   \
+{                                                                              \
+    unsigned int i = name##_find(map, key, name##_hash(key));                  \
+                                                                               \
+    return (i != map->capacity) ? &map->entries[i].val : NULL;                 \
+}                                                                              \
+                                                                               \
+static inline bool name##_contains(const struct name *__restrict map,          \
+                                   key_t key)                                  \
+{                                                                              \
+    return name##_find(map, key, name##_hash(key))                             \
+           != map->capacity;                                                   \
+}                                                                              \
+                                                                               \
+/* stores the value in 'val' if it isn't NULL */                               \
+static inline bool name##_take(struct name *__restrict map,                    \
+                               key_t key,                                      \
+                               val_t *val)                                     \
+{                                                                              \
+    unsigned int i = name##_find(map, key, name##_hash(key));                  \
+                                                                               \
+    if (i == map->capacity)                                                    \
+        return false;                                                          \
+                                                                               \
+    if (val)                                                                   \
+        *val = map->entries[i].val;                                            \
+                                                                               \
+    map->ctrl[i]     = MAP_DEFINE_CTRL_DELETED;                                \
+    map->size       -= 1;                                                      \
+    map->tombstones += 1;                                                      \
+                                                                               \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+static inline unsigned int name##_size(const struct name *__restrict map)      \
+{                                                                              \
+    return map->size;                                                          \
+}
+
+#endif /* _MAP_DEFINE_H_ */
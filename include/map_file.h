@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _MAP_FILE_H_
+#define _MAP_FILE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "map.h"
+
+/*
+ * A read-only snapshot of a map in a flat file. The file is mmap()ed
+ * and queried in place, without parsing or allocations, so several
+ * processes share the same pages. Offsets in the file are relative to
+ * its start and the byte order is the one of the writer.
+ */
+
+enum map_file_key {
+    /* keys are integers cast to 'const void *' */
+    MAP_FILE_KEY_INT,
+    /* keys are NUL-terminated strings */
+    MAP_FILE_KEY_STRING,
+};
+
+struct map_file {
+    const void *addr;
+    size_t len;
+    
+    const struct map_file_header *header;
+    const struct map_file_slot *slots;
+};
+
+/*
+ * Writes the entries of 'map' to 'path', replacing the file atomically.
+ * 'data_size' returns how many bytes 'data' points to, which are copied
+ * into the file. Without it the data pointer itself is stored as an
+ * integer of 8 bytes.
+ */
+int map_file_write(const struct map *__restrict map,
+                   const char *__restrict path,
+                   enum map_file_key key_type,
+                   size_t (*data_size)(const void *));
+
+struct map_file *map_file_new(const char *__restrict path);
+
+void map_file_delete(struct map_file *__restrict file);
+
+int map_file_init(struct map_file *__restrict file,
+                  const char *__restrict path);
+
+void map_file_destroy(struct map_file *__restrict file);
+
+/*
+ * Returns a pointer into the file to the data of 'key' and stores its
+ * size in 'size' if not NULL. Data is aligned to 8 bytes.
+ */
+const void *map_file_retrieve(const struct map_file *__restrict file,
+                              const void *key,
+                              size_t *size);
+
+bool map_file_contains(const struct map_file *__restrict file,
+                       const void *key);
+
+unsigned long map_file_size(const struct map_file *__restrict file);
+
+enum map_file_key map_file_key_type(const struct map_file *__restrict file);
+
+#endif /* _MAP_FILE_H_ */
@@ -0,0 +1,650 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _SORT_DEFINE_H_
+#define _SORT_DEFINE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+
+/*
+ * Sorting functions for arrays of any type with an inlined comparison,
+ * used by struct vector and VECTOR_DEFINE.
+ *
+ * SORT_DEFINE(name, T, cmp_fn) generates
+ *   void name_sort(T *a, size_t n)          pattern-defeating quicksort
+ *   int name_sort_stable(T *a, size_t n)    merge sort, -ENOMEM on failure
+ * where 'cmp_fn(a, b)' compares two elements like a data_compare function.
+ * SORT_DEFINE_CTX(name, T, ctx_t, cmp_fn) does the same for
+ * 'cmp_fn(ctx, a, b)', the generated functions take 'ctx' as last
+ * argument.
+ *
+ * SORT_DEFINE_RADIX(name, T, key_fn) generates int name_sort_radix(T *a,
+ * size_t n), a LSD radix sort by the unsigned long 'key_fn(x)'. Use
+ * SORT_KEY_SIGNED() for signed keys.
+ * SORT_DEFINE_STRING(name, T, str_fn) generates int name_sort_string(T *a,
+ * size_t n), a MSD radix sort by the string 'str_fn(x)' in strcmp() order.
+ */
+
+#define SORT_INSERTION_THRESHOLD 24
+#define SORT_NINTHER_THRESHOLD 128
+#define SORT_PARTIAL_INSERTION_LIMIT 8
+#define SORT_MERGE_RUN 32
+#define SORT_RADIX_THRESHOLD 64
+#define SORT_STRING_THRESHOLD 32
+
+/* maps signed integers to unsigned ones with the same order */
+#define SORT_KEY_SIGNED(x)                                                     \
+    ((unsigned long) (long) (x) ^ (1ul << (8 * sizeof(long) - 1)))
+
+#define __sort_define_call(cmp_fn, ctx, a, b)                                  \
+    cmp_fn(a, b)
+
+#define __sort_define_call_ctx(cmp_fn, ctx, a, b)                              \
+    cmp_fn(ctx, a, b)
+
+#define __SORT_DEFINE(name, T, ctx_t, cmp_fn, call)                            \
+                                                                               \
+static inline bool name##_less(ctx_t ctx, T const *a, T const *b)              \
+{                                                                              \
+    (void) ctx;                                                                \
+                                                                               \
+    return call(cmp_fn, ctx, *a, *b) < 0;                                      \
+}                                                                              \
+                                                                               \
+static inline void name##_swap(T *a, T *b)                                     \
+{                                                                              \
+    T tmp = *a;                                                                \
+                                                                               \
+    *a = *b;                                                                   \
+    *b = tmp;                                                                  \
+}                                                                              \
+                                                                               \
+/* sorts *a <= *b <= *c */                                                     \
+static inline void name##_sort3(ctx_t ctx, T *a, T *b, T *c)                   \
+{                                                                              \
+    if (name##_less(ctx, b, a))                                                \
+        name##_swap(a, b);                                                     \
+                                                                               \
+    if (name##_less(ctx, c, b)) {                                              \
+        name##_swap(b, c);                                                     \
+                                                                               \
+        if (name##_less(ctx, b, a))                                            \
+            name##_swap(a, b);                                                 \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline void name##_insertion(ctx_t ctx, T *a, size_t n)                 \
+{                                                                              \
+    size_t i, j;                                                               \
+    T tmp;                                                                     \
+                                                                               \
+    for (i = 1; i < n; ++i) {                                                  \
+        if (!name##_less(ctx, a + i, a + i - 1))                               \
+            continue;                                                          \
+                                                                               \
+        tmp = a[i];                                                            \
+        j   = i;                                                               \
+                                                                               \
+        do {                                                                   \
+            a[j] = a[j - 1];                                                   \
+            --j;                                                               \
+        } while (j > 0 && name##_less(ctx, &tmp, a + j - 1));                  \
+                                                                               \
+        a[j] = tmp;                                                            \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* a[-1] is not greater than any element and stops the search */               \
+static inline void name##_insertion_unguarded(ctx_t ctx, T *a, size_t n)       \
+{                                                                              \
+    size_t i, j;                                                               \
+    T tmp;                                                                     \
+                                                                               \
+    for (i = 1; i < n; ++i) {                                                  \
+        if (!name##_less(ctx, a + i, a + i - 1))                               \
+            continue;                                                          \
+                                                                               \
+        tmp = a[i];                                                            \
+        j   = i;                                                               \
+                                                                               \
+        do {                                                                   \
+            a[j] = a[j - 1];                                                   \
+            --j;                                                               \
+        } while (name##_less(ctx, &tmp, a + j - 1));                           \
+                                                                               \
+        a[j] = tmp;                                                            \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/* gives up once more than a few elements had to be moved */                   \
+static inline bool name##_insertion_partial(ctx_t ctx, T *a, size_t n)         \
+{                                                                              \
+    size_t i, j, moves = 0;                                                    \
+    T tmp;                                                                     \
+                                                                               \
+    for (i = 1; i < n; ++i) {                                                  \
+        if (!name##_less(ctx, a + i, a + i - 1))                               \
+            continue;                                                          \
+                                                                               \
+        tmp = a[i];                                                            \
+        j   = i;                                                               \
+                                                                               \
+        do {                                                                   \
+            a[j] = a[j - 1];                                                   \
+            --j;                                                               \
+        } while (j > 0 && name##_less(ctx, &tmp, a + j - 1));                  \
+                                                                               \
+        a[j]   = tmp;                                                          \
+        moves += i - j;                                                        \
+                                                                               \
+        if (moves > SORT_PARTIAL_INSERTION_LIMIT)                              \
+            return false;                                                      \
+    }                                                                          \
+                                                                               \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+static inline void name##_sift(ctx_t ctx, T *a, size_t i, size_t n)            \
+{                                                                              \
+    size_t child;                                                              \
+    T tmp = a[i];                                                              \
+                                                                               \
+    while ((child = 2 * i + 1) < n) {                                          \
+        if (child + 1 < n && name##_less(ctx, a + child, a + child + 1))       \
+            child += 1;                                                        \
+                                                                               \
+        if (!name##_less(ctx, &tmp, a + child))                                \
+            break;                                                             \
+                                                                               \
+        a[i] = a[child];                                                       \
+        i    = child;                                                          \
+    }                                                                          \
+                                                                               \
+    a[i] = tmp;                                                                \
+}                                                                              \
+                                                                               \
+static inline void name##_heapsort(ctx_t ctx, T *a, size_t n)                  \
+{                                                                              \
+    size_t i;                                                                  \
+                                                                               \
+    for (i = n / 2; i-- > 0;)                                                  \
+        name##_sift(ctx, a, i, n);                                             \
+                                                                               \
+    while (n-- > 1) {                                                          \
+        name##_swap(a, a + n);                                                 \
+        name##_sift(ctx, a, 0, n);                                             \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+/*                                                                             \
+ * Partitions around the pivot a[0] into elements less than and not less       \
+ * than it, returns the final position of the pivot. 'partitioned' is set      \
+ * if no element had to be swapped.                                            \
+ */                                                                            \
+static inline size_t name##_partition_right(ctx_t ctx,                         \
+                                            T *a,                              \
+                                            size_t n,                          \
+                                            bool *partitioned)                 \
+{                                                                              \
+    size_t first = 0, last = n;                                                \
+    T pivot = a[0];                                                            \
+                                                                               \
+    /* the pivot selection guarantees an element not less than the pivot */    \
+    while (name##_less(ctx, a + ++first, &pivot))                              \
+        ;                                                                      \
+                                                                               \
+    if (first == 1) {                                                          \
+        while (first < last && !name##_less(ctx, a + --last, &pivot))          \
+            ;                                                                  \
+    } else {                                                                   \
+        while (!name##_less(ctx, a + --last, &pivot))                          \
+            ;                                                                  \
+    }                                                                          \
+                                                                               \
+    *partitioned = first >= last;                                              \
+                                                                               \
+    while (first < last) {                                                     \
+        name##_swap(a + first, a + last);                                      \
+                                                                               \
+        while (name##_less(ctx, a + ++first, &pivot))                          \
+            ;                                                                  \
+                                                                               \
+        while (!name##_less(ctx, a + --last, &pivot))                          \
+            ;                                                                  \
+    }                                                                          \
+                                                                               \
+    a[0]         = a[first - 1];                                               \
+    a[first - 1] = pivot;                                                      \
+                                                                               \
+    return first - 1;                                                          \
+}                                                                              \
+                                                                               \
+/*                                                                             \
+ * Puts the elements equal to the pivot a[0] to the left, used if the          \
+ * pivot equals the one of the enclosing partition.                            \
+ */                                                                            \
+static inline size_t name##_partition_left(ctx_t ctx, T *a, size_t n)          \
+{                                                                              \
+    size_t first = 0, last = n;                                                \
+    T pivot = a[0];                                                            \
+                                                                               \
+    while (name##_less(ctx, &pivot, a + --last))                               \
+        ;                                                                      \
+                                                                               \
+    if (last + 1 == n) {                                                       \
+        while (first < last && !name##_less(ctx, &pivot, a + ++first))         \
+            ;                                                                  \
+    } else {                                                                   \
+        while (!name##_less(ctx, &pivot, a + ++first))                         \
+            ;                                                                  \
+    }                                                                          \
+                                                                               \
+    while (first < last) {                                                     \
+        name##_swap(a + first, a + last);                                      \
+                                                                               \
+        while (name##_less(ctx, &pivot, a + --last))                           \
+            ;                                                                  \
+                                                                               \
+        while (!name##_less(ctx, &pivot, a + ++first))                         \
+            ;                                                                  \
+    }                                                                          \
+                                                                               \
+    a[0]    = a[last];                                                         \
+    a[last] = pivot;                                                           \
+                                                                               \
+    return last;                                                               \
+}                                                                              \
+                                                                               \
+/* pattern-defeating quicksort (Orson Peters), without block partitioning */   \
+static inline void name##_pdqsort(ctx_t ctx,                                   \
+                                  T *a,                                        \
+                                  size_t n,                                    \
+                                  unsigned int bad_allowed,                    \
+                                  bool leftmost)                               \
+{                                                                              \
+    size_t mid, pivot, l_size, r_size, q;                                      \
+    bool partitioned;                                                          \
+                                                                               \
+    while (n >= SORT_INSERTION_THRESHOLD) {                                    \
+        mid = n / 2;                                                           \
+                                                                               \
+        /* the median ends up in a[0] */                                       \
+        if (n > SORT_NINTHER_THRESHOLD) {                                      \
+            name##_sort3(ctx, a, a + mid, a + n - 1);                          \
+            name##_sort3(ctx, a + 1, a + mid - 1, a + n - 2);                  \
+            name##_sort3(ctx, a + 2, a + mid + 1, a + n - 3);                  \
+            name##_sort3(ctx, a + mid - 1, a + mid, a + mid + 1);              \
+            name##_swap(a, a + mid);                                           \
+        } else {                                                               \
+            name##_sort3(ctx, a + mid, a, a + n - 1);                          \
+        }                                                                      \
+                                                                               \
+        /*                                                                     \
+         * a[-1] is the pivot of the enclosing partition. If it equals this    \
+         * pivot, every element equal to it can be skipped.                    \
+         */                                                                    \
+        if (!leftmost && !name##_less(ctx, a - 1, a)) {                        \
+            pivot = name##_partition_left(ctx, a, n);                          \
+            a    += pivot + 1;                                                 \
+            n    -= pivot + 1;                                                 \
+            continue;                                                          \
+        }                                                                      \
+                                                                               \
+        pivot  = name##_partition_right(ctx, a, n, &partitioned);              \
+        l_size = pivot;                                                        \
+        r_size = n - pivot - 1;                                                \
+                                                                               \
+        if (l_size < n / 8 || r_size < n / 8) {                                \
+            if (--bad_allowed == 0) {                                          \
+                name##_heapsort(ctx, a, n);                                    \
+                return;                                                        \
+            }                                                                  \
+                                                                               \
+            /* break up patterns which led to the bad pivot */                 \
+            if (l_size >= SORT_INSERTION_THRESHOLD) {                          \
+                q = l_size / 4;                                                \
+                                                                               \
+                name##_swap(a, a + q);                                         \
+                name##_swap(a + pivot - 1, a + pivot - q);                     \
+                                                                               \
+                if (l_size > SORT_NINTHER_THRESHOLD) {                         \
+                    name##_swap(a + 1, a + q + 1);                             \
+                    name##_swap(a + 2, a + q + 2);                             \
+                    name##_swap(a + pivot - 2, a + pivot - q - 1);             \
+                    name##_swap(a + pivot - 3, a + pivot - q - 2);             \
+                }                                                              \
+            }                                                                  \
+                                                                               \
+            if (r_size >= SORT_INSERTION_THRESHOLD) {                          \
+                q = r_size / 4;                                                \
+                                                                               \
+                name##_swap(a + pivot + 1, a + pivot + 1 + q);                 \
+                name##_swap(a + n - 1, a + n - q);                             \
+                                                                               \
+                if (r_size > SORT_NINTHER_THRESHOLD) {                         \
+                    name##_swap(a + pivot + 2, a + pivot + 2 + q);             \
+                    name##_swap(a + pivot + 3, a + pivot + 3 + q);             \
+                    name##_swap(a + n - 2, a + n - 1 - q);                     \
+                    name##_swap(a + n - 3, a + n - 2 - q);                     \
+                }                                                              \
+            }                                                                  \
+        } else if (partitioned                                                 \
+                   && name##_insertion_partial(ctx, a, pivot)                  \
+                   && name##_insertion_partial(ctx, a + pivot + 1, r_size)) {  \
+            /* the input was (almost) sorted already */                        \
+            return;                                                            \
+        }                                                                      \
+                                                                               \
+        name##_pdqsort(ctx, a, l_size, bad_allowed, leftmost);                 \
+                                                                               \
+        a       += pivot + 1;                                                  \
+        n        = r_size;                                                     \
+        leftmost = false;                                                      \
+    }                                                                          \
+                                                                               \
+    if (leftmost)                                                              \
+        name##_insertion(ctx, a, n);                                           \
+    else                                                                       \
+        name##_insertion_unguarded(ctx, a, n);                                 \
+}                                                                              \
+                                                                               \
+static inline void name##_sort_ctx(T *a, size_t n, ctx_t ctx)                  \
+{                                                                              \
+    unsigned int log = 0;                                                      \
+                                                                               \
+    for (size_t m = n; m > 1; m >>= 1)                                         \
+        log += 1;                                                              \
+                                                                               \
+    name##_pdqsort(ctx, a, n, log + 1, true);                                  \
+}                                                                              \
+                                                                               \
+/* merges a[0..mid) and a[mid..n), 'buf' holds at least 'mid' elements */      \
+static inline void name##_merge(ctx_t ctx,                                     \
+                                T *a,                                          \
+                                size_t mid,                                    \
+                                size_t n,                                      \
+                                T *buf)                                        \
+{                                                                              \
+    size_t i = 0, j = mid, k = 0;                                              \
+                                                                               \
+    memcpy(buf, a, mid * sizeof(*a));                                          \
+                                                                               \
+    /* ties are taken from the left run, which keeps the sort stable */        \
+    while (i < mid && j < n) {                                                 \
+        if (name##_less(ctx, a + j, buf + i))                                  \
+            a[k++] = a[j++];                                                   \
+        else                                                                   \
+            a[k++] = buf[i++];                                                 \
+    }                                                                          \
+                                                                               \
+    memcpy(a + k, buf + i, (mid - i) * sizeof(*a));                            \
+}                                                                              \
+                                                                               \
+static inline int name##_sort_stable_ctx(T *a, size_t n, ctx_t ctx)            \
+{                                                                              \
+    size_t i, width, mid, end;                                                 \
+    T *buf;                                                                    \
+                                                                               \
+    for (i = 0; i < n; i += SORT_MERGE_RUN)                                    \
+        name##_insertion(ctx, a + i, (n - i < SORT_MERGE_RUN)                  \
+                                     ? n - i : SORT_MERGE_RUN);                \
+                                                                               \
+    if (n <= SORT_MERGE_RUN)                                                   \
+        return 0;                                                              \
+                                                                               \
+    /* the left run of the last merge may hold almost all elements */          \
+    buf = malloc(n * sizeof(*buf));                                            \
+    if (!buf)                                                                  \
+        return -ENOMEM;                                                        \
+                                                                               \
+    for (width = SORT_MERGE_RUN; width < n; width *= 2) {                      \
+        for (i = 0; i + width < n; i += 2 * width) {                           \
+            mid = width;                                                       \
+            end = (n - i < 2 * width) ? n - i : 2 * width;                     \
+                                                                               \
+            /* runs in order already, common for presorted input */            \
+            if (!name##_less(ctx, a + i + mid, a + i + mid - 1))               \
+                continue;                                                      \
+                                                                               \
+            name##_merge(ctx, a + i, mid, end, buf);                           \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    free(buf);                                                                 \
+                                                                               \
+    return 0;                                                                  \
+}
+
+#define SORT_DEFINE(name, T, cmp_fn)                                           \
+                                                                               \
+__SORT_DEFINE(name, T, void *, cmp_fn, __sort_define_call)                     \
+                                                                               \
+static inline void name##_sort(T *a, size_t n)                                 \
+{                                                                              \
+    name##_sort_ctx(a, n, NULL);                                               \
+}                                                                              \
+                                                                               \
+static inline int name##_sort_stable(T *a, size_t n)                           \
+{                                                                              \
+    return name##_sort_stable_ctx(a, n, NULL);                                 \
+}
+
+#define SORT_DEFINE_CTX(name, T, ctx_t, cmp_fn)                                \
+                                                                               \
+__SORT_DEFINE(name, T, ctx_t, cmp_fn, __sort_define_call_ctx)                  \
+                                                                               \
+static inline void name##_sort(T *a, size_t n, ctx_t ctx)                      \
+{                                                                              \
+    name##_sort_ctx(a, n, ctx);                                                \
+}                                                                              \
+                                                                               \
+static inline int name##_sort_stable(T *a, size_t n, ctx_t ctx)                \
+{                                                                              \
+    return name##_sort_stable_ctx(a, n, ctx);                                  \
+}
+
+#define SORT_DEFINE_RADIX(name, T, key_fn)                                     \
+                                                                               \
+static inline int name##_sort_radix(T *a, size_t n)                            \
+{                                                                              \
+    size_t (*count)[256], i, sum, tmp;                                         \
+    unsigned int pass, shift;                                                  \
+    unsigned long key;                                                         \
+    T *buf;                                                                    \
+    T *src;                                                                    \
+    T *dst;                                                                    \
+    T *swap;                                                                   \
+    T val;                                                                     \
+                                                                               \
+    if (n < SORT_RADIX_THRESHOLD) {                                            \
+        for (i = 1; i < n; ++i) {                                              \
+            size_t j = i;                                                      \
+                                                                               \
+            val = a[i];                                                        \
+            key = key_fn(val);                                                 \
+                                                                               \
+            for (; j > 0 && key < (unsigned long) key_fn(a[j - 1]); --j)       \
+                a[j] = a[j - 1];                                               \
+                                                                               \
+            a[j] = val;                                                        \
+        }                                                                      \
+                                                                               \
+        return 0;                                                              \
+    }                                                                          \
+                                                                               \
+    /* one histogram per byte of the key */                                    \
+    count = calloc(sizeof(unsigned long), sizeof(*count));                     \
+    buf   = malloc(n * sizeof(*buf));                                          \
+    if (!count || !buf) {                                                      \
+        free(count);                                                           \
+        free(buf);                                                             \
+        return -ENOMEM;                                                        \
+    }                                                                          \
+                                                                               \
+    /* all histograms in a single pass over the input */                       \
+    for (i = 0; i < n; ++i) {                                                  \
+        key = key_fn(a[i]);                                                    \
+                                                                               \
+        for (pass = 0; pass < sizeof(unsigned long); ++pass)                   \
+            count[pass][(key >> (8 * pass)) & 0xff] += 1;                      \
+    }                                                                          \
+                                                                               \
+    src = a;                                                                   \
+    dst = buf;                                                                 \
+                                                                               \
+    for (pass = 0; pass < sizeof(unsigned long); ++pass) {                     \
+        shift = 8 * pass;                                                      \
+                                                                               \
+        /* every key has the same byte here */                                 \
+        key = key_fn(src[0]);                                                  \
+        if (count[pass][(key >> shift) & 0xff] == n)                           \
+            continue;                                                          \
+                                                                               \
+        for (i = 0, sum = 0; i < 256; ++i) {                                   \
+            tmp             = count[pass][i];                                  \
+            count[pass][i]  = sum;                                             \
+            sum            += tmp;                                             \
+        }                                                                      \
+                                                                               \
+        for (i = 0; i < n; ++i) {                                              \
+            key = key_fn(src[i]);                                              \
+            dst[count[pass][(key >> shift) & 0xff]++] = src[i];                \
+        }                                                                      \
+                                                                               \
+        swap = src;                                                            \
+        src  = dst;                                                            \
+        dst  = swap;                                                           \
+    }                                                                          \
+                                                                               \
+    if (src != a)                                                              \
+        memcpy(a, src, n * sizeof(*a));                                        \
+                                                                               \
+    free(buf);                                                                 \
+    free(count);                                                               \
+                                                                               \
+    return 0;                                                                  \
+}
+
+#define SORT_DEFINE_STRING(name, T, str_fn)                                    \
+                                                                               \
+static inline void name##_string_insertion(T *a, size_t n, size_t depth)       \
+{                                                                              \
+    const char *s;                                                             \
+    size_t i, j;                                                               \
+    T tmp;                                                                     \
+                                                                               \
+    /* all strings share their first 'depth' characters */                     \
+    for (i = 1; i < n; ++i) {                                                  \
+        tmp = a[i];                                                            \
+        s   = (const char *) str_fn(tmp) + depth;                              \
+                                                                               \
+        for (j = i; j > 0 && strcmp(s, str_fn(a[j - 1]) + depth) < 0; --j)     \
+            a[j] = a[j - 1];                                                   \
+                                                                               \
+        a[j] = tmp;                                                            \
+    }                                                                          \
+}                                                                              \
+                                                                               \
+static inline void name##_string_msd(T *a,                                     \
+                                     T *buf,                                   \
+                                     size_t n,                                 \
+                                     size_t depth)                             \
+{                                                                              \
+    size_t count[256], start[256], i, largest;                                 \
+    unsigned char c;                                                           \
+                                                                               \
+    while (n >= SORT_STRING_THRESHOLD) {                                       \
+        memset(count, 0, sizeof(count));                                       \
+                                                                               \
+        for (i = 0; i < n; ++i)                                                \
+            count[(unsigned char) str_fn(a[i])[depth]] += 1;                   \
+                                                                               \
+        /* a common prefix needs no distribution */                            \
+        c = (unsigned char) str_fn(a[0])[depth];                               \
+        if (count[c] == n) {                                                   \
+            if (c == '\0')                                                     \
+                return;                                                        \
+                                                                               \
+            depth += 1;                                                        \
+            continue;                                                          \
+        }                                                                      \
+                                                                               \
+        for (i = 0, start[0] = 0; i < 255; ++i)                                \
+            start[i + 1] = start[i] + count[i];                                \
+                                                                               \
+        for (i = 0; i < n; ++i)                                                \
+            buf[start[(unsigned char) str_fn(a[i])[depth]]++] = a[i];          \
+                                                                               \
+        memcpy(a, buf, n * sizeof(*a));                                        \
+                                                                               \
+        /*                                                                     \
+         * Strings which ended are equal and done, recurse into the smaller    \
+         * buckets and loop over the largest one, which bounds the depth of    \
+         * the recursion.                                                      \
+         */                                                                    \
+        largest = 1;                                                           \
+                                                                               \
+        for (i = 2; i < 256; ++i) {                                            \
+            if (count[i] > count[largest])                                     \
+                largest = i;                                                   \
+        }                                                                      \
+                                                                               \
+        for (i = 1; i < 256; ++i) {                                            \
+            if (i != largest && count[i] > 1)                                  \
+                name##_string_msd(a + start[i] - count[i], buf,                \
+                                  count[i], depth + 1);                        \
+        }                                                                      \
+                                                                               \
+        a     += start[largest] - count[largest];                              \
+        n      = count[largest];                                               \
+        depth += 1;                                                            \
+    }                                                                          \
+                                                                               \
+    name##_string_insertion(a, n, depth);                                      \
+}                                                                              \
+                                                                               \
+static inline int name##_sort_string(T *a, size_t n)                           \
+{                                                                              \
+    T *buf;                                                                    \
+                                                                               \
+    if (n < SORT_STRING_THRESHOLD) {                                           \
+        name##_string_insertion(a, n, 0);                                      \
+        return 0;                                                              \
+    }                                                                          \
+                                                                               \
+    buf = malloc(n * sizeof(*buf));                                            \
+    if (!buf)                                                                  \
+        return -ENOMEM;                                                        \
+                                                                               \
+    name##_string_msd(a, buf, n, 0);                                           \
+                                                                               \
+    free(buf);                                                                 \
+                                                                               \
+    return 0;                                                                  \
+}
+
+#endif /* _SORT_DEFINE_H_ */
@@ -27,21 +27,217 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <sched.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 
+#include "clock.h"
 #include "link.h"
 #include "map.h"
 #include "queue.h"
 
+/* 
+ * Workers are kept in an array allocated once, so every pool has a cap on
+ * its threads. It is this default unless 'max_threads' is larger.
+ */
+#define THREADPOOL_DEFAULT_MAX_THREADS 256
+#define THREADPOOL_DEFAULT_QUEUE_SIZE 4096
+#define THREADPOOL_DEFAULT_IDLE_TIMEOUT 1000
+#define THREADPOOL_DEFAULT_GROW_QUEUE_DEPTH 64
+
+enum threadpool_mode {
+    /* all workers share 'task_queue_in' */
+    THREADPOOL_MODE_SHARED_QUEUE,
+    /* 
+     * each worker has its own deque and steals from the others if idle,
+     * tasks added from within a worker go onto the worker's own deque
+     */
+    THREADPOOL_MODE_WORK_STEALING
+};
+
+/* 
+ * Strict priorities: a task is only dispatched if no task 
+ * with a higher priority is queued.
+ */
+enum threadpool_priority {
+    THREADPOOL_PRIORITY_HIGH,
+    THREADPOOL_PRIORITY_NORMAL,
+    THREADPOOL_PRIORITY_LOW
+};
+
+#define THREADPOOL_PRIORITIES 3
+#define THREADPOOL_WAIT_BUCKETS 32
+
+/* task doesn't go into the completion queue and isn't counted by 'event_fd' */
+#define THREADPOOL_TASK_DETACHED 0x01
+
+struct threadpool_future;
+
 struct threadpool_task {
     struct link link;
     void (*func)(struct threadpool_task *);
+    
+    /* only called for detached tasks, right after 'func' on the worker */
+    void (*complete)(struct threadpool_task *);
+    unsigned int flags;
+    
+    /* completed instead of handing out the task, see threadpool_future_init() */
+    struct threadpool_future *future;
+    
+    enum threadpool_priority priority;
+    unsigned long enqueued_ns;
+};
+
+struct threadpool_config {
+    int threads;
+    /* 
+     * upper limit for threadpool_add_thread(), at least 'threads', 
+     * THREADPOOL_DEFAULT_MAX_THREADS if 0 or less
+     */
+    int max_threads;
+    
+    /* capacity of the lock-free task rings, excess tasks are kept in a list */
+    unsigned int queue_size;
+    
+    /* costs two clock_gettime() calls per task */
+    bool measure_wait_time;
+    /* as above, needed for the 'busy_ns' and 'idle_ns' worker stats */
+    bool measure_busy_time;
+    
+    /* 
+     * Keep the last 'trace_size' (rounded up to a power of two) events
+     * per worker, see threadpool_trace(). 0 turns tracing off.
+     */
+    unsigned int trace_size;
+    
+    /* 
+     * restrict the workers to these cpus, NULL for the process' affinity,
+     * threadpool_init_config() fails with -EINVAL if the set is empty
+     */
+    const cpu_set_t *cpus;
+    /* pin each worker to a single cpu */
+    bool pin_threads;
+    /* 
+     * spread the workers evenly over the NUMA nodes, each node gets its
+     * own task queue, see threadpool_add_task_node()
+     */
+    bool numa;
+    
+    /*
+     * Elastic pools start another worker (up to 'max_threads') if no
+     * worker is idle and 'grow_queue_depth' tasks are queued, or a task
+     * waited longer than 'grow_wait_ns' (needs 'measure_wait_time').
+     * Workers idle for 'idle_timeout_ms' exit until 'min_threads' are left.
+     */
+    bool elastic;
+    int min_threads;
+    unsigned long idle_timeout_ms;
+    unsigned int grow_queue_depth;
+    unsigned long grow_wait_ns;
+    
+    enum threadpool_mode mode;
+};
+
+/*
+ * Completion of a single task, as an alternative to the completion queue.
+ * Continuations added with threadpool_future_then() run on the worker
+ * right after the task, before any waiter gets to see the result.
+ */
+struct threadpool_future {
+    struct queue continuations;
+    
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    
+    unsigned int waiters;
+    bool done;
+};
+
+struct threadpool_priority_stats {
+    unsigned long queued;
+    unsigned long dispatched;
+    
+    /* only available if 'measure_wait_time' is set */
+    unsigned long wait_ns;
+    unsigned long wait_max_ns;
+    
+    /* bucket i counts the tasks which waited [2^i, 2^(i + 1)) ns */
+    unsigned long wait_histogram[THREADPOOL_WAIT_BUCKETS];
+};
+
+struct threadpool_worker_stats {
+    unsigned long tasks;
+    unsigned long steals;
+    
+    /* only available if 'measure_busy_time' is set */
+    unsigned long busy_ns;
+    unsigned long idle_ns;
+    
+    /* most tasks on the worker's own deque at once */
+    unsigned long queue_max;
 };
 
+struct threadpool_stats {
+    unsigned int threads;
+    unsigned int idle;
+    
+    unsigned long queued;
+    /* most tasks in one of the shared task rings at once */
+    unsigned long queue_max;
+    
+    /* summed up over all workers, including the ones which exited */
+    struct threadpool_worker_stats workers;
+};
+
+/* timestamps are ns since the pool was initialized */
+struct threadpool_trace_event {
+    const struct threadpool_task *task;
+    unsigned int worker;
+    
+    unsigned long enqueued_ns;
+    unsigned long started_ns;
+    unsigned long finished_ns;
+};
+
+struct threadpool_worker;
+struct threadpool_node;
+struct mpmc_ring;
+
 struct threadpool {
-    struct queue task_queue_in;
+    struct mpmc_ring *ring_in[THREADPOOL_PRIORITIES];
+    struct mpmc_ring *ring_out;
+    struct queue task_queue_in[THREADPOOL_PRIORITIES];
     struct queue task_queue_out;
     struct map thread_map;
+    
+    struct threadpool_worker *workers;
+    unsigned int workers_used;
+    unsigned int workers_max;
+    unsigned int workers_idle;
+    unsigned int workers_retire;
+    unsigned int workers_min;
+    unsigned int consumers_idle;
+    
+    struct threadpool_node *nodes;
+    unsigned int node_count;
+    
+    enum threadpool_mode mode;
+    bool measure_wait_time;
+    bool set_affinity;
+    bool pin_threads;
+    bool measure_busy_time;
+    
+    unsigned long queue_max;
+    
+    struct clock trace_clock;
+    unsigned long trace_epoch_ns;
+    unsigned long trace_mask;
+    
+    bool elastic;
+    unsigned long idle_timeout_ms;
+    unsigned int grow_queue_depth;
+    unsigned long grow_wait_ns;
 
     sem_t sem_queue_in;
     sem_t sem_queue_out;
@@ -56,24 +252,181 @@ struct threadpool {
 
 struct threadpool *threadpool_new(int threads);
 
+struct threadpool *
+threadpool_new_config(const struct threadpool_config *__restrict conf);
+
 void threadpool_delete(struct threadpool *__restrict pool);
 
 int threadpool_init(struct threadpool *__restrict pool, int threads);
 
+int threadpool_init_config(struct threadpool *__restrict pool,
+                           const struct threadpool_config *__restrict conf);
+
 void threadpool_destroy(struct threadpool *__restrict pool);
 
 int threadpool_event_fd(const struct threadpool *__restrict pool);
 
+/* 
+ * Fails with -EAGAIN once the pool has 'max_threads' workers, which is
+ * THREADPOOL_DEFAULT_MAX_THREADS for pools from threadpool_new().
+ */
 int threadpool_add_thread(struct threadpool *__restrict pool);
 
+/* 
+ * Lets the next worker which is idle or done with its task exit, 
+ * fails with -EINVAL if all workers are already asked to exit.
+ * Before elastic pools this always returned 0, callers that ignored the
+ * return value may now see -EINVAL for surplus requests.
+ */
 int threadpool_remove_thread(struct threadpool *__restrict pool);
 
+unsigned int threadpool_thread_count(struct threadpool *__restrict pool);
+
 int threadpool_add_task(struct threadpool *__restrict pool, 
                         struct threadpool_task *task);
 
+int threadpool_add_tasks(struct threadpool *__restrict pool,
+                         struct threadpool_task **tasks,
+                         unsigned int n);
+
+int threadpool_add_task_priority(struct threadpool *__restrict pool,
+                                 struct threadpool_task *task,
+                                 enum threadpool_priority priority);
+
+int threadpool_add_tasks_priority(struct threadpool *__restrict pool,
+                                  struct threadpool_task **tasks,
+                                  unsigned int n,
+                                  enum threadpool_priority priority);
+
+/* 
+ * Tasks go into the queue of NUMA node 'node' and run on a worker of that
+ * node unless all workers of the node are busy and others are idle.
+ * 'node' is the index among the pool's nodes, counting only the nodes with
+ * an allowed cpu in ascending ID order, not the kernel's node ID.
+ */
+int threadpool_add_task_node(struct threadpool *__restrict pool,
+                             struct threadpool_task *task,
+                             unsigned int node);
+
+int threadpool_add_tasks_node(struct threadpool *__restrict pool,
+                              struct threadpool_task **tasks,
+                              unsigned int n,
+                              unsigned int node);
+
+int threadpool_add_detached_task(struct threadpool *__restrict pool,
+                                 struct threadpool_task *task,
+                                 void (*complete)(struct threadpool_task *));
+
+int threadpool_future_init(struct threadpool_future *__restrict future);
+
+void threadpool_future_destroy(struct threadpool_future *__restrict future);
+
+/* 
+ * 'task' completes 'future' instead of going into the completion queue,
+ * the task may be freed as soon as the future is done.
+ */
+int threadpool_add_task_future(struct threadpool *__restrict pool,
+                               struct threadpool_task *task,
+                               struct threadpool_future *future);
+
+bool threadpool_future_done(struct threadpool_future *__restrict future);
+
+void threadpool_future_wait(struct threadpool_future *__restrict future);
+
+/* returns -ETIMEDOUT if 'future' isn't done after 'timeout_ms' */
+int threadpool_future_wait_timeout(struct threadpool_future *__restrict future,
+                                   unsigned long timeout_ms);
+
+/*
+ * Runs 'task' once 'future' is done and completes 'next' afterwards.
+ * If 'next' is NULL 'task' goes into the completion queue instead.
+ * If 'future' is already done 'task' is simply added to the pool.
+ */
+int threadpool_future_then(struct threadpool *__restrict pool,
+                           struct threadpool_future *future,
+                           struct threadpool_task *task,
+                           struct threadpool_future *next);
+
+/* completes 'future' once all 'n' 'futures' are done */
+int threadpool_when_all(struct threadpool *__restrict pool,
+                        struct threadpool_future **futures,
+                        unsigned int n,
+                        struct threadpool_future *future);
+
 struct threadpool_task *
 threadpool_take_completed_task(struct threadpool *__restrict pool);
 
+/*
+ * Takes up to 'max' completed tasks without blocking and returns how many
+ * were taken. Meant to be called once after reading threadpool_event_fd(),
+ * the number of returned tasks may differ from the value read.
+ */
+unsigned int threadpool_take_completed_tasks(struct threadpool *__restrict pool,
+                                             struct threadpool_task **tasks,
+                                             unsigned int max);
+
+/*
+ * Calls 'func' for disjoint subranges which cover [begin, end) and returns
+ * once all of them are done. Ranges are halved recursively down to 'grain'
+ * elements, a 'grain' of 0 picks one based on the number of workers.
+ * The calling thread works on the range as well and runs queued tasks
+ * while it waits, so it is safe to call this from within a task.
+ */
+int threadpool_parallel_for(struct threadpool *__restrict pool,
+                            long begin,
+                            long end,
+                            long grain,
+                            void (*func)(long, long, void *),
+                            void *arg);
+
+/*
+ * Like threadpool_parallel_for(), but 'func' accumulates into a partial
+ * result of 'size' bytes which 'combine' merges into 'result' afterwards.
+ * 'result' has to hold the identity element on entry, every partial result
+ * starts out as a copy of it. 'combine' is never called concurrently, but
+ * in no particular order. Fails with -EINVAL if 'size' is 0.
+ */
+int threadpool_parallel_reduce(struct threadpool *__restrict pool,
+                               long begin,
+                               long end,
+                               long grain,
+                               void (*func)(long, long, void *, void *),
+                               void (*combine)(void *, const void *, void *),
+                               void *result,
+                               size_t size,
+                               void *arg);
+
 unsigned int threadpool_tasks_queued(struct threadpool *pool);
 
+unsigned int threadpool_node_count(const struct threadpool *__restrict pool);
+
+int threadpool_priority_stats(struct threadpool *__restrict pool,
+                              enum threadpool_priority priority,
+                              struct threadpool_priority_stats *stats);
+
+void threadpool_stats(struct threadpool *__restrict pool,
+                      struct threadpool_stats *stats);
+
+/* 
+ * Stats of the worker in slot 'index', slots of exited workers are reused.
+ * Returns -EINVAL if 'index' is past the last slot ever used.
+ */
+int threadpool_worker_stats(struct threadpool *__restrict pool,
+                            unsigned int index,
+                            struct threadpool_worker_stats *stats);
+
+/*
+ * Copies up to 'max' of the most recent events, grouped by worker, and
+ * returns how many were copied. Safe to call while tasks are running.
+ */
+unsigned int threadpool_trace(struct threadpool *__restrict pool,
+                              struct threadpool_trace_event *events,
+                              unsigned int max);
+
+/* 
+ * Writes one line "worker task enqueued_ns started_ns finished_ns"
+ * per event to 'file'.
+ */
+int threadpool_trace_dump(struct threadpool *__restrict pool, FILE *file);
+
 #endif /* _THREADPOOL_H_ */
\ No newline at end of file
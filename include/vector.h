@@ -27,6 +27,8 @@
 
 #include <stdbool.h>
 
+struct threadpool;
+
 struct vector {
     int (*data_compare)(const void *, const void *);
     void (*data_delete)(void *);
@@ -70,6 +72,16 @@ int vector_insert_at(struct vector *__restrict vec, unsigned int i, void *data);
 
 int vector_insert_back(struct vector *__restrict vec, void *data);
 
+/* inserts 'n' elements at 'i' with at most one reallocation */
+int vector_insert_range(struct vector *__restrict vec,
+                        unsigned int i,
+                        void *const *data,
+                        unsigned int n);
+
+int vector_append_array(struct vector *__restrict vec,
+                        void *const *data,
+                        unsigned int n);
+
 void *vector_take_front(struct vector *__restrict vec);
 
 void *vector_take_at(struct vector *__restrict vec, unsigned int i);
@@ -86,10 +98,48 @@ void **vector_front(struct vector *__restrict vec);
 
 void **vector_back(struct vector *__restrict vec);
 
+/* pattern-defeating quicksort, not stable */
 void vector_sort(struct vector *__restrict vec);
 
+/* merge sort, keeps the order of equal elements */
+int vector_sort_stable(struct vector *__restrict vec);
+
+/*
+ * Radix sorts which ignore 'data_compare': vector_sort_long() for data
+ * which are integers cast to 'void *', vector_sort_string() for
+ * NUL-terminated strings in strcmp() order.
+ */
+int vector_sort_long(struct vector *__restrict vec);
+
+int vector_sort_string(struct vector *__restrict vec);
+
+/*
+ * Sorts chunks of 'vec' on the workers of 'pool' and the calling thread,
+ * then merges them in parallel. Not stable, 'data' is replaced.
+ */
+int vector_sort_parallel(struct vector *__restrict vec,
+                         struct threadpool *pool);
+
+/*
+ * Appends the elements of the 'n' sorted vectors 'src' to 'dst' in the
+ * order of 'dst's data_compare. The merge is split into parts which run
+ * in parallel if 'pool' isn't NULL. 'dst' must not be one of 'src'.
+ */
+int vector_merge(struct vector *__restrict dst,
+                 struct vector **src,
+                 unsigned int n,
+                 struct threadpool *pool);
+
 int vector_insert_sorted(struct vector *__restrict vec, void *data);
 
+/*
+ * Sorts a copy of the 'n' elements of 'data' and merges it into the sorted
+ * 'vec' in one pass, instead of one binary search and memmove() each.
+ */
+int vector_insert_sorted_batch(struct vector *__restrict vec,
+                               void *const *data,
+                               unsigned int n);
+
 void *vector_take_sorted(struct vector *__restrict vec, void *data);
 
 unsigned int vector_index_of_sorted(const struct vector *__restrict vec, 
@@ -0,0 +1,343 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _VECTOR_DEFINE_H_
+#define _VECTOR_DEFINE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "sort_define.h"
+
+/*
+ * VECTOR_DEFINE(name, T, cmp_fn) generates 'struct name', a vector which
+ * stores its elements of type 'T' contiguously instead of pointers to
+ * them, together with the operations of struct vector: name_init(),
+ * name_insert_at(), name_take_at(), name_sort(), name_insert_sorted(),
+ * name_index_of_sorted() and so on.
+ * 'cmp_fn(a, b)' compares two elements like a data_compare function and
+ * can be a macro or a function, it is inlined instead of being called
+ * through a function pointer. The data of 'struct name' can be sorted
+ * with SORT_DEFINE_RADIX() and SORT_DEFINE_STRING() as well.
+ */
+
+#define VECTOR_DEFINE_DEFAULT_CAPACITY 8
+/* largest power of two an unsigned int holds */
+#define VECTOR_DEFINE_MAX_CAPACITY (1UL << 31)
+
+#define VECTOR_DEFINE_CMP(a, b)                                                \
+    (((a) > (b)) - ((a) < (b)))
+
+#define VECTOR_DEFINE_CMP_STRING(a, b)                                         \
+    strcmp((a), (b))
+
+#define vector_define_for_each(vec, p)                                         \
+    for ((p) = (vec)->data; (p) < (vec)->data + (vec)->size; ++(p))
+
+#define VECTOR_DEFINE(name, T, cmp_fn)                                         \
+                                                                               \
+struct name {                                                                  \
+    T *data;                                                                   \
+    unsigned int size;                                                         \
+    unsigned int capacity;                                                     \
+};                                                                             \
+                                                                               \
+static inline int name##_init(struct name *__restrict vec,                     \
+                              unsigned int capacity)                           \
+{                                                                              \
+    if (capacity < VECTOR_DEFINE_DEFAULT_CAPACITY)                             \
+        capacity = VECTOR_DEFINE_DEFAULT_CAPACITY;                             \
+                                                                               \
+    vec->data = malloc(capacity * sizeof(*vec->data));                         \
+    if (!vec->data)                                                            \
+        return -ENOMEM;                                                        \
+                                                                               \
+    vec->size     = 0;                                                         \
+    vec->capacity = capacity;                                                  \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline void name##_destroy(struct name *__restrict vec)                 \
+{                                                                              \
+    free(vec->data);                                                           \
+}                                                                              \
+                                                                               \
+static inline void name##_clear(struct name *__restrict vec)                   \
+{                                                                              \
+    vec->size = 0;                                                             \
+}                                                                              \
+                                                                               \
+static inline unsigned int name##_size(const struct name *__restrict vec)      \
+{                                                                              \
+    return vec->size;                                                          \
+}                                                                              \
+                                                                               \
+static inline bool name##_empty(const struct name *__restrict vec)             \
+{                                                                              \
+    return vec->size == 0;                                                     \
+}                                                                              \
+                                                                               \
+/* never drops elements, fails if 'capacity' is too small for them */          \
+static inline int name##_realloc(struct name *__restrict vec,                  \
+                                 unsigned int capacity)                        \
+{                                                                              \
+    T *data;                                                                   \
+                                                                               \
+    if (capacity < vec->size)                                                  \
+        return -EINVAL;                                                        \
+                                                                               \
+    if (capacity < VECTOR_DEFINE_DEFAULT_CAPACITY)                             \
+        capacity = VECTOR_DEFINE_DEFAULT_CAPACITY;                             \
+                                                                               \
+    data = realloc(vec->data, capacity * sizeof(*data));                       \
+    if (!data)                                                                 \
+        return -ENOMEM;                                                        \
+                                                                               \
+    vec->data     = data;                                                      \
+    vec->capacity = capacity;                                                  \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+/* drops the elements behind 'capacity' */                                     \
+static inline int name##_set_capacity(struct name *__restrict vec,             \
+                                      unsigned int capacity)                   \
+{                                                                              \
+    if (capacity < vec->size)                                                  \
+        vec->size = capacity;                                                  \
+                                                                               \
+    return name##_realloc(vec, capacity);                                      \
+}                                                                              \
+                                                                               \
+/* doubles the capacity, up to VECTOR_DEFINE_MAX_CAPACITY */                   \
+static inline int name##_grow(struct name *__restrict vec)                     \
+{                                                                              \
+    unsigned long capacity;                                                    \
+                                                                               \
+    if (vec->capacity >= VECTOR_DEFINE_MAX_CAPACITY)                           \
+        return -EOVERFLOW;                                                     \
+                                                                               \
+    capacity = 2UL * vec->capacity;                                            \
+                                                                               \
+    if (capacity > VECTOR_DEFINE_MAX_CAPACITY)                                 \
+        capacity = VECTOR_DEFINE_MAX_CAPACITY;                                 \
+                                                                               \
+    return name##_realloc(vec, (unsigned int) capacity);                       \
+}                                                                              \
+                                                                               \
+static inline int name##_squeeze(struct name *__restrict vec)                  \
+{                                                                              \
+    return name##_set_capacity(vec, vec->size);                                \
+}                                                                              \
+                                                                               \
+static inline T *name##_at(struct name *__restrict vec, unsigned int i)        \
+{                                                                              \
+    return vec->data + i;                                                      \
+}                                                                              \
+                                                                               \
+static inline T *name##_front(struct name *__restrict vec)                     \
+{                                                                              \
+    return vec->data;                                                          \
+}                                                                              \
+                                                                               \
+static inline T *name##_back(struct name *__restrict vec)                      \
+{                                                                              \
+    return vec->data + vec->size - 1;                                          \
+}                                                                              \
+                                                                               \
+static inline int name##_insert_at(struct name *__restrict vec,                \
+                                   unsigned int i,                             \
+                                   T val)                                      \
+{                                                                              \
+    int err;                                                                   \
+                                                                               \
+    if (vec->size >= vec->capacity) {                                          \
+        err = name##_grow(vec);                                                \
+        if (err < 0)                                                           \
+            return err;                                                        \
+    }                                                                          \
+                                                                               \
+    memmove(vec->data + i + 1, vec->data + i,                                  \
+            (vec->size - i) * sizeof(*vec->data));                             \
+                                                                               \
+    vec->data[i]  = val;                                                       \
+    vec->size    += 1;                                                         \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline int name##_insert_front(struct name *__restrict vec, T val)      \
+{                                                                              \
+    return name##_insert_at(vec, 0, val);                                      \
+}                                                                              \
+                                                                               \
+static inline int name##_insert_back(struct name *__restrict vec, T val)       \
+{                                                                              \
+    int err;                                                                   \
+                                                                               \
+    if (vec->size >= vec->capacity) {                                          \
+        err = name##_grow(vec);                                                \
+        if (err < 0)                                                           \
+            return err;                                                        \
+    }                                                                          \
+                                                                               \
+    vec->data[vec->size++] = val;                                              \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline T name##_take_at(struct name *__restrict vec, unsigned int i)    \
+{                                                                              \
+    T val = vec->data[i];                                                      \
+                                                                               \
+    vec->size -= 1;                                                            \
+                                                                               \
+    memmove(vec->data + i, vec->data + i + 1,                                  \
+            (vec->size - i) * sizeof(*vec->data));                             \
+                                                                               \
+    return val;                                                                \
+}                                                                              \
+                                                                               \
+static inline T name##_take_front(struct name *__restrict vec)                 \
+{                                                                              \
+    return name##_take_at(vec, 0);                                             \
+}                                                                              \
+                                                                               \
+static inline T name##_take_back(struct name *__restrict vec)                  \
+{                                                                              \
+    return vec->data[--vec->size];                                             \
+}                                                                              \
+                                                                               \
+/* returns (unsigned int) -1 if there's no element equal to 'val' */           \
+static inline unsigned int name##_index_of(const struct name *__restrict vec,  \
+                                           T val)                              \
+{                                                                              \
+    unsigned int i;                                                            \
+                                                                               \
+    for (i = 0; i < vec->size; ++i) {                                          \
+        if (cmp_fn(vec->data[i], val) == 0)                                    \
+            return i;                                                          \
+    }                                                                          \
+                                                                               \
+    return (unsigned int) -1;                                                  \
+}                                                                              \
+                                                                               \
+static inline bool name##_contains(const struct name *__restrict vec, T val)   \
+{                                                                              \
+    return name##_index_of(vec, val) != (unsigned int) -1;                     \
+}                                                                              \
+                                                                               \
+/* removes the first element equal to 'val' and stores it in 'out' */          \
+static inline bool name##_take(struct name *__restrict vec, T val, T *out)     \
+{                                                                              \
+    unsigned int i = name##_index_of(vec, val);                                \
+                                                                               \
+    if (i == (unsigned int) -1)                                                \
+        return false;                                                          \
+                                                                               \
+    if (out)                                                                   \
+        *out = vec->data[i];                                                   \
+                                                                               \
+    name##_take_at(vec, i);                                                    \
+                                                                               \
+    return true;                                                               \
+}                                                                              \
+                                                                               \
+SORT_DEFINE(name##_data, T, cmp_fn)                                            \
+                                                                               \
+static inline void name##_sort(struct name *__restrict vec)                    \
+{                                                                              \
+    name##_data_sort(vec->data, vec->size);                                    \
+}                                                                              \
+                                                                               \
+/* keeps the order of equal elements */                                        \
+static inline int name##_sort_stable(struct name *__restrict vec)              \
+{                                                                              \
+    return name##_data_sort_stable(vec->data, vec->size);                      \
+}                                                                              \
+                                                                               \
+/* index of the first element not less than 'val' */                           \
+static inline unsigned int                                                     \
+name##_lower_bound(const struct name *__restrict vec, T val)                   \
+{                                                                              \
+    const T *base = vec->data;                                                 \
+    unsigned int n = vec->size, half;                                          \
+                                                                               \
+    if (n == 0)                                                                \
+        return 0;                                                              \
+                                                                               \
+    /* the compiler turns this into a conditional move */                      \
+    while (n > 1) {                                                            \
+        half = n >> 1;                                                         \
+        base = (cmp_fn(base[half], val) < 0) ? base + half : base;             \
+        n   -= half;                                                           \
+    }                                                                          \
+                                                                               \
+    return (base - vec->data) + (cmp_fn(*base, val) < 0);                      \
+}                                                                              \
+                                                                               \
+static inline int name##_insert_sorted(struct name *__restrict vec, T val)     \
+{                                                                              \
+    return name##_insert_at(vec, name##_lower_bound(vec, val), val);           \
+}                                                                              \
+                                                                               \
+/* returns (unsigned int) -1 if there's no element equal to 'val' */           \
+static inline unsigned int                                                     \
+name##_index_of_sorted(const struct name *__restrict vec, T val)               \
+{                                                                              \
+    unsigned int i = name##_lower_bound(vec, val);                             \
+                                                                               \
+    if (i == vec->size || cmp_fn(vec->data[i], val) != 0)                      \
+        return (unsigned int) -1;                                              \
+                                                                               \
+    return i;                                                                  \
+}                                                                              \
+                                                                               \
+static inline bool name##_contains_sorted(const struct name *__restrict vec,   \
+                                          T val)                               \
+{                                                                              \
+    return name##_index_of_sorted(vec, val) != (unsigned int) -1;              \
+}                                                                              \
+                                                                               \
+static inline bool name##_take_sorted(struct name *__restrict vec,             \
+                                      T val,                                   \
+                                      T *out)                                  \
+{                                                                              \
+    unsigned int i = name##_index_of_sorted(vec, val);                         \
+                                                                               \
+    if (i == (unsigned int) -1)                                                \
+        return false;                                                          \
+                                                                               \
+    if (out)                                                                   \
+        *out = vec->data[i];                                                   \
+                                                                               \
+    name##_take_at(vec, i);                                                    \
+                                                                               \
+    return true;                                                               \
+}
+
+#endif /* _VECTOR_DEFINE_H_ */
@@ -0,0 +1,112 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _VECTOR_FROZEN_H_
+#define _VECTOR_FROZEN_H_
+
+#include <stdbool.h>
+
+#include "vector.h"
+
+/*
+ * Read-only search layouts built once from a sorted struct vector.
+ * Lookups return the index the element has in the sorted vector, like
+ * vector_index_of_sorted(), but touch far fewer cache lines and take no
+ * data dependent branches. Only the data pointers are copied, so the
+ * elements have to outlive the layout.
+ */
+
+/*
+ * Eytzinger layout: the implicit binary search tree in breadth-first
+ * order, so the next levels of a lookup lie next to each other and can
+ * be prefetched. Works with any 'data_compare'.
+ */
+struct vector_frozen {
+    /* 1-based tree and the sorted index of every node */
+    void **data;
+    unsigned int *index;
+    unsigned int size;
+    
+    int (*data_compare)(const void *, const void *);
+};
+
+/*
+ * Static B-tree ("S-tree") for data which are integers cast to 'void *',
+ * in the order of vector_sort_long(). Every node is a cache line of 8
+ * keys, which are compared at once with SSE4.2 or AVX2 if available.
+ */
+struct vector_frozen_long {
+    long *keys;
+    unsigned int *index;
+    unsigned int size;
+    unsigned int nodes;
+};
+
+struct vector_frozen *vector_frozen_new(const struct vector *__restrict vec);
+
+void vector_frozen_delete(struct vector_frozen *__restrict fz);
+
+int vector_frozen_init(struct vector_frozen *__restrict fz,
+                       const struct vector *__restrict vec);
+
+void vector_frozen_destroy(struct vector_frozen *__restrict fz);
+
+/* index of the first element not less than 'data', the size if none */
+unsigned int
+vector_frozen_lower_bound(const struct vector_frozen *__restrict fz,
+                          const void *data);
+
+unsigned int vector_frozen_index_of(const struct vector_frozen *__restrict fz,
+                                    const void *data);
+
+bool vector_frozen_contains(const struct vector_frozen *__restrict fz,
+                            const void *data);
+
+unsigned int vector_frozen_size(const struct vector_frozen *__restrict fz);
+
+struct vector_frozen_long *
+vector_frozen_long_new(const struct vector *__restrict vec);
+
+void vector_frozen_long_delete(struct vector_frozen_long *__restrict fz);
+
+int vector_frozen_long_init(struct vector_frozen_long *__restrict fz,
+                            const struct vector *__restrict vec);
+
+void vector_frozen_long_destroy(struct vector_frozen_long *__restrict fz);
+
+unsigned int
+vector_frozen_long_lower_bound(const struct vector_frozen_long *__restrict fz,
+                               long key);
+
+unsigned int
+vector_frozen_long_index_of(const struct vector_frozen_long *__restrict fz,
+                            long key);
+
+bool vector_frozen_long_contains(const struct vector_frozen_long *__restrict fz,
+                                 long key);
+
+unsigned int
+vector_frozen_long_size(const struct vector_frozen_long *__restrict fz);
+
+#endif /* _VECTOR_FROZEN_H_ */
@@ -0,0 +1,612 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <sched.h>
+
+#include "cmap.h"
+#include "macro.h"
+#include "concurrent_p.h"
+
+/* number of reader counters, threads beyond that share them */
+#define CMAP_READERS 64
+/* retired entries before a writer tries to advance the epoch */
+#define CMAP_RETIRE_BATCH 64
+
+#define CMAP_NODE_DELETE_DATA 0x01
+/* 'data' is a replaced table whose nodes have to be freed with it */
+#define CMAP_NODE_TABLE 0x02
+
+struct cmap_node {
+    struct cmap_node *next;
+    const void *key;
+    void *data;
+    unsigned int hash;
+    unsigned int flags;
+    
+    /* 'next' stays valid for readers until the node is freed */
+    struct cmap_node *retired_next;
+};
+
+struct cmap_table {
+    unsigned int mask;
+    struct cmap_node *buckets[];
+};
+
+struct cmap_stripe {
+    pthread_mutex_t mutex;
+} __attribute__((aligned(CACHELINE_SIZE)));
+
+struct cmap_reader {
+    unsigned long count[2];
+} __attribute__((aligned(CACHELINE_SIZE)));
+
+static unsigned int _cmap_next_reader;
+static __thread unsigned int _cmap_reader = -1;
+
+/* smallest power of two >= m, at least min (a power of two itself) */
+static unsigned int _cmap_pow2(unsigned int m, unsigned int min)
+{
+    unsigned int n;
+    
+    n = min;
+    
+    while (n < m && n < (1U << 31))
+        n <<= 1;
+    
+    return n;
+}
+
+static struct cmap_table *_cmap_table_new(unsigned int capacity)
+{
+    struct cmap_table *table;
+    
+    table = calloc(1, sizeof(*table) + capacity * sizeof(*table->buckets));
+    if (!table)
+        return NULL;
+    
+    table->mask = capacity - 1;
+    
+    return table;
+}
+
+static void _cmap_table_delete(struct cmap_table *__restrict table,
+                               void (*data_delete)(void *))
+{
+    struct cmap_node *node, *next;
+    unsigned int i;
+    
+    for (i = 0; i <= table->mask; ++i) {
+        for (node = table->buckets[i]; node; node = next) {
+            next = node->next;
+            
+            if (data_delete)
+                data_delete(node->data);
+            
+            free(node);
+        }
+    }
+    
+    free(table);
+}
+
+static void _cmap_free_retired(struct cmap *__restrict map, 
+                               struct cmap_node *node)
+{
+    struct cmap_node *next;
+    
+    for (; node; node = next) {
+        next = node->retired_next;
+        
+        if (node->flags & CMAP_NODE_TABLE)
+            _cmap_table_delete(node->data, NULL);
+        else if ((node->flags & CMAP_NODE_DELETE_DATA) && map->data_delete)
+            map->data_delete(node->data);
+        
+        free(node);
+    }
+}
+
+/*
+ * Called with 'mutex_retired' held. Entries retired before the previous
+ * advance can't be seen by anyone once the readers of the previous 
+ * epoch are gone, returns them or NULL if there are still such readers.
+ */
+static struct cmap_node *_cmap_try_advance(struct cmap *__restrict map,
+                                           bool *advanced)
+{
+    struct cmap_node *node;
+    unsigned long epoch;
+    unsigned int i;
+    
+    *advanced = false;
+    
+    /* order the unlinking of retired nodes before reading the counters */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    
+    epoch = __atomic_load_n(&map->epoch, __ATOMIC_RELAXED);
+    
+    for (i = 0; i < CMAP_READERS; ++i) {
+        if (__atomic_load_n(&map->readers[i].count[(epoch + 1) & 1], 
+                            __ATOMIC_SEQ_CST) != 0)
+            return NULL;
+    }
+    
+    node = map->retired_waiting;
+    
+    map->retired_waiting = map->retired_pending;
+    map->retired_pending = NULL;
+    map->retired_count   = 0;
+    
+    __atomic_store_n(&map->epoch, epoch + 1, __ATOMIC_SEQ_CST);
+    
+    *advanced = true;
+    
+    return node;
+}
+
+static void _cmap_retire(struct cmap *__restrict map, struct cmap_node *node)
+{
+    struct cmap_node *freed;
+    bool advanced;
+    
+    freed = NULL;
+    
+    pthread_mutex_lock(&map->mutex_retired);
+    
+    node->retired_next   = map->retired_pending;
+    map->retired_pending = node;
+    map->retired_count  += 1;
+    
+    if (map->retired_count >= CMAP_RETIRE_BATCH)
+        freed = _cmap_try_advance(map, &advanced);
+    
+    pthread_mutex_unlock(&map->mutex_retired);
+    
+    _cmap_free_retired(map, freed);
+}
+
+static inline struct cmap_stripe *_cmap_stripe(struct cmap *__restrict map,
+                                               unsigned int hash)
+{
+    return map->stripes + (hash & map->stripe_mask);
+}
+
+static struct cmap_node *_cmap_lookup(const struct cmap_table *table,
+                                      const struct cmap *__restrict map,
+                                      const void *key,
+                                      unsigned int hash)
+{
+    struct cmap_node *node;
+    
+    node = __atomic_load_n(&table->buckets[hash & table->mask], 
+                           __ATOMIC_ACQUIRE);
+    
+    while (node) {
+        if (node->hash == hash && map->key_compare(node->key, key) == 0)
+            return node;
+        
+        node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    }
+    
+    return NULL;
+}
+
+/* 
+ * Readers may still walk the old table, so the nodes are copied instead 
+ * of relinked. The old table is retired like a removed entry.
+ */
+static int _cmap_grow(struct cmap *__restrict map, unsigned int capacity)
+{
+    struct cmap_table *table, *old;
+    struct cmap_node *node, *copy, **bucket;
+    struct cmap_node *retire;
+    unsigned int i;
+    int err;
+    
+    retire = NULL;
+    err    = 0;
+    
+    pthread_mutex_lock(&map->mutex_resize);
+    
+    for (i = 0; i <= map->stripe_mask; ++i)
+        pthread_mutex_lock(&map->stripes[i].mutex);
+    
+    old = map->table;
+    
+    /* another thread was faster */
+    if (old->mask + 1 >= capacity)
+        goto out;
+    
+    table  = _cmap_table_new(capacity);
+    retire = malloc(sizeof(*retire));
+    if (!table || !retire) {
+        free(table);
+        free(retire);
+        retire = NULL;
+        err = -ENOMEM;
+        goto out;
+    }
+    
+    for (i = 0; i <= old->mask; ++i) {
+        for (node = old->buckets[i]; node; node = node->next) {
+            copy = malloc(sizeof(*copy));
+            if (!copy) {
+                _cmap_table_delete(table, NULL);
+                free(retire);
+                retire = NULL;
+                err = -ENOMEM;
+                goto out;
+            }
+            
+            *copy = *node;
+            
+            bucket = &table->buckets[node->hash & table->mask];
+            copy->next = *bucket;
+            *bucket    = copy;
+        }
+    }
+    
+    __atomic_store_n(&map->table, table, __ATOMIC_RELEASE);
+    
+    retire->data  = old;
+    retire->flags = CMAP_NODE_TABLE;
+    
+out:
+    for (i = 0; i <= map->stripe_mask; ++i)
+        pthread_mutex_unlock(&map->stripes[i].mutex);
+    
+    pthread_mutex_unlock(&map->mutex_resize);
+    
+    if (retire)
+        _cmap_retire(map, retire);
+    
+    return err;
+}
+
+struct cmap *cmap_new(const struct cmap_config *__restrict conf)
+{
+    struct cmap *map;
+    int err;
+    
+    map = malloc(sizeof(*map));
+    if (!map)
+        return NULL;
+    
+    err = cmap_init(map, conf);
+    if (err < 0) {
+        free(map);
+        errno = -err;
+        return NULL;
+    }
+    
+    return map;
+}
+
+void cmap_delete(struct cmap *__restrict map)
+{
+    cmap_destroy(map);
+    free(map);
+}
+
+int cmap_init(struct cmap *__restrict map,
+              const struct cmap_config *__restrict conf)
+{
+    unsigned int i, stripes, size;
+    void *mem;
+    int err;
+    
+    stripes = _cmap_pow2(conf->stripes, 1);
+    if (conf->stripes == 0)
+        stripes = CMAP_DEFAULT_STRIPES;
+    
+    /* every bucket has to belong to exactly one stripe */
+    size = _cmap_pow2(conf->size, max(stripes, CMAP_DEFAULT_SIZE));
+    
+    map->table = _cmap_table_new(size);
+    if (!map->table)
+        return -ENOMEM;
+    
+    err = posix_memalign(&mem, CACHELINE_SIZE, 
+                         stripes * sizeof(*map->stripes));
+    if (err) {
+        err = -err;
+        goto cleanup1;
+    }
+    
+    map->stripes     = mem;
+    map->stripe_mask = stripes - 1;
+    
+    for (i = 0; i < stripes; ++i)
+        pthread_mutex_init(&map->stripes[i].mutex, NULL);
+    
+    err = posix_memalign(&mem, CACHELINE_SIZE, 
+                         CMAP_READERS * sizeof(*map->readers));
+    if (err) {
+        err = -err;
+        goto cleanup2;
+    }
+    
+    map->readers = mem;
+    memset(map->readers, 0, CMAP_READERS * sizeof(*map->readers));
+    
+    map->size  = 0;
+    map->epoch = 0;
+    
+    pthread_mutex_init(&map->mutex_resize, NULL);
+    pthread_mutex_init(&map->mutex_retired, NULL);
+    
+    map->retired_pending = NULL;
+    map->retired_waiting = NULL;
+    map->retired_count   = 0;
+    
+    map->upper_bound = conf->upper_bound;
+    if (map->upper_bound == 0)
+        map->upper_bound = CMAP_DEFAULT_UPPER_BOUND;
+    
+    map->key_compare = conf->key_compare;
+    map->key_hash    = conf->key_hash;
+    map->data_delete = conf->data_delete;
+    
+    return 0;
+
+cleanup2:
+    for (i = 0; i < stripes; ++i)
+        pthread_mutex_destroy(&map->stripes[i].mutex);
+    
+    free(map->stripes);
+cleanup1:
+    free(map->table);
+    
+    return err;
+}
+
+void cmap_destroy(struct cmap *__restrict map)
+{
+    unsigned int i;
+    
+    _cmap_free_retired(map, map->retired_waiting);
+    _cmap_free_retired(map, map->retired_pending);
+    
+    _cmap_table_delete(map->table, map->data_delete);
+    
+    pthread_mutex_destroy(&map->mutex_retired);
+    pthread_mutex_destroy(&map->mutex_resize);
+    
+    for (i = 0; i <= map->stripe_mask; ++i)
+        pthread_mutex_destroy(&map->stripes[i].mutex);
+    
+    free(map->readers);
+    free(map->stripes);
+}
+
+int cmap_insert(struct cmap *__restrict map, const void *key, void *data)
+{
+    struct cmap_stripe *stripe;
+    struct cmap_table *table;
+    struct cmap_node *node, **bucket;
+    unsigned long size;
+    unsigned int hash, capacity;
+    
+    hash = map->key_hash(key);
+    
+    node = malloc(sizeof(*node));
+    if (!node)
+        return -errno;
+    
+    node->key   = key;
+    node->data  = data;
+    node->hash  = hash;
+    node->flags = 0;
+    
+    stripe = _cmap_stripe(map, hash);
+    
+    pthread_mutex_lock(&stripe->mutex);
+    
+    /* a resize holds all stripes, so 'table' can't change anymore */
+    table = map->table;
+    
+    if (_cmap_lookup(table, map, key, hash)) {
+        pthread_mutex_unlock(&stripe->mutex);
+        free(node);
+        return -EEXIST;
+    }
+    
+    bucket = &table->buckets[hash & table->mask];
+    
+    node->next = *bucket;
+    __atomic_store_n(bucket, node, __ATOMIC_RELEASE);
+    
+    /* 'table' may be reclaimed as soon as we unlock */
+    capacity = table->mask + 1;
+    
+    pthread_mutex_unlock(&stripe->mutex);
+    
+    size = __atomic_add_fetch(&map->size, 1, __ATOMIC_RELAXED);
+    
+    if (100 * size > (unsigned long) map->upper_bound * capacity)
+        _cmap_grow(map, capacity << 1);
+    
+    return 0;
+}
+
+void *cmap_retrieve(struct cmap *__restrict map, const void *key)
+{
+    struct cmap_node *node;
+    unsigned int ticket;
+    void *data;
+    
+    ticket = cmap_read_lock(map);
+    
+    node = _cmap_lookup(__atomic_load_n(&map->table, __ATOMIC_ACQUIRE), map, 
+                        key, map->key_hash(key));
+    data = (node) ? node->data : NULL;
+    
+    cmap_read_unlock(map, ticket);
+    
+    return data;
+}
+
+bool cmap_contains(struct cmap *__restrict map, const void *key)
+{
+    struct cmap_node *node;
+    unsigned int ticket;
+    
+    ticket = cmap_read_lock(map);
+    
+    node = _cmap_lookup(__atomic_load_n(&map->table, __ATOMIC_ACQUIRE), map, 
+                        key, map->key_hash(key));
+    
+    cmap_read_unlock(map, ticket);
+    
+    return node != NULL;
+}
+
+static struct cmap_node *_cmap_unlink(struct cmap *__restrict map, 
+                                      const void *key)
+{
+    struct cmap_stripe *stripe;
+    struct cmap_table *table;
+    struct cmap_node *node, **prev;
+    unsigned int hash;
+    
+    hash   = map->key_hash(key);
+    stripe = _cmap_stripe(map, hash);
+    
+    pthread_mutex_lock(&stripe->mutex);
+    
+    table = map->table;
+    prev  = &table->buckets[hash & table->mask];
+    
+    for (node = *prev; node; prev = &node->next, node = node->next) {
+        if (node->hash == hash && map->key_compare(node->key, key) == 0) {
+            /* readers standing on 'node' still see the rest of the chain */
+            __atomic_store_n(prev, node->next, __ATOMIC_RELEASE);
+            __atomic_sub_fetch(&map->size, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&stripe->mutex);
+    
+    return node;
+}
+
+void *cmap_take(struct cmap *__restrict map, const void *key)
+{
+    struct cmap_node *node;
+    void *data;
+    
+    node = _cmap_unlink(map, key);
+    if (!node)
+        return NULL;
+    
+    data = node->data;
+    
+    _cmap_retire(map, node);
+    
+    return data;
+}
+
+int cmap_remove(struct cmap *__restrict map, const void *key)
+{
+    struct cmap_node *node;
+    
+    node = _cmap_unlink(map, key);
+    if (!node)
+        return -ENOENT;
+    
+    node->flags |= CMAP_NODE_DELETE_DATA;
+    
+    _cmap_retire(map, node);
+    
+    return 0;
+}
+
+unsigned long cmap_size(const struct cmap *__restrict map)
+{
+    return __atomic_load_n(&map->size, __ATOMIC_RELAXED);
+}
+
+unsigned int cmap_read_lock(struct cmap *__restrict map)
+{
+    unsigned long *count, epoch;
+    unsigned int slot;
+    
+    slot = _cmap_reader;
+    if (unlikely(slot == (unsigned int) -1)) {
+        slot = __atomic_fetch_add(&_cmap_next_reader, 1, __ATOMIC_RELAXED);
+        slot %= CMAP_READERS;
+        _cmap_reader = slot;
+    }
+    
+    for (;;) {
+        epoch = __atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST);
+        count = &map->readers[slot].count[epoch & 1];
+        
+        __atomic_add_fetch(count, 1, __ATOMIC_SEQ_CST);
+        
+        /* 
+         * The epoch may have advanced in between, only announce ourselves
+         * in the counter of the epoch that is current now.
+         */
+        if (__atomic_load_n(&map->epoch, __ATOMIC_SEQ_CST) == epoch)
+            return (slot << 1) | (epoch & 1);
+        
+        __atomic_sub_fetch(count, 1, __ATOMIC_RELEASE);
+    }
+}
+
+void cmap_read_unlock(struct cmap *__restrict map, unsigned int ticket)
+{
+    __atomic_sub_fetch(&map->readers[ticket >> 1].count[ticket & 1], 1, 
+                       __ATOMIC_RELEASE);
+}
+
+void cmap_synchronize(struct cmap *__restrict map)
+{
+    struct cmap_node *freed;
+    unsigned int advances;
+    bool advanced;
+    
+    /* the second advance frees what was pending before the first one */
+    advances = 0;
+    
+    while (advances < 2) {
+        pthread_mutex_lock(&map->mutex_retired);
+        freed = _cmap_try_advance(map, &advanced);
+        pthread_mutex_unlock(&map->mutex_retired);
+        
+        _cmap_free_retired(map, freed);
+        
+        if (advanced)
+            advances += 1;
+        else
+            sched_yield();
+    }
+}
@@ -0,0 +1,297 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <sched.h>
+
+#include "concurrent_p.h"
+
+int ws_deque_init(struct ws_deque *__restrict deque, unsigned long capacity)
+{
+    deque->buffer = calloc(capacity, sizeof(*deque->buffer));
+    if (!deque->buffer)
+        return -errno;
+    
+    deque->top    = 0;
+    deque->bottom = 0;
+    deque->mask   = capacity - 1;
+    
+    return 0;
+}
+
+void ws_deque_destroy(struct ws_deque *__restrict deque)
+{
+    free(deque->buffer);
+}
+
+int ws_deque_push(struct ws_deque *__restrict deque, void *data)
+{
+    long b, t;
+    
+    b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    
+    if ((unsigned long) (b - t) > deque->mask)
+        return -ENOBUFS;
+    
+    __atomic_store_n(&deque->buffer[b & deque->mask], data, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    
+    return 0;
+}
+
+void *ws_deque_pop(struct ws_deque *__restrict deque)
+{
+    void *data;
+    long b, t;
+    
+    b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    
+    if (t > b) {
+        /* deque was empty */
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    
+    data = __atomic_load_n(&deque->buffer[b & deque->mask], __ATOMIC_RELAXED);
+    
+    if (t == b) {
+        /* last element, race against thieves */
+        if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            data = NULL;
+        
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    
+    return data;
+}
+
+void *ws_deque_steal(struct ws_deque *__restrict deque)
+{
+    void *data;
+    long b, t;
+    
+    t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    
+    if (t >= b)
+        return NULL;
+    
+    data = __atomic_load_n(&deque->buffer[t & deque->mask], __ATOMIC_RELAXED);
+    
+    if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return NULL;
+    
+    return data;
+}
+
+unsigned long ws_deque_size(const struct ws_deque *__restrict deque)
+{
+    long b, t;
+    
+    t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    
+    return (b > t) ? (unsigned long) (b - t) : 0;
+}
+
+struct mpmc_ring *mpmc_ring_new(unsigned long capacity)
+{
+    struct mpmc_ring *ring;
+    void *mem;
+    unsigned long size, i;
+    int err;
+    
+    size = 2;
+    
+    while (size < capacity)
+        size <<= 1;
+    
+    err = posix_memalign(&mem, CACHELINE_SIZE, sizeof(*ring));
+    if (err) {
+        errno = err;
+        return NULL;
+    }
+    
+    ring = mem;
+    
+    ring->cells = malloc(size * sizeof(*ring->cells));
+    if (!ring->cells) {
+        free(ring);
+        return NULL;
+    }
+    
+    for (i = 0; i < size; ++i)
+        ring->cells[i].seq = i;
+    
+    ring->head = 0;
+    ring->tail = 0;
+    ring->mask = size - 1;
+    
+    return ring;
+}
+
+void mpmc_ring_delete(struct mpmc_ring *__restrict ring)
+{
+    free(ring->cells);
+    free(ring);
+}
+
+int mpmc_ring_push(struct mpmc_ring *__restrict ring, void *data)
+{
+    struct mpmc_cell *cell;
+    unsigned long pos, seq;
+    long diff;
+    
+    pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    
+    while (1) {
+        cell = ring->cells + (pos & ring->mask);
+        seq  = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        diff = (long) seq - (long) pos;
+        
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, 
+                                            __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            /* the consumers did not yet free this cell => ring is full */
+            return -ENOBUFS;
+        } else {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+    
+    cell->data = data;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    
+    return 0;
+}
+
+void *mpmc_ring_pop(struct mpmc_ring *__restrict ring)
+{
+    struct mpmc_cell *cell;
+    unsigned long pos, seq;
+    void *data;
+    long diff;
+    
+    pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    
+    while (1) {
+        cell = ring->cells + (pos & ring->mask);
+        seq  = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        diff = (long) seq - (long) (pos + 1);
+        
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, 
+                                            __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            /* no producer filled this cell yet => ring is empty */
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        }
+    }
+    
+    data = cell->data;
+    __atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+    
+    return data;
+}
+
+unsigned long mpmc_ring_size(const struct mpmc_ring *__restrict ring)
+{
+    unsigned long head, tail;
+    
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    
+    return (head > tail) ? head - tail : 0;
+}
+
+/* parses a sysfs list like "0-3,8-11" into 'set' */
+static int _read_list(const char *path, cpu_set_t *set)
+{
+    char buf[1024], *p, *end;
+    unsigned long first, last;
+    FILE *file;
+    
+    file = fopen(path, "r");
+    if (!file)
+        return -errno;
+    
+    p = fgets(buf, sizeof(buf), file);
+    fclose(file);
+    
+    if (!p)
+        return -EIO;
+    
+    CPU_ZERO(set);
+    
+    while (*p != '\0' && *p != '\n') {
+        first = strtoul(p, &end, 10);
+        if (end == p)
+            return -EINVAL;
+        
+        last = first;
+        
+        if (*end == '-')
+            last = strtoul(end + 1, &end, 10);
+        
+        while (first <= last && first < CPU_SETSIZE)
+            CPU_SET(first++, set);
+        
+        p = (*end == ',') ? end + 1 : end;
+    }
+    
+    return 0;
+}
+
+int numa_node_cpus(unsigned int node, cpu_set_t *set)
+{
+    char path[64];
+    
+    snprintf(path, sizeof(path), 
+             "/sys/devices/system/node/node%u/cpulist", node);
+    
+    return _read_list(path, set);
+}
+
+int numa_nodes_online(cpu_set_t *set)
+{
+    return _read_list("/sys/devices/system/node/online", set);
+}
@@ -0,0 +1,110 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _CONCURRENT_P_H_
+#define _CONCURRENT_P_H_
+
+#include <sched.h>
+
+#define CACHELINE_SIZE 64
+
+#if defined(__i386__) || defined(__x86_64__)
+#define cpu_relax()                                                            \
+    __builtin_ia32_pause()
+#else
+#define cpu_relax()                                                            \
+    do { } while (0)
+#endif
+
+/*
+ * Work stealing deque as described by Chase and Lev ("Dynamic Circular
+ * Work-Stealing Deque"), using the memory orderings of Le et al.
+ * ("Correct and Efficient Work-Stealing for Weak Memory Models").
+ * Only the owning thread may call ws_deque_push() and ws_deque_pop(),
+ * any other thread may call ws_deque_steal().
+ * The deque has a fixed capacity, ws_deque_push() fails if it is full.
+ */
+struct ws_deque {
+    long top __attribute__((aligned(CACHELINE_SIZE)));
+    long bottom __attribute__((aligned(CACHELINE_SIZE)));
+    
+    void **buffer;
+    unsigned long mask;
+};
+
+int ws_deque_init(struct ws_deque *__restrict deque, unsigned long capacity);
+
+void ws_deque_destroy(struct ws_deque *__restrict deque);
+
+int ws_deque_push(struct ws_deque *__restrict deque, void *data);
+
+void *ws_deque_pop(struct ws_deque *__restrict deque);
+
+void *ws_deque_steal(struct ws_deque *__restrict deque);
+
+unsigned long ws_deque_size(const struct ws_deque *__restrict deque);
+
+/*
+ * Bounded multi-producer / multi-consumer queue as described by
+ * Dmitry Vyukov. Every cell carries a sequence number which tells producers
+ * and consumers whether the cell is ready for them, so neither side needs
+ * a lock. mpmc_ring_push() fails if the ring is full and mpmc_ring_pop()
+ * returns NULL if it is empty.
+ */
+struct mpmc_cell {
+    unsigned long seq;
+    void *data;
+};
+
+struct mpmc_ring {
+    unsigned long head __attribute__((aligned(CACHELINE_SIZE)));
+    unsigned long tail __attribute__((aligned(CACHELINE_SIZE)));
+    
+    struct mpmc_cell *cells;
+    unsigned long mask;
+};
+
+struct mpmc_ring *mpmc_ring_new(unsigned long capacity);
+
+void mpmc_ring_delete(struct mpmc_ring *__restrict ring);
+
+int mpmc_ring_push(struct mpmc_ring *__restrict ring, void *data);
+
+void *mpmc_ring_pop(struct mpmc_ring *__restrict ring);
+
+unsigned long mpmc_ring_size(const struct mpmc_ring *__restrict ring);
+
+/* 
+ * Reads the cpus of NUMA node 'node' from sysfs,
+ * returns -ENOENT if there is no such node.
+ */
+int numa_node_cpus(unsigned int node, cpu_set_t *set);
+
+/* 
+ * Reads the IDs of the online NUMA nodes into 'set', they don't have to
+ * be contiguous.
+ */
+int numa_nodes_online(cpu_set_t *set);
+
+#endif /* _CONCURRENT_P_H_ */
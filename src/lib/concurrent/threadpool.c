@@ -30,16 +30,55 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <time.h>
 #include <sys/eventfd.h>
 
 #include "queue.h"
 #include "map.h"
+#include "clock.h"
 #include "threadpool.h"
 #include "macro.h"
+#include "concurrent_p.h"
 
-struct exit_task {
-    struct threadpool_task task;
+#define THREADPOOL_DEQUE_SIZE 1024
+#define THREADPOOL_SPIN_COUNT 64
+
+struct threadpool_worker {
+    struct ws_deque deque;
+    
     struct threadpool *pool;
+    pthread_t thread;
+    
+    unsigned int node;
+    unsigned int seed;
+    bool active;
+    
+    /* 
+     * Only written by the worker itself, threadpool_priority_stats()
+     * sums them up. 'queued' is unused here.
+     */
+    struct threadpool_priority_stats stats[THREADPOOL_PRIORITIES];
+    
+    /* 'idle_ns' is only filled in by threadpool_worker_stats() */
+    struct threadpool_worker_stats counters;
+    unsigned long started_ns;
+    unsigned long alive_ns;
+    
+    /* a copy of the pool's 'trace_clock', so only this worker writes it */
+    struct clock clock;
+    struct threadpool_trace_event *trace;
+    unsigned long trace_seq;
+};
+
+struct threadpool_node {
+    /* tasks bound to this node, the overflow list uses 'mutex_queue_in' */
+    struct mpmc_ring *ring;
+    struct queue task_queue;
+    
+    cpu_set_t cpus;
+    
+    unsigned int workers;
+    unsigned int next_cpu;
 };
 
 static unsigned int _thread_hash(const void *thread)
@@ -72,20 +111,228 @@ static int _thread_compare(const void *a, const void *b)
     return !pthread_equal(*(pthread_t *) a, *(pthread_t *) b);
 }
 
-static void _thread_delete(void *thread)
+static unsigned long _now_ns(void)
 {
-    pthread_cancel(*(pthread_t *)thread);
-    pthread_join(*(pthread_t *)thread, NULL);
-    free(thread);
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
 }
 
-static void _thread_exit(void *arg)
+static void _counter_add(unsigned long *counter, unsigned long val)
 {
-    struct threadpool *pool;
-    pthread_t *thread, self;
-    int err;
+    /* single writer, but there are concurrent readers */
+    __atomic_store_n(counter, *counter + val, __ATOMIC_RELAXED);
+}
+
+/* worker of the pool the calling thread belongs to, if any */
+static __thread struct threadpool_worker *_worker_self;
+
+static struct threadpool_worker *
+_threadpool_self(const struct threadpool *__restrict pool)
+{
+    struct threadpool_worker *worker;
+    
+    worker = _worker_self;
+    
+    return (worker && worker->pool == pool) ? worker : NULL;
+}
+
+/* caller must hold 'mutex_map' */
+static void _worker_release(struct threadpool_worker *__restrict worker)
+{
+    worker->pool->nodes[worker->node].workers -= 1;
+    worker->active = false;
+    
+    _counter_add(&worker->alive_ns, _now_ns() - worker->started_ns);
+}
+
+static void _thread_delete(void *data)
+{
+    struct threadpool_worker *worker;
+    
+    worker = data;
+    
+    pthread_cancel(worker->thread);
+    pthread_join(worker->thread, NULL);
+    
+    _worker_release(worker);
+}
+
+/*
+ * 'sem_queue_in' and 'sem_queue_out' do not count the queued tasks.
+ * They are only posted if some thread went idle and needs to be woken up,
+ * so adding and completing tasks doesn't touch them while the pool is busy.
+ */
+static void _threadpool_wake(unsigned int *idle, sem_t *sem, unsigned int n)
+{
+    unsigned int waiting;
+    
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    
+    waiting = __atomic_load_n(idle, __ATOMIC_RELAXED);
+    n       = min(n, waiting);
+    
+    while (n--)
+        sem_post(sem);
+}
+
+static int _threadpool_start_thread(struct threadpool *__restrict pool);
+
+/* starts another worker of an elastic pool if none of them is idle */
+static void _threadpool_grow(struct threadpool *__restrict pool)
+{
+    if (__atomic_load_n(&pool->workers_idle, __ATOMIC_RELAXED))
+        return;
+    
+    /* 
+     * Never block on 'mutex_map' here, threadpool_destroy() holds it 
+     * while joining the workers, which might be waiting here otherwise.
+     */
+    if (pthread_mutex_trylock(&pool->mutex_map))
+        return;
+    
+    if (map_size(&pool->thread_map) < pool->workers_max)
+        _threadpool_start_thread(pool);
+    
+    pthread_mutex_unlock(&pool->mutex_map);
+}
+
+/* 'queue_max' is the high-water mark of the queue that is 'depth' deep */
+static void _threadpool_check_depth(struct threadpool *__restrict pool,
+                                    unsigned long *queue_max,
+                                    unsigned long depth)
+{
+    unsigned long old;
+    
+    old = __atomic_load_n(queue_max, __ATOMIC_RELAXED);
+    
+    while (depth > old) {
+        if (__atomic_compare_exchange_n(queue_max, &old, depth, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+    
+    if (pool->grow_queue_depth && depth >= pool->grow_queue_depth)
+        _threadpool_grow(pool);
+}
+
+static void _task_push(struct mpmc_ring *__restrict ring, 
+                       struct queue *__restrict overflow,
+                       pthread_mutex_t *__restrict mutex,
+                       struct threadpool_task **tasks,
+                       unsigned int n)
+{
+    unsigned int i;
+    
+    /* 
+     * Once tasks overflowed, newer ones have to queue up behind them
+     * until the overflow list is drained, or they would overtake them.
+     */
+    i = 0;
+    
+    if (__atomic_load_n(&overflow->size, __ATOMIC_RELAXED) == 0) {
+        for (; i < n; ++i) {
+            if (mpmc_ring_push(ring, tasks[i]) < 0)
+                break;
+        }
+    }
+    
+    if (i == n)
+        return;
+    
+    /* move everything that didn't fit in one go */
+    pthread_mutex_lock(mutex);
+    
+    for (; i < n; ++i)
+        queue_insert(overflow, &tasks[i]->link);
+    
+    pthread_mutex_unlock(mutex);
+}
+
+static struct threadpool_task *_task_pop(struct mpmc_ring *__restrict ring, 
+                                         struct queue *__restrict overflow,
+                                         pthread_mutex_t *__restrict mutex)
+{
+    struct threadpool_task *task;
+    struct link *link;
+    
+    /* 
+     * Tasks in the ring are older than those in the overflow list, see
+     * _task_push(). Peek at the size without the lock, the overflow list
+     * is empty most of the time.
+     */
+    task = mpmc_ring_pop(ring);
+    if (task)
+        return task;
+    
+    if (__atomic_load_n(&overflow->size, __ATOMIC_RELAXED) == 0)
+        return NULL;
+    
+    link = NULL;
+    
+    pthread_mutex_lock(mutex);
+    
+    if (!queue_empty(overflow))
+        link = queue_take(overflow);
+    
+    pthread_mutex_unlock(mutex);
+    
+    return (link) ? container_of(link, struct threadpool_task, link) : NULL;
+}
+
+static void _threadpool_push_global(struct threadpool *__restrict pool,
+                                    struct threadpool_task **tasks,
+                                    unsigned int n,
+                                    enum threadpool_priority priority)
+{
+    _task_push(pool->ring_in[priority], &pool->task_queue_in[priority], 
+               &pool->mutex_queue_in, tasks, n);
+    
+    _threadpool_wake(&pool->workers_idle, &pool->sem_queue_in, n);
+    
+    _threadpool_check_depth(pool, &pool->queue_max, 
+                            mpmc_ring_size(pool->ring_in[priority]));
+}
+
+static void _worker_flush(struct threadpool_worker *__restrict worker)
+{
+    struct threadpool_task *task;
+    
+    /* hand the remaining tasks of an exiting worker over to the others */
+    while ((task = ws_deque_pop(&worker->deque)))
+        _threadpool_push_global(worker->pool, &task, 1, task->priority);
+}
+
+/* claims one of the requests made by threadpool_remove_thread() */
+static bool _thread_should_retire(struct threadpool *__restrict pool)
+{
+    unsigned int n;
+    
+    n = __atomic_load_n(&pool->workers_retire, __ATOMIC_RELAXED);
+    
+    while (n > 0) {
+        if (__atomic_compare_exchange_n(&pool->workers_retire, &n, n - 1, 
+                                        true, __ATOMIC_ACQUIRE, 
+                                        __ATOMIC_RELAXED))
+            return true;
+    }
+    
+    return false;
+}
 
-    pool = arg;
+/* 
+ * Returns only if the thread must not exit, because 'keep' threads are left.
+ * 'retiring' is true if the thread already claimed a retire request.
+ */
+static void _thread_exit(struct threadpool *__restrict pool,
+                         unsigned int keep,
+                         bool retiring)
+{
+    struct threadpool_worker *worker;
+    pthread_t self;
+    int err;
     
     /*
      * This semaphore makes sure that no race conditions with
@@ -108,173 +355,760 @@ again:
     self = pthread_self();
     
     pthread_mutex_lock(&pool->mutex_map);
-    thread = map_take(&pool->thread_map, &self);
+    
+    if (map_size(&pool->thread_map) <= keep) {
+        pthread_mutex_unlock(&pool->mutex_map);
+        sem_post(&pool->sem_exit);
+        return;
+    }
+    
+    /* the slot may be reused as soon as it is released */
+    if (pool->mode == THREADPOOL_MODE_WORK_STEALING)
+        _worker_flush(_worker_self);
+    
+    worker = map_take(&pool->thread_map, &self);
+    if (worker)
+        _worker_release(worker);
+    
+    /* 
+     * An exit after an idle timeout fulfils a pending retire request too,
+     * otherwise the requests could outnumber the remaining workers and
+     * take the pool below 'min_threads'.
+     */
+    if (worker && !retiring)
+        _thread_should_retire(pool);
+    
     pthread_mutex_unlock(&pool->mutex_map);
     
     sem_post(&pool->sem_exit);
     
-    if (thread) {
+    if (worker) {
         /* 
          * This means another thread did not try to cancel this thread
          * => it is now responsible to clean itself up
          */
         pthread_detach(self);
-        free(thread);
     }
     
     pthread_exit(NULL);
 }
 
-static void _exit_task_thread(struct threadpool_task *__restrict task)
+static void _worker_account_task(struct threadpool_worker *__restrict worker,
+                                 const struct threadpool_task *task)
 {
-    struct threadpool *pool;
-    struct exit_task *exit_task;
+    struct threadpool_priority_stats *stats;
+    unsigned long wait;
+    unsigned int bucket;
     
-    exit_task = container_of(task, struct exit_task, task);
+    stats = worker->stats + task->priority;
     
-    pool = exit_task->pool;
-    free(exit_task);
+    _counter_add(&stats->dispatched, 1);
     
-    _thread_exit(pool);
+    if (!worker->pool->measure_wait_time)
+        return;
+    
+    wait   = _now_ns() - task->enqueued_ns;
+    bucket = (wait) ? 63 - __builtin_clzl(wait) : 0;
+    bucket = min(bucket, THREADPOOL_WAIT_BUCKETS - 1);
+    
+    _counter_add(&stats->wait_ns, wait);
+    _counter_add(&stats->wait_histogram[bucket], 1);
+    
+    if (wait > stats->wait_max_ns)
+        __atomic_store_n(&stats->wait_max_ns, wait, __ATOMIC_RELAXED);
+    
+    if (worker->pool->grow_wait_ns && wait > worker->pool->grow_wait_ns)
+        _threadpool_grow(worker->pool);
 }
 
-static void *_thread_handle_tasks(void *arg)
+static void _threadpool_run_task(struct threadpool *__restrict pool,
+                                 struct threadpool_worker *worker,
+                                 struct threadpool_task *task);
+
+static void _future_complete(struct threadpool *__restrict pool,
+                             struct threadpool_worker *worker,
+                             struct threadpool_future *__restrict future)
 {
-    struct link *link;
     struct threadpool_task *task;
-    struct threadpool *pool;
-    int err;
+    struct queue continuations;
     
-    pool = arg;
+    queue_init(&continuations);
     
-    while (1) {
-        err = sem_wait(&pool->sem_queue_in);
-        if (err < 0) {
-            if (errno == EINTR)
-                continue;
-            
-            _thread_exit(pool);
-        }
+    pthread_mutex_lock(&future->mutex);
+    
+    future->done = true;
+    
+    while (!queue_empty(&future->continuations))
+        queue_insert(&continuations, queue_take(&future->continuations));
+    
+    if (future->waiters)
+        pthread_cond_broadcast(&future->cond);
+    
+    /* the future may be destroyed as soon as this is unlocked */
+    pthread_mutex_unlock(&future->mutex);
+    
+    /* run them right away, the data of the parent is still in the cache */
+    while (!queue_empty(&continuations)) {
+        task = container_of(queue_take(&continuations), 
+                            struct threadpool_task, link);
         
-        pthread_mutex_lock(&pool->mutex_queue_in);
-        link = queue_take(&pool->task_queue_in);
-        pthread_mutex_unlock(&pool->mutex_queue_in);
+        _threadpool_run_task(pool, worker, task);
+    }
+}
 
-        task = container_of(link, struct threadpool_task, link);
-                
-        task->func(task);
+/* 'worker' is NULL if a thread outside the pool helps out */
+static void _threadpool_run_task(struct threadpool *__restrict pool,
+                                 struct threadpool_worker *worker,
+                                 struct threadpool_task *task)
+{
+    struct threadpool_trace_event *event;
+    unsigned long enqueued, started, seq;
+    bool trace;
+    
+    trace    = worker && worker->trace;
+    enqueued = 0;
+    started  = 0;
+    
+    if (worker) {
+        _worker_account_task(worker, task);
+        _counter_add(&worker->counters.tasks, 1);
+    }
+    
+    if (trace) {
+        /* 'task' may be gone once 'func' returned */
+        enqueued = task->enqueued_ns - pool->trace_epoch_ns;
+        started  = clock_elapsed_ns(&worker->clock);
+    }
+    
+    task->func(task);
+    
+    if (trace) {
+        /* 
+         * 'func' might have run other tasks on this worker, see 
+         * threadpool_parallel_for(). 'trace_seq' is odd while writing.
+         */
+        seq   = worker->trace_seq;
+        event = worker->trace + ((seq / 2) & pool->trace_mask);
         
-        pthread_mutex_lock(&pool->mutex_queue_out);
+        __atomic_store_n(&worker->trace_seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
         
-        err = sem_post(&pool->sem_queue_out);
-        if (err == 0)
-            queue_insert(&pool->task_queue_out, &task->link);
-
-        pthread_mutex_unlock(&pool->mutex_queue_out);
+        event->task        = task;
+        event->worker      = worker - pool->workers;
+        event->enqueued_ns = enqueued;
+        event->started_ns  = started;
+        event->finished_ns = clock_elapsed_ns(&worker->clock);
         
-        /* don't know what to do if this fails :-/ */
-        eventfd_write(pool->event_fd, 1);
+        __atomic_store_n(&worker->trace_seq, seq + 2, __ATOMIC_RELEASE);
+    }
+    
+    if (task->future) {
+        /* 'task' may be gone after this */
+        _future_complete(pool, worker, task->future);
+        return;
+    }
+    
+    if (task->flags & THREADPOOL_TASK_DETACHED) {
+        /* 'task' may be gone after this */
+        if (task->complete)
+            task->complete(task);
         
-        pthread_testcancel();
+        return;
     }
     
-    return NULL;
+    _task_push(pool->ring_out, &pool->task_queue_out, &pool->mutex_queue_out,
+               &task, 1);
+    
+    _threadpool_wake(&pool->consumers_idle, &pool->sem_queue_out, 1);
+    
+    /* don't know what to do if this fails :-/ */
+    eventfd_write(pool->event_fd, 1);
 }
 
-struct threadpool *threadpool_new(int threads)
+static struct threadpool_task *
+_worker_steal_task(struct threadpool_worker *__restrict worker)
 {
     struct threadpool *pool;
-    int err;
+    struct threadpool_worker *victim;
+    unsigned int i, n, start;
+    void *task;
     
-    pool = malloc(sizeof(*pool));
-    if (!pool)
-        return NULL;
+    pool = worker->pool;
+    n    = __atomic_load_n(&pool->workers_used, __ATOMIC_ACQUIRE);
     
-    err = threadpool_init(pool, threads);
-    if (err < 0) {
-        free(pool);
-        return NULL;
+    /* xorshift, so not all idle workers go for the same victim */
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 17;
+    worker->seed ^= worker->seed << 5;
+    
+    start = worker->seed % n;
+    
+    for (i = 0; i < n; ++i) {
+        victim = pool->workers + (start + i) % n;
+        if (victim == worker)
+            continue;
+        
+        task = ws_deque_steal(&victim->deque);
+        if (task) {
+            _counter_add(&worker->counters.steals, 1);
+            return task;
+        }
     }
     
-    return pool;
+    return NULL;
 }
 
-void threadpool_delete(struct threadpool *__restrict pool)
+static struct threadpool_task *
+_threadpool_node_pop(struct threadpool *__restrict pool, unsigned int node)
 {
-    threadpool_destroy(pool);
-    free(pool);
+    return _task_pop(pool->nodes[node].ring, &pool->nodes[node].task_queue,
+                     &pool->mutex_queue_in);
 }
 
-int threadpool_init(struct threadpool *__restrict pool, int threads)
+static struct threadpool_task *
+_worker_find_local_task(struct threadpool_worker *__restrict worker)
 {
-    const struct map_config map_conf = {
-        .size           = MAP_DEFAULT_SIZE,
-        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
-        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
-        .static_size    = false,
-        .key_compare    = &_thread_compare,
-        .key_hash       = &_thread_hash,
-        .data_delete    = &_thread_delete,
-    };
-    int i, err;
-    
-    memset(pool, 0, sizeof(*pool));
+    struct threadpool_task *task;
     
-    pool->event_fd = eventfd(0, 0);
-    if (pool->event_fd < 0) {
-        err = -errno;
-        goto out;
+    if (worker->pool->mode == THREADPOOL_MODE_WORK_STEALING) {
+        task = ws_deque_pop(&worker->deque);
+        if (task)
+            return task;
     }
     
-    err = pthread_mutex_init(&pool->mutex_queue_in, NULL);
-    if (err) {
-        errno = err;
-        goto cleanup1;
+    return _threadpool_node_pop(worker->pool, worker->node);
+}
+
+static struct threadpool_task *
+_worker_find_remote_task(struct threadpool_worker *__restrict worker)
+{
+    struct threadpool *pool;
+    struct threadpool_task *task;
+    unsigned int i;
+    
+    pool = worker->pool;
+    
+    if (pool->mode == THREADPOOL_MODE_WORK_STEALING) {
+        task = _worker_steal_task(worker);
+        if (task)
+            return task;
     }
     
-    err = pthread_mutex_init(&pool->mutex_queue_out, NULL);
-    if (err) {
-        errno = err;
-        goto cleanup2;
+    /* help out other nodes only if there is nothing else to do */
+    for (i = 1; i < pool->node_count; ++i) {
+        task = _threadpool_node_pop(pool, (worker->node + i) % pool->node_count);
+        if (task)
+            return task;
     }
     
-    err = pthread_mutex_init(&pool->mutex_map, NULL);
-    if (err) {
-        errno = err;
-        goto cleanup3;
+    return NULL;
+}
+
+static struct threadpool_task *
+_worker_find_task(struct threadpool_worker *__restrict worker)
+{
+    struct threadpool *pool;
+    struct threadpool_task *task;
+    int prio;
+    
+    pool = worker->pool;
+    
+    /* worker deques and node queues only hold tasks with normal priority */
+    for (prio = 0; prio < THREADPOOL_PRIORITIES; ++prio) {
+        if (prio == THREADPOOL_PRIORITY_NORMAL) {
+            task = _worker_find_local_task(worker);
+            if (task)
+                return task;
+        }
+        
+        task = _task_pop(pool->ring_in[prio], &pool->task_queue_in[prio], 
+                         &pool->mutex_queue_in);
+        if (task)
+            return task;
+        
+        if (prio == THREADPOOL_PRIORITY_NORMAL) {
+            task = _worker_find_remote_task(worker);
+            if (task)
+                return task;
+        }
     }
+    
+    return NULL;
+}
 
-    err = sem_init(&pool->sem_queue_in, 0, 0);
-    if (err < 0)
-        goto cleanup4;
+static int _thread_park(struct threadpool *__restrict pool)
+{
+    struct timespec ts;
     
-    err = sem_init(&pool->sem_queue_out, 0, 0);
-    if (err < 0)
-        goto cleanup5;
+    if (!pool->elastic)
+        return sem_wait(&pool->sem_queue_in);
     
-    err = sem_init(&pool->sem_exit, 0, 1);
-    if (err < 0)
-        goto cleanup6;
+    /* sem_timedwait() only knows about CLOCK_REALTIME */
+    clock_gettime(CLOCK_REALTIME, &ts);
     
-    err = map_init(&pool->thread_map, &map_conf);
-    if (err < 0)
-        goto cleanup7;
+    ts.tv_sec  += pool->idle_timeout_ms / 1000;
+    ts.tv_nsec += (pool->idle_timeout_ms % 1000) * 1000000;
     
-    for (i = 0; i < threads; ++i) {
-        err = threadpool_add_thread(pool);
-        if(err < 0)
-            goto cleanup8;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec  += 1;
+        ts.tv_nsec -= 1000000000;
     }
     
-    queue_init(&pool->task_queue_in);
-    queue_init(&pool->task_queue_out);
-
-    return 0;
+    return sem_timedwait(&pool->sem_queue_in, &ts);
+}
 
-cleanup8:
-    map_destroy(&pool->thread_map);
-cleanup7:
-    sem_destroy(&pool->sem_exit);
+static void *_thread_handle_tasks(void *arg)
+{
+    struct threadpool_worker *worker;
+    struct threadpool_task *task;
+    struct threadpool *pool;
+    unsigned long start;
+    int i, err;
+    
+    worker = arg;
+    pool   = worker->pool;
+    
+    _worker_self = worker;
+    
+    while (1) {
+        /* requests to exit don't queue up behind the tasks */
+        if (_thread_should_retire(pool))
+            _thread_exit(pool, 0, true);
+        
+        task = _worker_find_task(worker);
+        
+        /* spin for a short while before going to sleep */
+        for (i = 0; !task && i < THREADPOOL_SPIN_COUNT; ++i) {
+            cpu_relax();
+            task = _worker_find_task(worker);
+        }
+        
+        if (!task) {
+            __atomic_add_fetch(&pool->workers_idle, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            
+            /* a task might have been added before we were marked as idle */
+            task = _worker_find_task(worker);
+            if (!task && !__atomic_load_n(&pool->workers_retire, 
+                                          __ATOMIC_RELAXED))
+                err = _thread_park(pool);
+            else
+                err = 0;
+            
+            __atomic_sub_fetch(&pool->workers_idle, 1, __ATOMIC_SEQ_CST);
+            
+            if (!task) {
+                /* idle workers of an elastic pool retire after a while */
+                if (err < 0 && errno == ETIMEDOUT)
+                    _thread_exit(pool, pool->workers_min, false);
+                else if (err < 0 && errno != EINTR)
+                    _thread_exit(pool, 0, false);
+                
+                continue;
+            }
+        }
+        
+        if (pool->measure_busy_time) {
+            start = _now_ns();
+            _threadpool_run_task(pool, worker, task);
+            _counter_add(&worker->counters.busy_ns, _now_ns() - start);
+        } else {
+            _threadpool_run_task(pool, worker, task);
+        }
+        
+        pthread_testcancel();
+    }
+    
+    return NULL;
+}
+
+static struct threadpool_worker *
+_threadpool_get_worker(struct threadpool *__restrict pool)
+{
+    struct threadpool_worker *worker;
+    unsigned int i;
+    int err;
+    
+    /* caller must hold 'mutex_map' */
+    for (i = 0; i < pool->workers_used; ++i) {
+        if (!pool->workers[i].active)
+            return pool->workers + i;
+    }
+    
+    if (pool->workers_used == pool->workers_max) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    
+    worker = pool->workers + pool->workers_used;
+    
+    err = ws_deque_init(&worker->deque, THREADPOOL_DEQUE_SIZE);
+    if (err < 0)
+        return NULL;
+    
+    if (pool->trace_mask) {
+        worker->trace = calloc(pool->trace_mask + 1, sizeof(*worker->trace));
+        if (!worker->trace) {
+            ws_deque_destroy(&worker->deque);
+            return NULL;
+        }
+    }
+    
+    worker->pool  = pool;
+    worker->seed  = pool->workers_used + 1;
+    worker->clock = pool->trace_clock;
+    
+    /* thieves may only look at workers with an initialized deque */
+    __atomic_store_n(&pool->workers_used, pool->workers_used + 1, 
+                     __ATOMIC_RELEASE);
+    
+    return worker;
+}
+
+/* caller must hold 'mutex_map' */
+static int _threadpool_place_worker(struct threadpool *__restrict pool,
+                                    struct threadpool_worker *worker,
+                                    pthread_attr_t *__restrict attr)
+{
+    struct threadpool_node *node;
+    cpu_set_t set;
+    unsigned int i, cpu, skip;
+    
+    worker->node = 0;
+    
+    for (i = 1; i < pool->node_count; ++i) {
+        if (pool->nodes[i].workers < pool->nodes[worker->node].workers)
+            worker->node = i;
+    }
+    
+    if (!pool->set_affinity)
+        return 0;
+    
+    node = pool->nodes + worker->node;
+    
+    if (!pool->pin_threads)
+        return pthread_attr_setaffinity_np(attr, sizeof(node->cpus), 
+                                           &node->cpus);
+    
+    /* hand out the cpus of the node round robin */
+    skip = node->next_cpu++ % CPU_COUNT(&node->cpus);
+    
+    for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &node->cpus) && skip-- == 0)
+            break;
+    }
+    
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+}
+
+static void _threadpool_destroy_nodes(struct threadpool *__restrict pool)
+{
+    unsigned int i;
+    
+    for (i = 0; i < pool->node_count; ++i) {
+        if (!pool->nodes[i].ring)
+            break;
+        
+        queue_destroy(&pool->nodes[i].task_queue, NULL);
+        mpmc_ring_delete(pool->nodes[i].ring);
+    }
+    
+    free(pool->nodes);
+}
+
+static int _threadpool_init_nodes(struct threadpool *__restrict pool,
+                                  const struct threadpool_config *conf,
+                                  unsigned int queue_size)
+{
+    cpu_set_t allowed, online, cpus;
+    unsigned int i, n;
+    int err;
+    
+    if (conf->cpus) {
+        allowed = *conf->cpus;
+    } else {
+        err = sched_getaffinity(0, sizeof(allowed), &allowed);
+        if (err < 0)
+            return -errno;
+    }
+    
+    /* there would be no cpu to run or pin the workers on */
+    if (CPU_COUNT(&allowed) == 0)
+        return -EINVAL;
+    
+    /* node IDs may have gaps, e.g. after memory hot-unplug */
+    CPU_ZERO(&online);
+    
+    if (conf->numa)
+        numa_nodes_online(&online);
+    
+    /* count the nodes which have at least one usable cpu */
+    n = 0;
+    
+    for (i = 0; i < CPU_SETSIZE; ++i) {
+        if (!CPU_ISSET(i, &online) || numa_node_cpus(i, &cpus) < 0)
+            continue;
+        
+        CPU_AND(&cpus, &cpus, &allowed);
+        n += CPU_COUNT(&cpus) > 0;
+    }
+    
+    pool->node_count = max(n, 1);
+    
+    pool->nodes = calloc(pool->node_count, sizeof(*pool->nodes));
+    if (!pool->nodes)
+        return -errno;
+    
+    pool->nodes[0].cpus = allowed;
+    
+    for (i = 0, n = 0; i < CPU_SETSIZE && n < pool->node_count; ++i) {
+        if (!CPU_ISSET(i, &online) || numa_node_cpus(i, &cpus) < 0)
+            continue;
+        
+        CPU_AND(&cpus, &cpus, &allowed);
+        
+        if (CPU_COUNT(&cpus) > 0)
+            pool->nodes[n++].cpus = cpus;
+    }
+    
+    for (i = 0; i < pool->node_count; ++i) {
+        pool->nodes[i].ring = mpmc_ring_new(queue_size);
+        if (!pool->nodes[i].ring) {
+            err = -errno;
+            _threadpool_destroy_nodes(pool);
+            return err;
+        }
+        
+        queue_init(&pool->nodes[i].task_queue);
+    }
+    
+    return 0;
+}
+
+struct threadpool *threadpool_new(int threads)
+{
+    struct threadpool *pool;
+    int err;
+    
+    pool = malloc(sizeof(*pool));
+    if (!pool)
+        return NULL;
+    
+    err = threadpool_init(pool, threads);
+    if (err < 0) {
+        free(pool);
+        return NULL;
+    }
+    
+    return pool;
+}
+
+struct threadpool *
+threadpool_new_config(const struct threadpool_config *__restrict conf)
+{
+    struct threadpool *pool;
+    int err;
+    
+    pool = malloc(sizeof(*pool));
+    if (!pool)
+        return NULL;
+    
+    err = threadpool_init_config(pool, conf);
+    if (err < 0) {
+        free(pool);
+        return NULL;
+    }
+    
+    return pool;
+}
+
+void threadpool_delete(struct threadpool *__restrict pool)
+{
+    threadpool_destroy(pool);
+    free(pool);
+}
+
+int threadpool_init(struct threadpool *__restrict pool, int threads)
+{
+    const struct threadpool_config conf = {
+        .threads        = threads,
+        .max_threads    = THREADPOOL_DEFAULT_MAX_THREADS,
+        .queue_size     = THREADPOOL_DEFAULT_QUEUE_SIZE,
+        .mode           = THREADPOOL_MODE_SHARED_QUEUE,
+    };
+    
+    return threadpool_init_config(pool, &conf);
+}
+
+int threadpool_init_config(struct threadpool *__restrict pool,
+                           const struct threadpool_config *__restrict conf)
+{
+    const struct map_config map_conf = {
+        .size           = MAP_DEFAULT_SIZE,
+        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
+        .static_size    = false,
+        .key_compare    = &_thread_compare,
+        .key_hash       = &_thread_hash,
+        .data_delete    = &_thread_delete,
+    };
+    void *workers;
+    unsigned int queue_size;
+    int i, workers_max, err;
+    
+    memset(pool, 0, sizeof(*pool));
+    
+    /* clamp before it goes into the unsigned 'workers_max', both may be < 0 */
+    workers_max = max(conf->max_threads, conf->threads);
+    
+    pool->mode              = conf->mode;
+    pool->measure_wait_time = conf->measure_wait_time;
+    pool->set_affinity      = conf->cpus || conf->pin_threads || conf->numa;
+    pool->pin_threads       = conf->pin_threads;
+    pool->measure_busy_time = conf->measure_busy_time;
+    pool->workers_max       = (workers_max > 0) ?
+                              workers_max : THREADPOOL_DEFAULT_MAX_THREADS;
+    
+    if (conf->elastic) {
+        pool->elastic          = true;
+        pool->workers_min      = max(conf->min_threads, 0);
+        pool->idle_timeout_ms  = conf->idle_timeout_ms;
+        pool->grow_queue_depth = conf->grow_queue_depth;
+        pool->grow_wait_ns     = conf->grow_wait_ns;
+        
+        if (pool->idle_timeout_ms == 0)
+            pool->idle_timeout_ms = THREADPOOL_DEFAULT_IDLE_TIMEOUT;
+        
+        if (pool->grow_queue_depth == 0)
+            pool->grow_queue_depth = THREADPOOL_DEFAULT_GROW_QUEUE_DEPTH;
+        
+        if (!pool->measure_wait_time)
+            pool->grow_wait_ns = 0;
+    }
+    
+    queue_size = conf->queue_size;
+    if (queue_size == 0)
+        queue_size = THREADPOOL_DEFAULT_QUEUE_SIZE;
+    
+    if (conf->trace_size) {
+        /* round up to a power of two */
+        pool->trace_mask = max(conf->trace_size, 2U) - 1;
+        
+        for (i = 1; i < (int) (8 * sizeof(pool->trace_mask)); i <<= 1)
+            pool->trace_mask |= pool->trace_mask >> i;
+    }
+    
+    err = clock_init(&pool->trace_clock, CLOCK_MONOTONIC);
+    if (err < 0)
+        goto out;
+    
+    clock_start(&pool->trace_clock);
+    
+    pool->trace_epoch_ns = pool->trace_clock.start.tv_sec * 1000000000UL 
+                           + pool->trace_clock.start.tv_nsec;
+    
+    pool->event_fd = eventfd(0, 0);
+    if (pool->event_fd < 0) {
+        err = -errno;
+        goto out;
+    }
+    
+    err = pthread_mutex_init(&pool->mutex_queue_in, NULL);
+    if (err) {
+        errno = err;
+        goto cleanup1;
+    }
+    
+    err = pthread_mutex_init(&pool->mutex_queue_out, NULL);
+    if (err) {
+        errno = err;
+        goto cleanup2;
+    }
+    
+    err = pthread_mutex_init(&pool->mutex_map, NULL);
+    if (err) {
+        errno = err;
+        goto cleanup3;
+    }
+
+    err = sem_init(&pool->sem_queue_in, 0, 0);
+    if (err < 0)
+        goto cleanup4;
+    
+    err = sem_init(&pool->sem_queue_out, 0, 0);
+    if (err < 0)
+        goto cleanup5;
+    
+    err = sem_init(&pool->sem_exit, 0, 1);
+    if (err < 0)
+        goto cleanup6;
+    
+    err = posix_memalign(&workers, CACHELINE_SIZE,
+                         pool->workers_max * sizeof(*pool->workers));
+    if (err) {
+        errno = err;
+        goto cleanup7;
+    }
+    
+    pool->workers = memset(workers, 0, 
+                           pool->workers_max * sizeof(*pool->workers));
+    
+    err = map_init(&pool->thread_map, &map_conf);
+    if (err < 0)
+        goto cleanup8;
+    
+    for (i = 0; i < THREADPOOL_PRIORITIES; ++i) {
+        pool->ring_in[i] = mpmc_ring_new(queue_size);
+        if (!pool->ring_in[i]) {
+            err = -errno;
+            goto cleanup10;
+        }
+        
+        queue_init(pool->task_queue_in + i);
+    }
+    
+    pool->ring_out = mpmc_ring_new(queue_size);
+    if (!pool->ring_out) {
+        err = -errno;
+        goto cleanup10;
+    }
+    
+    queue_init(&pool->task_queue_out);
+    
+    err = _threadpool_init_nodes(pool, conf, queue_size);
+    if (err < 0)
+        goto cleanup11;
+    
+    for (i = 0; i < conf->threads; ++i) {
+        err = threadpool_add_thread(pool);
+        if(err < 0)
+            goto cleanup12;
+    }
+
+    return 0;
+
+cleanup12:
+    map_clear(&pool->thread_map);
+    _threadpool_destroy_nodes(pool);
+cleanup11:
+    mpmc_ring_delete(pool->ring_out);
+cleanup10:
+    for (i = 0; i < THREADPOOL_PRIORITIES && pool->ring_in[i]; ++i)
+        mpmc_ring_delete(pool->ring_in[i]);
+    
+    map_destroy(&pool->thread_map);
+cleanup8:
+    for (i = 0; i < (int) pool->workers_used; ++i) {
+        ws_deque_destroy(&pool->workers[i].deque);
+        free(pool->workers[i].trace);
+    }
+    
+    free(pool->workers);
+cleanup7:
+    sem_destroy(&pool->sem_exit);
 cleanup6:
     sem_destroy(&pool->sem_queue_out);
 cleanup5:
@@ -311,7 +1145,21 @@ void threadpool_destroy(struct threadpool *__restrict pool)
      * operate on the threadpool when it gets destroyed.
      */
     queue_destroy(&pool->task_queue_out, NULL);
-    queue_destroy(&pool->task_queue_in, NULL);
+    mpmc_ring_delete(pool->ring_out);
+    
+    _threadpool_destroy_nodes(pool);
+    
+    for (unsigned int i = 0; i < THREADPOOL_PRIORITIES; ++i) {
+        queue_destroy(pool->task_queue_in + i, NULL);
+        mpmc_ring_delete(pool->ring_in[i]);
+    }
+    
+    for (unsigned int i = 0; i < pool->workers_used; ++i) {
+        ws_deque_destroy(&pool->workers[i].deque);
+        free(pool->workers[i].trace);
+    }
+    
+    free(pool->workers);
 
     sem_destroy(&pool->sem_exit);
     sem_destroy(&pool->sem_queue_out);
@@ -320,6 +1168,8 @@ void threadpool_destroy(struct threadpool *__restrict pool)
     pthread_mutex_destroy(&pool->mutex_map);
     pthread_mutex_destroy(&pool->mutex_queue_out);
     pthread_mutex_destroy(&pool->mutex_queue_in);
+    
+    clock_destroy(&pool->trace_clock);
 }
 
 int threadpool_event_fd(const struct threadpool *__restrict pool)
@@ -327,87 +1177,709 @@ int threadpool_event_fd(const struct threadpool *__restrict pool)
     return pool->event_fd;
 }
 
-int threadpool_add_thread(struct threadpool *__restrict pool)
+/* caller must hold 'mutex_map' */
+static int _threadpool_start_thread(struct threadpool *__restrict pool)
 {
-    pthread_t *thread;
+    struct threadpool_worker *worker;
     pthread_attr_t attr;
     int err;
     
-    thread = malloc(sizeof(*thread));
-    if (!thread) {
+    worker = _threadpool_get_worker(pool);
+    if (!worker) {
         err = -errno;
         goto out;
     }
 
     err = pthread_attr_init(&attr);
+    if (err)
+        goto out;
+    
+    err = _threadpool_place_worker(pool, worker, &attr);
     if (err)
         goto cleanup1;
     
-    err = pthread_create(thread, &attr, &_thread_handle_tasks, pool);
+    worker->started_ns = _now_ns();
+    
+    err = pthread_create(&worker->thread, &attr, &_thread_handle_tasks, worker);
     if (err)
+        goto cleanup1;
+    
+    err = map_insert(&pool->thread_map, &worker->thread, worker);
+    if (err < 0)
         goto cleanup2;
     
-    pthread_mutex_lock(&pool->mutex_map);
-    err = map_insert(&pool->thread_map, thread, thread);
-    pthread_mutex_unlock(&pool->mutex_map);
-    
-    if (err < 0)
-        goto cleanup3;
+    pool->nodes[worker->node].workers += 1;
+    worker->active = true;
     
     pthread_attr_destroy(&attr);
     
     return 0;
 
-cleanup3:
-    pthread_cancel(*thread);
-    pthread_join(*thread, NULL);
 cleanup2:
-    pthread_attr_destroy(&attr);
+    pthread_cancel(worker->thread);
+    pthread_join(worker->thread, NULL);
 cleanup1:
-    free(thread);
+    pthread_attr_destroy(&attr);
 out:
     return (err > 0) ? -err : err;
 }
 
+int threadpool_add_thread(struct threadpool *__restrict pool)
+{
+    int err;
+    
+    pthread_mutex_lock(&pool->mutex_map);
+    err = _threadpool_start_thread(pool);
+    pthread_mutex_unlock(&pool->mutex_map);
+    
+    return err;
+}
+
 int threadpool_remove_thread(struct threadpool *__restrict pool)
 {
-    struct exit_task *task;
     int err;
+    
     /* 
-     * this approach is quite neat since the first thread to take this
-     * task (and therefore was idling) exits.
-     * However, before that it has to deallocate the memory allocated here.
+     * The first worker to notice the request exits, either after its
+     * current task or right away if it is idle.
      */
-    task = malloc(sizeof(*task));
-    if (!task)
-        return -errno;
+    pthread_mutex_lock(&pool->mutex_map);
     
-    task->task.func = _exit_task_thread;
+    err = -EINVAL;
     
-    task->pool = pool;
+    if (pool->workers_retire < map_size(&pool->thread_map)) {
+        __atomic_add_fetch(&pool->workers_retire, 1, __ATOMIC_RELAXED);
+        err = 0;
+    }
     
-    err = threadpool_add_task(pool, &task->task);
-    if (err < 0)
-        free(task);
+    pthread_mutex_unlock(&pool->mutex_map);
+    
+    if (err == 0)
+        _threadpool_wake(&pool->workers_idle, &pool->sem_queue_in, 1);
     
     return err;
 }
 
+unsigned int threadpool_thread_count(struct threadpool *__restrict pool)
+{
+    unsigned int n;
+    
+    pthread_mutex_lock(&pool->mutex_map);
+    n = map_size(&pool->thread_map);
+    pthread_mutex_unlock(&pool->mutex_map);
+    
+    return n;
+}
+
 int threadpool_add_task(struct threadpool *__restrict pool, 
                         struct threadpool_task *task)
 {
+    return threadpool_add_tasks_priority(pool, &task, 1, 
+                                         THREADPOOL_PRIORITY_NORMAL);
+}
+
+static void _threadpool_prepare_tasks(struct threadpool *__restrict pool,
+                                      struct threadpool_task **tasks,
+                                      unsigned int n,
+                                      enum threadpool_priority priority,
+                                      unsigned int flags)
+{
+    unsigned long now;
+    unsigned int i;
+    
+    now = (pool->measure_wait_time || pool->trace_mask) ? _now_ns() : 0;
+    
+    for (i = 0; i < n; ++i) {
+        tasks[i]->flags       = flags;
+        tasks[i]->future      = NULL;
+        tasks[i]->priority    = priority;
+        tasks[i]->enqueued_ns = now;
+    }
+}
+
+/* 'tasks' have to be prepared by _threadpool_prepare_tasks() */
+static void _threadpool_add_tasks(struct threadpool *__restrict pool,
+                                  struct threadpool_task **tasks,
+                                  unsigned int n,
+                                  enum threadpool_priority priority)
+{
+    struct threadpool_worker *worker;
+    unsigned int i;
+    
+    worker = _threadpool_self(pool);
+    i      = 0;
+    
+    if (pool->mode == THREADPOOL_MODE_WORK_STEALING && worker 
+        && priority == THREADPOOL_PRIORITY_NORMAL) {
+        while (i < n && ws_deque_push(&worker->deque, tasks[i]) == 0)
+            ++i;
+        
+        _threadpool_wake(&pool->workers_idle, &pool->sem_queue_in, i);
+        
+        _threadpool_check_depth(pool, &worker->counters.queue_max, 
+                                ws_deque_size(&worker->deque));
+    }
+    
+    if (i < n)
+        _threadpool_push_global(pool, tasks + i, n - i, priority);
+}
+
+int threadpool_add_tasks(struct threadpool *__restrict pool,
+                         struct threadpool_task **tasks,
+                         unsigned int n)
+{
+    return threadpool_add_tasks_priority(pool, tasks, n, 
+                                         THREADPOOL_PRIORITY_NORMAL);
+}
+
+int threadpool_add_task_priority(struct threadpool *__restrict pool,
+                                 struct threadpool_task *task,
+                                 enum threadpool_priority priority)
+{
+    return threadpool_add_tasks_priority(pool, &task, 1, priority);
+}
+
+int threadpool_add_tasks_priority(struct threadpool *__restrict pool,
+                                  struct threadpool_task **tasks,
+                                  unsigned int n,
+                                  enum threadpool_priority priority)
+{
+    if ((unsigned int) priority >= THREADPOOL_PRIORITIES)
+        return -EINVAL;
+    
+    _threadpool_prepare_tasks(pool, tasks, n, priority, 0);
+    _threadpool_add_tasks(pool, tasks, n, priority);
+    
+    return 0;
+}
+
+int threadpool_add_task_node(struct threadpool *__restrict pool,
+                             struct threadpool_task *task,
+                             unsigned int node)
+{
+    return threadpool_add_tasks_node(pool, &task, 1, node);
+}
+
+int threadpool_add_tasks_node(struct threadpool *__restrict pool,
+                              struct threadpool_task **tasks,
+                              unsigned int n,
+                              unsigned int node)
+{
+    if (node >= pool->node_count)
+        return -EINVAL;
+    
+    _threadpool_prepare_tasks(pool, tasks, n, THREADPOOL_PRIORITY_NORMAL, 0);
+    
+    _task_push(pool->nodes[node].ring, &pool->nodes[node].task_queue, 
+               &pool->mutex_queue_in, tasks, n);
+    
+    _threadpool_wake(&pool->workers_idle, &pool->sem_queue_in, n);
+    
+    _threadpool_check_depth(pool, &pool->queue_max, 
+                            mpmc_ring_size(pool->nodes[node].ring));
+    
+    return 0;
+}
+
+int threadpool_add_detached_task(struct threadpool *__restrict pool,
+                                 struct threadpool_task *task,
+                                 void (*complete)(struct threadpool_task *))
+{
+    task->complete = complete;
+    
+    _threadpool_prepare_tasks(pool, &task, 1, THREADPOOL_PRIORITY_NORMAL, 
+                              THREADPOOL_TASK_DETACHED);
+    _threadpool_add_tasks(pool, &task, 1, THREADPOOL_PRIORITY_NORMAL);
+    
+    return 0;
+}
+
+int threadpool_future_init(struct threadpool_future *__restrict future)
+{
+    pthread_condattr_t attr;
     int err;
+    
+    err = pthread_mutex_init(&future->mutex, NULL);
+    if (err)
+        return -err;
+    
+    err = pthread_condattr_init(&attr);
+    if (err)
+        goto cleanup1;
+    
+    /* timeouts must not depend on the wall clock */
+    err = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    if (err)
+        goto cleanup2;
+    
+    err = pthread_cond_init(&future->cond, &attr);
+    if (err)
+        goto cleanup2;
+    
+    pthread_condattr_destroy(&attr);
+    
+    queue_init(&future->continuations);
+    
+    future->waiters = 0;
+    future->done    = false;
+    
+    return 0;
 
-    pthread_mutex_lock(&pool->mutex_queue_in);
+cleanup2:
+    pthread_condattr_destroy(&attr);
+cleanup1:
+    pthread_mutex_destroy(&future->mutex);
     
-    err = sem_post(&pool->sem_queue_in);
-    if (err < 0) {
-        pthread_mutex_unlock(&pool->mutex_queue_in);
+    return -err;
+}
+
+void threadpool_future_destroy(struct threadpool_future *__restrict future)
+{
+    pthread_cond_destroy(&future->cond);
+    pthread_mutex_destroy(&future->mutex);
+}
+
+int threadpool_add_task_future(struct threadpool *__restrict pool,
+                               struct threadpool_task *task,
+                               struct threadpool_future *future)
+{
+    _threadpool_prepare_tasks(pool, &task, 1, THREADPOOL_PRIORITY_NORMAL, 0);
+    
+    task->future = future;
+    
+    _threadpool_add_tasks(pool, &task, 1, THREADPOOL_PRIORITY_NORMAL);
+    
+    return 0;
+}
+
+bool threadpool_future_done(struct threadpool_future *__restrict future)
+{
+    bool done;
+    
+    /* 
+     * Take the lock, so the future can't be destroyed while 
+     * _future_complete() still holds it.
+     */
+    pthread_mutex_lock(&future->mutex);
+    done = future->done;
+    pthread_mutex_unlock(&future->mutex);
+    
+    return done;
+}
+
+void threadpool_future_wait(struct threadpool_future *__restrict future)
+{
+    pthread_mutex_lock(&future->mutex);
+    
+    future->waiters += 1;
+    
+    while (!future->done)
+        pthread_cond_wait(&future->cond, &future->mutex);
+    
+    future->waiters -= 1;
+    
+    pthread_mutex_unlock(&future->mutex);
+}
+
+int threadpool_future_wait_timeout(struct threadpool_future *__restrict future,
+                                   unsigned long timeout_ms)
+{
+    struct timespec ts;
+    int err;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    ts.tv_sec  += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+    
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec  += 1;
+        ts.tv_nsec -= 1000000000;
+    }
+    
+    err = 0;
+    
+    pthread_mutex_lock(&future->mutex);
+    
+    future->waiters += 1;
+    
+    while (!future->done && err != ETIMEDOUT)
+        err = pthread_cond_timedwait(&future->cond, &future->mutex, &ts);
+    
+    future->waiters -= 1;
+    
+    err = (future->done) ? 0 : -ETIMEDOUT;
+    
+    pthread_mutex_unlock(&future->mutex);
+    
+    return err;
+}
+
+/* 'task' has to be prepared by _threadpool_prepare_tasks() */
+static void _future_then(struct threadpool *__restrict pool,
+                         struct threadpool_future *__restrict future,
+                         struct threadpool_task *task)
+{
+    bool done;
+    
+    pthread_mutex_lock(&future->mutex);
+    
+    done = future->done;
+    if (!done)
+        queue_insert(&future->continuations, &task->link);
+    
+    pthread_mutex_unlock(&future->mutex);
+    
+    if (done)
+        _threadpool_add_tasks(pool, &task, 1, THREADPOOL_PRIORITY_NORMAL);
+}
+
+int threadpool_future_then(struct threadpool *__restrict pool,
+                           struct threadpool_future *future,
+                           struct threadpool_task *task,
+                           struct threadpool_future *next)
+{
+    _threadpool_prepare_tasks(pool, &task, 1, THREADPOOL_PRIORITY_NORMAL, 0);
+    
+    task->future = next;
+    
+    _future_then(pool, future, task);
+    
+    return 0;
+}
+
+struct when_all_task {
+    struct threadpool_task task;
+    struct when_all *group;
+};
+
+struct when_all {
+    struct threadpool *pool;
+    struct threadpool_future *future;
+    unsigned int pending;
+    
+    struct when_all_task tasks[];
+};
+
+static void _when_all_run(struct threadpool_task *task)
+{
+    (void) task;
+}
+
+static void _when_all_complete(struct threadpool_task *task)
+{
+    struct when_all *group;
+    
+    group = container_of(task, struct when_all_task, task)->group;
+    
+    if (__atomic_sub_fetch(&group->pending, 1, __ATOMIC_ACQ_REL))
+        return;
+    
+    _future_complete(group->pool, _threadpool_self(group->pool), 
+                     group->future);
+    
+    free(group);
+}
+
+int threadpool_when_all(struct threadpool *__restrict pool,
+                        struct threadpool_future **futures,
+                        unsigned int n,
+                        struct threadpool_future *future)
+{
+    struct when_all *group;
+    struct threadpool_task *task;
+    unsigned int i;
+    
+    if (n == 0) {
+        _future_complete(pool, _threadpool_self(pool), future);
+        return 0;
+    }
+    
+    group = malloc(sizeof(*group) + n * sizeof(*group->tasks));
+    if (!group)
         return -errno;
+    
+    group->pool    = pool;
+    group->future  = future;
+    group->pending = n;
+    
+    /* an empty continuation of every future counts down 'pending' */
+    for (i = 0; i < n; ++i) {
+        task = &group->tasks[i].task;
+        
+        task->func     = &_when_all_run;
+        task->complete = &_when_all_complete;
+        
+        group->tasks[i].group = group;
+        
+        _threadpool_prepare_tasks(pool, &task, 1, THREADPOOL_PRIORITY_NORMAL,
+                                  THREADPOOL_TASK_DETACHED);
+        _future_then(pool, futures[i], task);
     }
     
-    queue_insert(&pool->task_queue_in, &task->link);
-    pthread_mutex_unlock(&pool->mutex_queue_in);
+    return 0;
+}
+
+struct range_job {
+    struct threadpool *pool;
+    
+    void (*func)(long, long, void *);
+    void (*reduce)(long, long, void *, void *);
+    void (*combine)(void *, const void *, void *);
+    void *arg;
+    
+    /* only used by threadpool_parallel_reduce() */
+    void *result;
+    const void *identity;
+    size_t size;
+    
+    long grain;
+    unsigned int pending;
+    
+    pthread_mutex_t mutex;
+};
+
+struct range_task {
+    struct threadpool_task task;
+    struct range_job *job;
+    long begin;
+    long end;
+    
+    /* partial result of a reduction */
+    char acc[] __attribute__((aligned(16)));
+};
+
+/* a queued task for a thread that is outside the pool's workers */
+static struct threadpool_task *
+_threadpool_find_task(struct threadpool *__restrict pool)
+{
+    struct threadpool_task *task;
+    unsigned int i, n;
+    int prio;
+    
+    for (prio = 0; prio < THREADPOOL_PRIORITIES; ++prio) {
+        task = _task_pop(pool->ring_in[prio], &pool->task_queue_in[prio], 
+                         &pool->mutex_queue_in);
+        if (task)
+            return task;
+        
+        if (prio != THREADPOOL_PRIORITY_NORMAL)
+            continue;
+        
+        for (i = 0; i < pool->node_count; ++i) {
+            task = _threadpool_node_pop(pool, i);
+            if (task)
+                return task;
+        }
+        
+        if (pool->mode != THREADPOOL_MODE_WORK_STEALING)
+            continue;
+        
+        n = __atomic_load_n(&pool->workers_used, __ATOMIC_ACQUIRE);
+        
+        for (i = 0; i < n; ++i) {
+            task = ws_deque_steal(&pool->workers[i].deque);
+            if (task)
+                return task;
+        }
+    }
+    
+    return NULL;
+}
+
+/* runs one queued task on the calling thread, returns false if none ran */
+static bool _threadpool_help(struct threadpool *__restrict pool)
+{
+    struct threadpool_worker *worker;
+    struct threadpool_task *task;
+    
+    worker = _threadpool_self(pool);
+    task   = (worker) ? _worker_find_task(worker) : _threadpool_find_task(pool);
+    if (!task)
+        return false;
+    
+    _threadpool_run_task(pool, worker, task);
+    
+    return true;
+}
+
+static void _range_task_run(struct threadpool_task *task);
+
+static void _range_task_free(struct threadpool_task *task)
+{
+    free(container_of(task, struct range_task, task));
+}
+
+/*
+ * Hands off the upper half of [begin, end) until at most 'grain' elements
+ * are left. On a worker the halves go onto its own deque, so thieves take
+ * the biggest chunks while the owner keeps working on the lower end.
+ */
+static void _range_split(struct range_job *__restrict job, 
+                         long begin, 
+                         long *end)
+{
+    struct range_task *t;
+    long mid;
+    
+    while (*end - begin > job->grain) {
+        t = malloc(sizeof(*t) + job->size);
+        if (!t)
+            return;
+        
+        mid = begin + (*end - begin) / 2;
+        
+        t->task.func = &_range_task_run;
+        t->job       = job;
+        t->begin     = mid;
+        t->end       = *end;
+        
+        if (job->size)
+            memcpy(t->acc, job->identity, job->size);
+        
+        __atomic_add_fetch(&job->pending, 1, __ATOMIC_RELAXED);
+        
+        threadpool_add_detached_task(job->pool, &t->task, &_range_task_free);
+        
+        *end = mid;
+    }
+}
+
+static void _range_run(struct range_job *__restrict job, 
+                       long begin, 
+                       long end, 
+                       void *acc)
+{
+    _range_split(job, begin, &end);
+    
+    if (job->reduce)
+        job->reduce(begin, end, acc, job->arg);
+    else
+        job->func(begin, end, job->arg);
+}
+
+static void _range_task_run(struct threadpool_task *task)
+{
+    struct range_task *t;
+    struct range_job *job;
+    
+    t   = container_of(task, struct range_task, task);
+    job = t->job;
+    
+    _range_run(job, t->begin, t->end, t->acc);
+    
+    if (job->combine) {
+        pthread_mutex_lock(&job->mutex);
+        job->combine(job->result, t->acc, job->arg);
+        pthread_mutex_unlock(&job->mutex);
+    }
+    
+    /* 'job' lives on the stack of the waiting thread */
+    __atomic_sub_fetch(&job->pending, 1, __ATOMIC_RELEASE);
+}
+
+static void _threadpool_parallel(struct range_job *__restrict job,
+                                 long begin, 
+                                 long end, 
+                                 void *acc)
+{
+    unsigned int workers;
+    int i;
+    
+    if (job->grain <= 0) {
+        /* a few chunks per thread leave enough room for balancing */
+        workers    = __atomic_load_n(&job->pool->workers_used, 
+                                     __ATOMIC_RELAXED);
+        job->grain = max((end - begin) / (8 * (long) (workers + 1)), 1L);
+    }
+    
+    _range_run(job, begin, end, acc);
+    
+    /* don't sleep, run whatever is queued until the other chunks are done */
+    i = 0;
+    
+    while (__atomic_load_n(&job->pending, __ATOMIC_ACQUIRE)) {
+        if (_threadpool_help(job->pool))
+            i = 0;
+        else if (++i < THREADPOOL_SPIN_COUNT)
+            cpu_relax();
+        else
+            sched_yield();
+    }
+}
+
+int threadpool_parallel_for(struct threadpool *__restrict pool,
+                            long begin,
+                            long end,
+                            long grain,
+                            void (*func)(long, long, void *),
+                            void *arg)
+{
+    struct range_job job = {
+        .pool   = pool,
+        .func   = func,
+        .arg    = arg,
+        .grain  = grain,
+    };
+    
+    if (begin >= end)
+        return 0;
+    
+    _threadpool_parallel(&job, begin, end, NULL);
+    
+    return 0;
+}
+
+int threadpool_parallel_reduce(struct threadpool *__restrict pool,
+                               long begin,
+                               long end,
+                               long grain,
+                               void (*func)(long, long, void *, void *),
+                               void (*combine)(void *, const void *, void *),
+                               void *result,
+                               size_t size,
+                               void *arg)
+{
+    struct range_job job = {
+        .pool       = pool,
+        .reduce     = func,
+        .combine    = combine,
+        .arg        = arg,
+        .result     = result,
+        .size       = size,
+        .grain      = grain,
+    };
+    char *buf;
+    int err;
+    
+    if (size == 0)
+        return -EINVAL;
+    
+    if (begin >= end)
+        return 0;
+    
+    /* the identity and the caller's own partial result */
+    buf = malloc(2 * size);
+    if (!buf)
+        return -errno;
+    
+    memcpy(buf, result, size);
+    memcpy(buf + size, result, size);
+    
+    job.identity = buf;
+    
+    err = pthread_mutex_init(&job.mutex, NULL);
+    if (err) {
+        free(buf);
+        return -err;
+    }
+    
+    _threadpool_parallel(&job, begin, end, buf + size);
+    
+    combine(result, buf + size, arg);
+    
+    pthread_mutex_destroy(&job.mutex);
+    free(buf);
     
     return 0;
 }
@@ -415,34 +1887,295 @@ int threadpool_add_task(struct threadpool *__restrict pool,
 struct threadpool_task *
 threadpool_take_completed_task(struct threadpool *__restrict pool)
 {
-    struct link *link;
-    int err;
+    struct threadpool_task *task;
+    int i, err;
     
-again:
-    err = sem_wait(&pool->sem_queue_out);
-    if (err < 0) {
-        if(errno == EINTR)
-            goto again;
-        else
+    while (1) {
+        task = _task_pop(pool->ring_out, &pool->task_queue_out, 
+                         &pool->mutex_queue_out);
+        
+        for (i = 0; !task && i < THREADPOOL_SPIN_COUNT; ++i) {
+            cpu_relax();
+            task = _task_pop(pool->ring_out, &pool->task_queue_out, 
+                             &pool->mutex_queue_out);
+        }
+        
+        if (task)
+            return task;
+        
+        __atomic_add_fetch(&pool->consumers_idle, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        
+        task = _task_pop(pool->ring_out, &pool->task_queue_out, 
+                         &pool->mutex_queue_out);
+        if (!task)
+            err = sem_wait(&pool->sem_queue_out);
+        
+        __atomic_sub_fetch(&pool->consumers_idle, 1, __ATOMIC_SEQ_CST);
+        
+        if (task)
+            return task;
+        
+        if (err < 0 && errno != EINTR)
             return NULL;
     }
+}
+
+unsigned int threadpool_take_completed_tasks(struct threadpool *__restrict pool,
+                                             struct threadpool_task **tasks,
+                                             unsigned int max)
+{
+    unsigned int n;
     
-    pthread_mutex_lock(&pool->mutex_queue_out);
-    link = queue_take(&pool->task_queue_out);
-    pthread_mutex_unlock(&pool->mutex_queue_out);
+    for (n = 0; n < max; ++n) {
+        tasks[n] = _task_pop(pool->ring_out, &pool->task_queue_out, 
+                             &pool->mutex_queue_out);
+        if (!tasks[n])
+            break;
+    }
     
-    return container_of(link, struct threadpool_task, link);
+    return n;
 }
 
 unsigned int threadpool_tasks_queued(struct threadpool *pool)
 {
-    unsigned int ret;
+    unsigned int i, ret;
+    
+    ret = 0;
     
     pthread_mutex_lock(&pool->mutex_queue_in);
     
-    ret = queue_size(&pool->task_queue_in);
+    for (i = 0; i < THREADPOOL_PRIORITIES; ++i)
+        ret += queue_size(pool->task_queue_in + i);
+    
+    for (i = 0; i < pool->node_count; ++i)
+        ret += queue_size(&pool->nodes[i].task_queue);
+    
+    pthread_mutex_unlock(&pool->mutex_queue_in);
+    
+    for (i = 0; i < THREADPOOL_PRIORITIES; ++i)
+        ret += mpmc_ring_size(pool->ring_in[i]);
     
-    pthread_mutex_unlock(&pool->mutex_queue_out);
+    for (i = 0; i < pool->node_count; ++i)
+        ret += mpmc_ring_size(pool->nodes[i].ring);
+    
+    if (pool->mode == THREADPOOL_MODE_WORK_STEALING) {
+        i = __atomic_load_n(&pool->workers_used, __ATOMIC_ACQUIRE);
+        
+        while (i--)
+            ret += ws_deque_size(&pool->workers[i].deque);
+    }
     
     return ret;
 }
+
+int threadpool_priority_stats(struct threadpool *__restrict pool,
+                              enum threadpool_priority priority,
+                              struct threadpool_priority_stats *stats)
+{
+    const struct threadpool_priority_stats *w;
+    unsigned long max_ns;
+    unsigned int i, j, n;
+    
+    if ((unsigned int) priority >= THREADPOOL_PRIORITIES)
+        return -EINVAL;
+    
+    memset(stats, 0, sizeof(*stats));
+    
+    pthread_mutex_lock(&pool->mutex_queue_in);
+    
+    stats->queued = queue_size(pool->task_queue_in + priority);
+    
+    for (i = 0; priority == THREADPOOL_PRIORITY_NORMAL 
+                && i < pool->node_count; ++i)
+        stats->queued += queue_size(&pool->nodes[i].task_queue);
+    
+    pthread_mutex_unlock(&pool->mutex_queue_in);
+    
+    stats->queued += mpmc_ring_size(pool->ring_in[priority]);
+    
+    for (i = 0; priority == THREADPOOL_PRIORITY_NORMAL 
+                && i < pool->node_count; ++i)
+        stats->queued += mpmc_ring_size(pool->nodes[i].ring);
+    
+    n = __atomic_load_n(&pool->workers_used, __ATOMIC_ACQUIRE);
+    
+    for (i = 0; i < n; ++i) {
+        w = pool->workers[i].stats + priority;
+        
+        if (pool->mode == THREADPOOL_MODE_WORK_STEALING
+            && priority == THREADPOOL_PRIORITY_NORMAL)
+            stats->queued += ws_deque_size(&pool->workers[i].deque);
+        
+        stats->dispatched += __atomic_load_n(&w->dispatched, __ATOMIC_RELAXED);
+        stats->wait_ns    += __atomic_load_n(&w->wait_ns, __ATOMIC_RELAXED);
+        
+        max_ns = __atomic_load_n(&w->wait_max_ns, __ATOMIC_RELAXED);
+        stats->wait_max_ns = max(stats->wait_max_ns, max_ns);
+        
+        for (j = 0; j < THREADPOOL_WAIT_BUCKETS; ++j)
+            stats->wait_histogram[j] += __atomic_load_n(&w->wait_histogram[j],
+                                                        __ATOMIC_RELAXED);
+    }
+    
+    return 0;
+}
+
+unsigned int threadpool_node_count(const struct threadpool *__restrict pool)
+{
+    return pool->node_count;
+}
+
+static void _worker_read_stats(struct threadpool_worker *__restrict worker,
+                               unsigned long now,
+                               struct threadpool_worker_stats *stats)
+{
+    const struct threadpool_worker_stats *c;
+    unsigned long alive;
+    
+    c = &worker->counters;
+    
+    stats->tasks     = __atomic_load_n(&c->tasks, __ATOMIC_RELAXED);
+    stats->steals    = __atomic_load_n(&c->steals, __ATOMIC_RELAXED);
+    stats->busy_ns   = __atomic_load_n(&c->busy_ns, __ATOMIC_RELAXED);
+    stats->queue_max = __atomic_load_n(&c->queue_max, __ATOMIC_RELAXED);
+    stats->idle_ns   = 0;
+    
+    if (!worker->pool->measure_busy_time)
+        return;
+    
+    alive = __atomic_load_n(&worker->alive_ns, __ATOMIC_RELAXED);
+    
+    if (worker->active)
+        alive += now - worker->started_ns;
+    
+    stats->idle_ns = (alive > stats->busy_ns) ? alive - stats->busy_ns : 0;
+}
+
+int threadpool_worker_stats(struct threadpool *__restrict pool,
+                            unsigned int index,
+                            struct threadpool_worker_stats *stats)
+{
+    int err;
+    
+    err = 0;
+    
+    /* 'active' and 'started_ns' change under this lock */
+    pthread_mutex_lock(&pool->mutex_map);
+    
+    if (index < pool->workers_used)
+        _worker_read_stats(pool->workers + index, _now_ns(), stats);
+    else
+        err = -EINVAL;
+    
+    pthread_mutex_unlock(&pool->mutex_map);
+    
+    return err;
+}
+
+void threadpool_stats(struct threadpool *__restrict pool,
+                      struct threadpool_stats *stats)
+{
+    struct threadpool_worker_stats w;
+    unsigned long now;
+    unsigned int i;
+    
+    memset(stats, 0, sizeof(*stats));
+    
+    stats->queued    = threadpool_tasks_queued(pool);
+    stats->queue_max = __atomic_load_n(&pool->queue_max, __ATOMIC_RELAXED);
+    stats->idle      = __atomic_load_n(&pool->workers_idle, __ATOMIC_RELAXED);
+    
+    now = _now_ns();
+    
+    pthread_mutex_lock(&pool->mutex_map);
+    
+    stats->threads = map_size(&pool->thread_map);
+    
+    for (i = 0; i < pool->workers_used; ++i) {
+        _worker_read_stats(pool->workers + i, now, &w);
+        
+        stats->workers.tasks    += w.tasks;
+        stats->workers.steals   += w.steals;
+        stats->workers.busy_ns  += w.busy_ns;
+        stats->workers.idle_ns  += w.idle_ns;
+        stats->workers.queue_max = max(stats->workers.queue_max, w.queue_max);
+    }
+    
+    pthread_mutex_unlock(&pool->mutex_map);
+}
+
+unsigned int threadpool_trace(struct threadpool *__restrict pool,
+                              struct threadpool_trace_event *events,
+                              unsigned int max)
+{
+    struct threadpool_worker *worker;
+    unsigned long seq, head, first, size, j, drop;
+    unsigned int i, n, base, used;
+    
+    n    = 0;
+    size = pool->trace_mask + 1;
+    used = __atomic_load_n(&pool->workers_used, __ATOMIC_ACQUIRE);
+    
+    for (i = 0; pool->trace_mask && i < used && n < max; ++i) {
+        worker = pool->workers + i;
+        base   = n;
+        
+        seq   = __atomic_load_n(&worker->trace_seq, __ATOMIC_ACQUIRE);
+        head  = seq / 2;
+        first = (head > size) ? head - size : 0;
+        
+        for (j = first; j < head && n < max; ++j)
+            events[n++] = worker->trace[j & pool->trace_mask];
+        
+        /* 
+         * Drop the events the worker started to overwrite in the meantime,
+         * writing event 'i' overwrites event 'i - size'.
+         */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        
+        seq  = __atomic_load_n(&worker->trace_seq, __ATOMIC_RELAXED);
+        head = (seq + 1) / 2;
+        
+        if (head <= first + size)
+            continue;
+        
+        drop = min(head - size - first, (unsigned long) (n - base));
+        
+        memmove(events + base, events + base + drop, 
+                (n - base - drop) * sizeof(*events));
+        
+        n -= drop;
+    }
+    
+    return n;
+}
+
+int threadpool_trace_dump(struct threadpool *__restrict pool, FILE *file)
+{
+    struct threadpool_trace_event *events;
+    unsigned int i, n, max;
+    int err;
+    
+    max = (pool->trace_mask + 1) * pool->workers_max;
+    
+    if (!pool->trace_mask)
+        return -EINVAL;
+    
+    events = malloc(max * sizeof(*events));
+    if (!events)
+        return -errno;
+    
+    n   = threadpool_trace(pool, events, max);
+    err = 0;
+    
+    for (i = 0; i < n && err >= 0; ++i) {
+        err = fprintf(file, "%u %p %lu %lu %lu\n", events[i].worker, 
+                      (void *) events[i].task, events[i].enqueued_ns, 
+                      events[i].started_ns, events[i].finished_ns);
+    }
+    
+    free(events);
+    
+    return (err < 0) ? -EIO : 0;
+}
@@ -26,32 +26,120 @@
 #include <string.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <limits.h>
 
 #include "map.h"
+#include "map_p.h"
 #include "container_p.h"
 #include "macro.h"
 
+/* slots of the old table moved by every operation during a resize */
+#define MAP_MIGRATE_STEP 32
+/* keys whose slots are prefetched before the first one is resolved */
+#define MAP_BATCH_SIZE 16
+
 static inline bool map_should_grow(const struct map *__restrict map)
 {
-    return 100 * map->size / map->capacity >= map->upper_bound;
+    return 100 * map_size(map) / map->capacity >= map->upper_bound;
 }
 
 static inline bool map_should_shrink(const struct map *__restrict map)
 {
-    return 100 * map->size / map->capacity < map->lower_bound;
+    return 100 * map_size(map) / map->capacity < map->lower_bound;
 }
 
-static int map_resize(struct map *__restrict map, unsigned int capacity)
+/* 
+ * Lookups of missing keys only stop at empty slots, so tombstones make 
+ * them as slow as a full table. Clean up once live and removed entries 
+ * together fill the table halfway between 'upper_bound' and 100 %.
+ */
+static inline bool map_should_cleanup(const struct map *__restrict map)
+{
+    return 200 * (map->size + map->tombstones) / map->capacity >= 
+           map->upper_bound + 100;
+}
+
+/*
+ * Puts an entry into 'table' without checking the load factor.
+ * The stored hash spares us from calling 'key_hash' when resizing.
+ */
+static int map_place(struct map *__restrict map, 
+                     const void *key, 
+                     void *data, 
+                     unsigned int hash)
+{
+    unsigned int index, offset;
+    
+    if (map->engine == MAP_ENGINE_SWISS)
+        return map_swiss_place(map, key, data, hash);
+    
+    if (map->engine == MAP_ENGINE_ROBIN_HOOD)
+        return map_robin_place(map, key, data, hash);
+    
+    index = hash & (map->capacity - 1);
+    offset = 1;
+    
+    while (offset < map->capacity) {
+        if (map->table[index].state != MAP_DATA_STATE_AVAILABLE) {
+            if (map->table[index].state == MAP_DATA_STATE_REMOVED)
+                map->tombstones -= 1;
+            
+            map->table[index].key   = key;
+            map->table[index].data  = data;
+            map->table[index].hash  = hash;
+            map->table[index].state = MAP_DATA_STATE_AVAILABLE;
+            
+            map->size += 1;
+            
+            return 0;
+        }
+
+        index  += offset;
+        offset += 2;
+        
+        index &= (map->capacity - 1);
+    }
+    
+    return -EBADSLT;
+}
+
+static void map_erase(struct map *__restrict map, struct entry *entry)
+{
+    if (map->engine == MAP_ENGINE_SWISS) {
+        map_swiss_erase(map, entry);
+        return;
+    }
+    
+    if (map->engine == MAP_ENGINE_ROBIN_HOOD) {
+        map_robin_erase(map, entry);
+        return;
+    }
+    
+    entry->state     = MAP_DATA_STATE_REMOVED;
+    map->size       -= 1;
+    map->tombstones += 1;
+}
+
+/* rebuilds 'table' with 'capacity' slots before returning */
+static int map_rebuild(struct map *__restrict map, unsigned int capacity)
 {
     struct entry *old_table;
-    unsigned int i, old_capacity, old_size;
+    unsigned int i, old_capacity, old_size, old_tombstones;
     int err;
     
-    old_size     = map->size;
-    old_capacity = map->capacity;
-    old_table    = map->table;
+    if (map->engine == MAP_ENGINE_SWISS)
+        return map_swiss_resize(map, capacity);
     
-    map->size     = 0;
+    if (map->engine == MAP_ENGINE_ROBIN_HOOD)
+        return map_robin_resize(map, capacity);
+    
+    old_size       = map->size;
+    old_tombstones = map->tombstones;
+    old_capacity   = map->capacity;
+    old_table      = map->table;
+    
+    map->size       = 0;
+    map->tombstones = 0;
     map->capacity = max(capacity, MAP_DEFAULT_SIZE);
     map->table    = calloc(map->capacity, sizeof(*map->table));
 
@@ -62,7 +150,8 @@ static int map_resize(struct map *__restrict map, unsigned int capacity)
     
     for (i = 0; i < old_capacity; ++i) {
         if (old_table[i].state == MAP_DATA_STATE_AVAILABLE) {
-            err = map_insert(map, old_table[i].key, old_table[i].data);
+            err = map_place(map, old_table[i].key, old_table[i].data,
+                            old_table[i].hash);
             if(err < 0)
                 goto cleanup1;
         }
@@ -75,13 +164,147 @@ static int map_resize(struct map *__restrict map, unsigned int capacity)
 cleanup1:
     free(map->table);
 out:
-    map->size     = old_size;
-    map->capacity = old_capacity;
+    map->size       = old_size;
+    map->tombstones = old_tombstones;
+    map->capacity   = old_capacity;
     map->table    = old_table;
 
     return err;
 }
 
+/* quadratic probing may miss free slots, so keep doubling until it works */
+static int map_rebuild_grow(struct map *__restrict map, unsigned int capacity)
+{
+    int err;
+    
+    do {
+        err = map_rebuild(map, capacity);
+        capacity <<= 1;
+    } while (err == -EBADSLT);
+    
+    return err;
+}
+
+/* allocates what the engine keeps next to 'table' */
+static int map_engine_init(struct map *__restrict map)
+{
+    map->ctrl = NULL;
+    map->dist = NULL;
+    
+    switch (map->engine) {
+    case MAP_ENGINE_SWISS:
+        return map_swiss_init(map);
+    case MAP_ENGINE_ROBIN_HOOD:
+        return map_robin_init(map);
+    default:
+        return 0;
+    }
+}
+
+static void map_free_table(struct map *__restrict map)
+{
+    free(map->dist);
+    free(map->ctrl);
+    free(map->table);
+}
+
+/* moves up to 'n' slots of the old table into the new one */
+static int map_migrate(struct map *__restrict map, unsigned int n)
+{
+    struct map *old;
+    struct entry *entry;
+    int err;
+    
+    old = map->old;
+    
+    while (n-- && old->size > 0) {
+        entry = old->table + map->migrate_pos;
+        
+        if (entry->state == MAP_DATA_STATE_AVAILABLE) {
+            err = map_place(map, entry->key, entry->data, entry->hash);
+            if (err == -EBADSLT) {
+                err = map_rebuild_grow(map, map->capacity << 1);
+                if (err == 0)
+                    err = map_place(map, entry->key, entry->data, 
+                                    entry->hash);
+            }
+            
+            if (err < 0)
+                return err;
+            
+            /* lookups still search the old table, so erase it there */
+            map_erase(old, entry);
+            
+            /* the Robin Hood engine may have shifted the next entry here */
+            if (entry->state == MAP_DATA_STATE_AVAILABLE)
+                continue;
+        }
+        
+        map->migrate_pos += 1;
+    }
+    
+    if (old->size == 0) {
+        map_free_table(old);
+        free(old);
+        map->old = NULL;
+    }
+    
+    return 0;
+}
+
+/* 
+ * Incremental maps keep the old table around, every following insert,
+ * retrieve or take moves a few of its slots into the new table.
+ */
+static int map_resize(struct map *__restrict map, unsigned int capacity)
+{
+    struct map *old;
+    int err;
+    
+    if (!map->incremental)
+        return map_rebuild_grow(map, capacity);
+    
+    /* a second resize has to wait for the first one to finish */
+    if (map->old) {
+        err = map_migrate(map, UINT_MAX);
+        if (err < 0)
+            return err;
+    }
+    
+    old = malloc(sizeof(*old));
+    if (!old)
+        return -errno;
+    
+    *old = *map;
+    
+    map->capacity   = max(capacity, MAP_DEFAULT_SIZE);
+    map->size       = 0;
+    map->tombstones = 0;
+    
+    map->table = calloc(map->capacity, sizeof(*map->table));
+    if (!map->table) {
+        err = -errno;
+        goto fail;
+    }
+    
+    err = map_engine_init(map);
+    if (err < 0) {
+        free(map->table);
+        goto fail;
+    }
+    
+    map->old         = old;
+    map->migrate_pos = 0;
+    
+    return 0;
+
+fail:
+    *map = *old;
+    free(old);
+    
+    return err;
+}
+
 /*
  * Search for an map_entry with the given 'key'.
  * If the state field of the map_entry states
@@ -97,11 +320,16 @@ out:
  * map_insert() suffers from the same bug.
  */
 static struct entry *map_lookup(const struct map *__restrict map,
-                                const void *__restrict key)
+                                const void *__restrict key,
+                                unsigned int hash)
 {
-    unsigned int hash, index, offset;
+    unsigned int index, offset;
+    
+    if (map->engine == MAP_ENGINE_SWISS)
+        return map_swiss_lookup(map, key, hash);
     
-    hash = map->key_hash(key);
+    if (map->engine == MAP_ENGINE_ROBIN_HOOD)
+        return map_robin_lookup(map, key, hash);
 
     index = hash & (map->capacity - 1);
     offset = 1;
@@ -133,6 +361,103 @@ static struct entry *map_lookup(const struct map *__restrict map,
     return NULL;
 }
 
+/* entries not migrated yet are still in the old table */
+static struct entry *map_find(const struct map *__restrict map,
+                              const void *__restrict key,
+                              unsigned int hash)
+{
+    struct entry *entry;
+    
+    entry = map_lookup(map, key, hash);
+    if (!entry && map->old)
+        entry = map_lookup(map->old, key, hash);
+    
+    return entry;
+}
+
+/* 
+ * Visits the entries whose probe sequence starts at 'bucket', 
+ * returns the number of erased ones.
+ */
+static unsigned int map_scan_bucket(struct map *__restrict map,
+                                    unsigned int bucket,
+                                    bool (*fn)(const void *, void *, void *),
+                                    void *arg)
+{
+    struct entry *entry;
+    unsigned int index, offset, mask, erased;
+    
+    if (map->engine == MAP_ENGINE_SWISS)
+        return map_swiss_scan(map, bucket, fn, arg);
+    
+    if (map->engine == MAP_ENGINE_ROBIN_HOOD)
+        return map_robin_scan(map, bucket, fn, arg);
+    
+    mask   = map->capacity - 1;
+    index  = bucket;
+    offset = 1;
+    erased = 0;
+    
+    /* same sequence as map_lookup(), other keys cross it as well */
+    while (offset < map->capacity) {
+        entry = map->table + index;
+        
+        if (entry->state == MAP_DATA_STATE_EMPTY)
+            break;
+        
+        if (entry->state == MAP_DATA_STATE_AVAILABLE 
+            && (entry->hash & mask) == bucket
+            && map_scan_visit(map, entry, fn, arg)) {
+            map_erase(map, entry);
+            erased += 1;
+        }
+        
+        index  += offset;
+        offset += 2;
+        
+        index &= mask;
+    }
+    
+    return erased;
+}
+
+static inline unsigned long map_reverse_bits(unsigned long v)
+{
+    v = __builtin_bswap64(v);
+    v = ((v >> 4) & 0x0f0f0f0f0f0f0f0ful) | ((v & 0x0f0f0f0f0f0f0f0ful) << 4);
+    v = ((v >> 2) & 0x3333333333333333ul) | ((v & 0x3333333333333333ul) << 2);
+    v = ((v >> 1) & 0x5555555555555555ul) | ((v & 0x5555555555555555ul) << 1);
+    
+    return v;
+}
+
+/* 
+ * Increments the bits of 'cursor' covered by 'mask' starting at the 
+ * highest one. Doubling the capacity splits bucket b into b and 
+ * b + capacity, which comes right after b in this order, so buckets 
+ * visited before a resize don't have to be visited again.
+ */
+static inline unsigned long map_cursor_next(unsigned long cursor, 
+                                            unsigned long mask)
+{
+    cursor |= ~mask;
+    cursor  = map_reverse_bits(cursor);
+    cursor += 1;
+    
+    return map_reverse_bits(cursor);
+}
+
+static inline void map_prefetch(const struct map *__restrict map, 
+                                unsigned int hash)
+{
+    if (map->engine == MAP_ENGINE_SWISS)
+        map_swiss_prefetch(map, hash);
+    else if (map->engine == MAP_ENGINE_ROBIN_HOOD)
+        map_robin_prefetch(map, hash);
+    else
+        __builtin_prefetch(map->table + (hash & (map->capacity - 1)));
+}
+
 struct map *map_new(const struct map_config *__restrict conf)
 {
     struct map *map;
@@ -162,6 +487,7 @@ int map_init(struct map *__restrict map,
              const struct map_config *__restrict conf)
 {
     unsigned int size = get_nice_size(conf->size << 1, MAP_DEFAULT_SIZE);
+    int err;
     
     map->table = calloc(size, sizeof(*map->table));
     if (!map->table)
@@ -170,11 +496,24 @@ int map_init(struct map *__restrict map,
     map->size     = 0;
     map->capacity = size;
     
+    map->engine     = conf->engine;
+    map->tombstones = 0;
+    
+    err = map_engine_init(map);
+    if (err < 0) {
+        free(map->table);
+        return err;
+    }
+    
     map->lower_bound = conf->lower_bound;
     map->upper_bound = conf->upper_bound;
     
     map->static_size = conf->static_size;
     
+    map->incremental = conf->incremental_resize;
+    map->old         = NULL;
+    map->migrate_pos = 0;
+    
     map->key_compare = conf->key_compare;
     map->key_hash    = conf->key_hash;
     map->data_delete = conf->data_delete;
@@ -185,14 +524,27 @@ int map_init(struct map *__restrict map,
 void map_destroy(struct map *__restrict map)
 {
     map_clear(map);
-    free(map->table);
+    map_free_table(map);
 }
 
 void map_clear(struct map *__restrict map)
 {
     unsigned int i;
     
-    map->size = 0;
+    if (map->old) {
+        map_clear(map->old);
+        map_free_table(map->old);
+        free(map->old);
+        map->old = NULL;
+    }
+    
+    map->size       = 0;
+    map->tombstones = 0;
+    
+    if (map->engine == MAP_ENGINE_SWISS)
+        map_swiss_clear(map);
+    else if (map->engine == MAP_ENGINE_ROBIN_HOOD)
+        map_robin_clear(map);
     
     if (!map->data_delete) {
         memset(map->table, 0, sizeof(*map->table) * map->capacity);
@@ -200,92 +552,152 @@ void map_clear(struct map *__restrict map)
     }
     
     for (i = 0; i < map->capacity; ++i) {
-        if (map->table[i].state == MAP_DATA_STATE_AVAILABLE) {
+        if (map->table[i].state == MAP_DATA_STATE_AVAILABLE)
             map->data_delete(map->table[i].data);
-            
-            map->table[i].state = MAP_DATA_STATE_EMPTY;
-        }
+        
+        map->table[i].state = MAP_DATA_STATE_EMPTY;
     }
 }
 
 int map_rehash(struct map *__restrict map, unsigned int size)
 {
+    int err;
+    
+    if (map->old) {
+        err = map_migrate(map, UINT_MAX);
+        if (err < 0)
+            return err;
+    }
+    
     /* ensure that we don't have to rehash for 'size' additional insertions */
     size = get_nice_size((size + map->size) << 1, MAP_DEFAULT_SIZE);
     
     if (size == map->capacity)
         return 0;
     
-    return map_resize(map, size);
+    /* the caller asked for the work now, so don't spread it out */
+    return map_rebuild_grow(map, size);
 }
 
-/*
- * Note:
- * If there is a bug in this function it is very likely that
- * _map_lookup() suffers from the same bug.
- */
 int map_insert(struct map *__restrict map, const void *key, void *data)
 {
-    unsigned int hash, index, offset, capacity;
-    int err;
+    unsigned int capacity;
     
-    if (!map->static_size && map_should_grow(map)) {
+    if (map->old)
+        map_migrate(map, MAP_MIGRATE_STEP);
+    
+    if (map->engine == MAP_ENGINE_SWISS)
+        capacity = map_swiss_grow_capacity(map);
+    else if (!map->static_size && map_should_grow(map))
         capacity = map->capacity << 1;
-        do {
-            err = map_resize(map, capacity);
-            capacity <<= 1;
-        } while (err == -EBADSLT);
-    }
+    else if (map->engine == MAP_ENGINE_QUADRATIC && map_should_cleanup(map))
+        capacity = map->capacity;
+    else
+        capacity = 0;
     
-    hash = map->key_hash(key);
+    /* static maps never grow, but still get rid of their tombstones */
+    if (map->static_size && capacity != map->capacity)
+        capacity = 0;
     
-    index = hash & (map->capacity - 1);
-    offset = 1;
+    if (capacity)
+        map_resize(map, capacity);
     
-    while (offset < map->capacity) {
-        if (map->table[index].state != MAP_DATA_STATE_AVAILABLE) {
-            map->table[index].key   = key;
-            map->table[index].data  = data;
-            map->table[index].hash  = hash;
-            map->table[index].state = MAP_DATA_STATE_AVAILABLE;
+    return map_place(map, key, data, map->key_hash(key));
+}
+
+/*
+ * Hashes the keys of a batch first and prefetches their slots, the cache
+ * misses of the whole batch then overlap instead of following each other.
+ */
+int map_insert_batch(struct map *__restrict map, 
+                     const void **keys, 
+                     void **data, 
+                     unsigned int n)
+{
+    unsigned int hashes[MAP_BATCH_SIZE];
+    unsigned int i, j, batch;
+    bool grow;
+    int err;
+    
+    /* grow once up front, so no resize happens in the middle of a batch */
+    if (!map->static_size) {
+        if (map->engine == MAP_ENGINE_SWISS)
+            grow = map->size + map->tombstones + n >= 
+                   map->capacity - map->capacity / 8;
+        else
+            grow = 100ul * (map_size(map) + n) / map->capacity >= 
+                   map->upper_bound;
+        
+        if (grow) {
+            err = map_rehash(map, n);
+            if (err < 0)
+                return err;
+        }
+    }
+    
+    for (i = 0; i < n; i += batch) {
+        batch = min(n - i, MAP_BATCH_SIZE);
+        
+        if (map->old)
+            map_migrate(map, MAP_MIGRATE_STEP);
+        
+        for (j = 0; j < batch; ++j) {
+            hashes[j] = map->key_hash(keys[i + j]);
+            map_prefetch(map, hashes[j]);
+        }
+        
+        for (j = 0; j < batch; ++j) {
+            err = map_place(map, keys[i + j], data[i + j], hashes[j]);
             
-            map->size += 1;
+            /* quadratic probing missed a free slot, let map_insert() grow */
+            if (err == -EBADSLT && !map->static_size)
+                err = map_insert(map, keys[i + j], data[i + j]);
             
-            return 0;
+            if (err < 0)
+                return err;
         }
-
-        index  += offset;
-        offset += 2;
-        
-        index &= (map->capacity - 1);
     }
     
-    return -EBADSLT;
+    return 0;
 }
 
 void *map_retrieve(struct map *__restrict map, const void *key)
 {
     struct entry *entry;
     
-    entry = map_lookup(map, key);
+    if (map->old)
+        map_migrate(map, MAP_MIGRATE_STEP);
+    
+    entry = map_find(map, key, map->key_hash(key));
     
     return (entry) ? entry->data : NULL;
 }
 
 void *map_take(struct map *__restrict map, const void *key)
 {
+    struct map *owner;
     struct entry *entry;
+    unsigned int hash;
     void *data;
     
-    entry = map_lookup(map, key);
+    if (map->old)
+        map_migrate(map, MAP_MIGRATE_STEP);
+    
+    hash  = map->key_hash(key);
+    owner = map;
+    entry = map_lookup(map, key, hash);
+    
+    if (!entry && map->old) {
+        owner = map->old;
+        entry = map_lookup(owner, key, hash);
+    }
+    
     if(!entry)
         return NULL;
 
     data = entry->data;
 
-    entry->state = MAP_DATA_STATE_REMOVED;
-    
-    map->size -= 1;
+    map_erase(owner, entry);
     
     if(!map->static_size && map_should_shrink(map))
         map_resize(map, map->capacity >> 2);
@@ -293,19 +705,52 @@ void *map_take(struct map *__restrict map, const void *key)
     return data;
 }
 
+unsigned int map_retrieve_batch(struct map *__restrict map, 
+                                const void **keys, 
+                                void **data, 
+                                unsigned int n)
+{
+    unsigned int hashes[MAP_BATCH_SIZE];
+    unsigned int i, j, batch, found;
+    struct entry *entry;
+    
+    found = 0;
+    
+    for (i = 0; i < n; i += batch) {
+        batch = min(n - i, MAP_BATCH_SIZE);
+        
+        if (map->old)
+            map_migrate(map, MAP_MIGRATE_STEP);
+        
+        for (j = 0; j < batch; ++j) {
+            hashes[j] = map->key_hash(keys[i + j]);
+            map_prefetch(map, hashes[j]);
+        }
+        
+        for (j = 0; j < batch; ++j) {
+            entry = map_find(map, keys[i + j], hashes[j]);
+            
+            data[i + j] = (entry) ? entry->data : NULL;
+            found      += (entry != NULL);
+        }
+    }
+    
+    return found;
+}
+
 bool map_contains(const struct map *__restrict map, const void *key)
 {
-    return map_lookup(map, key) != NULL;
+    return map_find(map, key, map->key_hash(key)) != NULL;
 }
 
 unsigned int map_size(const struct map *__restrict map)
 {
-    return map->size;
+    return (map->old) ? map->size + map->old->size : map->size;
 }
 
 bool map_empty(const struct map *__restrict map)
 {
-    return map->size == 0;
+    return map_size(map) == 0;
 }
 
 void map_set_static_size(struct map *__restrict map, bool static_size)
@@ -318,6 +763,131 @@ bool map_static_size(const struct map *__restrict map)
     return map->static_size;
 }
 
+unsigned long map_scan(struct map *__restrict map, 
+                       unsigned long cursor,
+                       bool (*fn)(const void *key, void *data, void *arg),
+                       void *arg)
+{
+    struct map *small, *large;
+    unsigned long m0, m1;
+    unsigned int erased;
+    
+    if (!map->old) {
+        m0 = map->capacity - 1;
+        
+        erased = map_scan_bucket(map, cursor & m0, fn, arg);
+        cursor = map_cursor_next(cursor, m0);
+    } else {
+        small = map;
+        large = map->old;
+        
+        if (small->capacity > large->capacity) {
+            small = map->old;
+            large = map;
+        }
+        
+        m0 = small->capacity - 1;
+        m1 = large->capacity - 1;
+        
+        erased = map_scan_bucket(small, cursor & m0, fn, arg);
+        
+        /* all buckets of the larger table which 'cursor & m0' splits into */
+        do {
+            erased += map_scan_bucket(large, cursor & m1, fn, arg);
+            cursor  = map_cursor_next(cursor, m1);
+        } while (cursor & (m0 ^ m1));
+    }
+    
+    if (erased && !map->static_size && map_should_shrink(map))
+        map_resize(map, map->capacity >> 2);
+    
+    return cursor;
+}
+
+static unsigned int map_probe_length(const struct map *__restrict map,
+                                     unsigned int hash,
+                                     const struct entry *entry)
+{
+    unsigned int index, offset, n;
+    
+    if (map->engine == MAP_ENGINE_SWISS)
+        return map_swiss_probe_length(map, hash, entry);
+    
+    if (map->engine == MAP_ENGINE_ROBIN_HOOD)
+        return map_robin_probe_length(map, hash, entry);
+    
+    index  = hash & (map->capacity - 1);
+    offset = 1;
+    n      = 1;
+    
+    while (offset < map->capacity) {
+        if (entry && map->table + index == entry)
+            break;
+        
+        if (!entry && map->table[index].state == MAP_DATA_STATE_EMPTY)
+            break;
+        
+        index  += offset;
+        offset += 2;
+        n      += 1;
+        
+        index &= (map->capacity - 1);
+    }
+    
+    return n;
+}
+
+/* sums up the probes of the entries, returns the average of a miss */
+static double map_stats_table(const struct map *__restrict map,
+                              unsigned long *probes,
+                              unsigned int *probe_max)
+{
+    unsigned long misses;
+    unsigned int i, n;
+    
+    misses = 0;
+    
+    for (i = 0; i < map->capacity; ++i) {
+        /* a missing key is as likely to start probing at any slot */
+        misses += map_probe_length(map, i, NULL);
+        
+        if (map->table[i].state != MAP_DATA_STATE_AVAILABLE)
+            continue;
+        
+        n = map_probe_length(map, map->table[i].hash, map->table + i);
+        
+        *probes   += n;
+        *probe_max = max(*probe_max, n);
+    }
+    
+    return (double) misses / map->capacity;
+}
+
+void map_stats(const struct map *__restrict map, 
+               struct map_stats *__restrict stats)
+{
+    unsigned long probes;
+    
+    stats->size       = map_size(map);
+    stats->capacity   = map->capacity;
+    stats->tombstones = map->tombstones;
+    stats->probe_max  = 0;
+    
+    probes = 0;
+    
+    stats->probe_miss_avg = map_stats_table(map, &probes, &stats->probe_max);
+    
+    /* during an incremental resize a miss has to probe both tables */
+    if (map->old) {
+        stats->capacity       += map->old->capacity;
+        stats->tombstones     += map->old->tombstones;
+        stats->probe_miss_avg += map_stats_table(map->old, &probes,
+                                                 &stats->probe_max);
+    }
+    
+    stats->probe_avg = (stats->size) ? (double) probes / stats->size : 0.0;
+}
+
 const void *entry_key(struct entry *__restrict e)
 {
     return e->key;
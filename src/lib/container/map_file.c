@@ -0,0 +1,448 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "map_file.h"
+#include "hash.h"
+#include "macro.h"
+
+#define MAP_FILE_MAGIC "VCIMAP\0\0"
+#define MAP_FILE_VERSION 1
+/* independent of the process seed, readers take it from the header */
+#define MAP_FILE_SEED 0x9e3779b97f4a7c15ul
+#define MAP_FILE_SLOTS 64
+#define MAP_FILE_MIN_CAPACITY 16
+
+struct map_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t key_type;
+    uint64_t seed;
+    /* number of entries and slots, capacity is a power of two */
+    uint64_t size;
+    uint64_t capacity;
+    /* offset of the slot array and size of the whole file */
+    uint64_t slots;
+    uint64_t length;
+};
+
+struct map_file_slot {
+    uint64_t hash;
+    /* the key itself or the offset of a string */
+    uint64_t key;
+    /* offset of the data, 0 marks an empty slot */
+    uint64_t data;
+    uint32_t key_size;
+    uint32_t data_size;
+};
+
+static const char _zeros[8];
+
+static inline uint64_t _align(uint64_t off)
+{
+    return (off + 7) & ~(uint64_t) 7;
+}
+
+static inline uint64_t _hash(enum map_file_key key_type,
+                             uint64_t seed,
+                             const void *key,
+                             size_t *key_size)
+{
+    if (key_type == MAP_FILE_KEY_STRING) {
+        *key_size = strlen(key);
+        return hash_bytes_seed(key, *key_size, seed);
+    }
+    
+    *key_size = 0;
+    
+    return hash_mix((unsigned long) key ^ seed);
+}
+
+static int _write_padded(FILE *fp, const void *ptr, size_t size)
+{
+    size_t pad = _align(size) - size;
+    
+    if (size && fwrite(ptr, size, 1, fp) != 1)
+        return -EIO;
+    
+    if (pad && fwrite(_zeros, pad, 1, fp) != 1)
+        return -EIO;
+    
+    return 0;
+}
+
+static int _write_blobs(FILE *fp, 
+                        const struct map *__restrict map,
+                        enum map_file_key key_type,
+                        size_t (*data_size)(const void *))
+{
+    struct entry *e;
+    uint64_t val;
+    int err;
+    
+    map_for_each(map, e) {
+        if (key_type == MAP_FILE_KEY_STRING) {
+            err = _write_padded(fp, e->key, strlen(e->key) + 1);
+            if (err < 0)
+                return err;
+        }
+        
+        if (data_size) {
+            err = _write_padded(fp, e->data, data_size(e->data));
+        } else {
+            val = (uintptr_t) e->data;
+            err = _write_padded(fp, &val, sizeof(val));
+        }
+        
+        if (err < 0)
+            return err;
+    }
+    
+    return 0;
+}
+
+int map_file_write(const struct map *__restrict map,
+                   const char *__restrict path,
+                   enum map_file_key key_type,
+                   size_t (*data_size)(const void *))
+{
+    struct map_file_header header;
+    struct map_file_slot *slots, *s;
+    struct entry *e;
+    uint64_t capacity, off, mask, hash, i;
+    size_t key_size, size;
+    char *tmp;
+    FILE *fp;
+    int fd, err;
+    
+    if (key_type != MAP_FILE_KEY_INT && key_type != MAP_FILE_KEY_STRING)
+        return -EINVAL;
+    
+    /* at most half of the slots are used, which keeps probes short */
+    capacity = MAP_FILE_MIN_CAPACITY;
+    while (capacity < 2 * (uint64_t) map_size(map))
+        capacity <<= 1;
+    
+    slots = calloc(capacity, sizeof(*slots));
+    if (!slots)
+        return -ENOMEM;
+    
+    mask = capacity - 1;
+    off  = MAP_FILE_SLOTS + capacity * sizeof(*slots);
+    
+    /* assign the slots and the offsets of keys and data in walking order */
+    map_for_each(map, e) {
+        hash = _hash(key_type, MAP_FILE_SEED, e->key, &key_size);
+        size = (data_size) ? data_size(e->data) : sizeof(uint64_t);
+        
+        if (key_size > UINT32_MAX || size > UINT32_MAX) {
+            err = -EFBIG;
+            goto cleanup1;
+        }
+        
+        for (i = hash & mask; slots[i].data; i = (i + 1) & mask)
+            ;
+        
+        s = slots + i;
+        s->hash = hash;
+        
+        if (key_type == MAP_FILE_KEY_STRING) {
+            s->key      = off;
+            s->key_size = key_size;
+            off        += _align(key_size + 1);
+        } else {
+            s->key = (uintptr_t) e->key;
+        }
+        
+        s->data      = off;
+        s->data_size = size;
+        off         += _align(size);
+    }
+    
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAP_FILE_MAGIC, sizeof(header.magic));
+    header.version  = MAP_FILE_VERSION;
+    header.key_type = key_type;
+    header.seed     = MAP_FILE_SEED;
+    header.size     = map_size(map);
+    header.capacity = capacity;
+    header.slots    = MAP_FILE_SLOTS;
+    header.length   = off;
+    
+    /* readers keep the old file mapped until the new one is complete */
+    tmp = malloc(strlen(path) + sizeof(".XXXXXX"));
+    if (!tmp) {
+        err = -ENOMEM;
+        goto cleanup1;
+    }
+    
+    sprintf(tmp, "%s.XXXXXX", path);
+    
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        err = -errno;
+        goto cleanup2;
+    }
+    
+    if (fchmod(fd, 0644) < 0) {
+        err = -errno;
+        close(fd);
+        goto cleanup3;
+    }
+    
+    fp = fdopen(fd, "w");
+    if (!fp) {
+        err = -errno;
+        close(fd);
+        goto cleanup3;
+    }
+    
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(_zeros, MAP_FILE_SLOTS - sizeof(header), 1, fp) != 1 ||
+        fwrite(slots, sizeof(*slots), capacity, fp) != capacity) {
+        err = -EIO;
+        goto cleanup4;
+    }
+    
+    err = _write_blobs(fp, map, key_type, data_size);
+    if (err < 0)
+        goto cleanup4;
+    
+    if (fflush(fp) != 0 || fsync(fd) < 0) {
+        err = -errno;
+        goto cleanup4;
+    }
+    
+    if (fclose(fp) != 0) {
+        err = -errno;
+        goto cleanup3;
+    }
+    
+    if (rename(tmp, path) < 0) {
+        err = -errno;
+        goto cleanup3;
+    }
+    
+    free(tmp);
+    free(slots);
+    
+    return 0;
+    
+cleanup4:
+    fclose(fp);
+cleanup3:
+    unlink(tmp);
+cleanup2:
+    free(tmp);
+cleanup1:
+    free(slots);
+    
+    return err;
+}
+
+struct map_file *map_file_new(const char *__restrict path)
+{
+    struct map_file *file;
+    int err;
+    
+    file = malloc(sizeof(*file));
+    if (!file)
+        return NULL;
+    
+    err = map_file_init(file, path);
+    if (err < 0) {
+        free(file);
+        errno = -err;
+        return NULL;
+    }
+    
+    return file;
+}
+
+void map_file_delete(struct map_file *__restrict file)
+{
+    map_file_destroy(file);
+    free(file);
+}
+
+static bool _valid_header(const struct map_file_header *h, size_t len)
+{
+    if (memcmp(h->magic, MAP_FILE_MAGIC, sizeof(h->magic)) != 0)
+        return false;
+    
+    if (h->version != MAP_FILE_VERSION || h->length != len)
+        return false;
+    
+    if (h->key_type != MAP_FILE_KEY_INT && h->key_type != MAP_FILE_KEY_STRING)
+        return false;
+    
+    if (h->capacity == 0 || (h->capacity & (h->capacity - 1)) != 0)
+        return false;
+    
+    /* lookups rely on at least one empty slot */
+    if (h->size >= h->capacity)
+        return false;
+    
+    if (h->slots < sizeof(*h) || h->slots > len || (h->slots & 7) != 0)
+        return false;
+    
+    return h->capacity <= (len - h->slots) / sizeof(struct map_file_slot);
+}
+
+int map_file_init(struct map_file *__restrict file, 
+                  const char *__restrict path)
+{
+    struct stat st;
+    void *addr;
+    int fd, err;
+    
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    
+    if (fstat(fd, &st) < 0) {
+        err = -errno;
+        goto cleanup1;
+    }
+    
+    if ((size_t) st.st_size < sizeof(struct map_file_header)) {
+        err = -EINVAL;
+        goto cleanup1;
+    }
+    
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        err = -errno;
+        goto cleanup1;
+    }
+    
+    if (!_valid_header(addr, st.st_size)) {
+        err = -EINVAL;
+        goto cleanup2;
+    }
+    
+    close(fd);
+    
+    file->addr   = addr;
+    file->len    = st.st_size;
+    file->header = addr;
+    file->slots  = (const void *)((const char *) addr + file->header->slots);
+    
+    return 0;
+    
+cleanup2:
+    munmap(addr, st.st_size);
+cleanup1:
+    close(fd);
+    
+    return err;
+}
+
+void map_file_destroy(struct map_file *__restrict file)
+{
+    munmap((void *) file->addr, file->len);
+}
+
+/* offsets come from the file, so they are checked before each access */
+static inline bool _in_file(const struct map_file *__restrict file,
+                            uint64_t off,
+                            uint64_t size)
+{
+    return off <= file->len && size <= file->len - off;
+}
+
+static const struct map_file_slot *
+_lookup(const struct map_file *__restrict file, const void *key)
+{
+    const struct map_file_header *h = file->header;
+    const struct map_file_slot *s;
+    uint64_t hash, mask, i, n;
+    size_t key_size;
+    
+    hash = _hash(h->key_type, h->seed, key, &key_size);
+    mask = h->capacity - 1;
+    
+    for (i = hash & mask, n = 0; n < h->capacity; i = (i + 1) & mask, ++n) {
+        s = file->slots + i;
+        
+        if (s->data == 0)
+            return NULL;
+        
+        if (s->hash != hash)
+            continue;
+        
+        if (h->key_type == MAP_FILE_KEY_INT) {
+            if (s->key == (uintptr_t) key)
+                return s;
+        } else if (s->key_size == key_size && 
+                   _in_file(file, s->key, key_size + 1) &&
+                   memcmp((const char *) file->addr + s->key, 
+                          key, key_size) == 0) {
+            return s;
+        }
+    }
+    
+    return NULL;
+}
+
+const void *map_file_retrieve(const struct map_file *__restrict file,
+                              const void *key,
+                              size_t *size)
+{
+    const struct map_file_slot *s;
+    
+    s = _lookup(file, key);
+    if (!s || !_in_file(file, s->data, s->data_size))
+        return NULL;
+    
+    if (size)
+        *size = s->data_size;
+    
+    return (const char *) file->addr + s->data;
+}
+
+bool map_file_contains(const struct map_file *__restrict file, 
+                       const void *key)
+{
+    return _lookup(file, key) != NULL;
+}
+
+unsigned long map_file_size(const struct map_file *__restrict file)
+{
+    return file->header->size;
+}
+
+enum map_file_key map_file_key_type(const struct map_file *__restrict file)
+{
+    return file->header->key_type;
+}
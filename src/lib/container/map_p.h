@@ -0,0 +1,137 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _MAP_P_H_
+#define _MAP_P_H_
+
+#include "map.h"
+
+/* 
+ * murmur3 finalizer for the engines which take the home slot or a tag
+ * from the hash, protects them from weak user-supplied key_hash functions
+ * whose keys would otherwise all share a tag or a first group
+ */
+static inline unsigned int map_hash_mix(unsigned int h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    
+    return h;
+}
+
+/* 
+ * Calls the function of map_scan() for 'entry', returns true if the 
+ * entry has to be erased.
+ */
+static inline bool map_scan_visit(struct map *__restrict map,
+                                  struct entry *entry,
+                                  bool (*fn)(const void *, void *, void *),
+                                  void *arg)
+{
+    if (!fn(entry->key, entry->data, arg))
+        return false;
+    
+    if (map->data_delete)
+        map->data_delete(entry->data);
+    
+    return true;
+}
+
+/* 
+ * SwissTable engine, see map_swiss.c. The entries in 'table' are kept
+ * up to date, so map_for_each() and entry_key() work with every engine.
+ */
+int map_swiss_init(struct map *__restrict map);
+
+void map_swiss_clear(struct map *__restrict map);
+
+int map_swiss_resize(struct map *__restrict map, unsigned int capacity);
+
+/* capacity to resize to before the next insertion, 0 if there's room */
+unsigned int map_swiss_grow_capacity(const struct map *__restrict map);
+
+int map_swiss_place(struct map *__restrict map, 
+                    const void *key, 
+                    void *data, 
+                    unsigned int hash);
+
+struct entry *map_swiss_lookup(const struct map *__restrict map, 
+                               const void *key,
+                               unsigned int hash);
+
+/* 
+ * Groups probed until 'entry' is reached or, 
+ * if 'entry' is NULL, until 'hash' is known to be missing.
+ */
+unsigned int map_swiss_probe_length(const struct map *__restrict map,
+                                    unsigned int hash,
+                                    const struct entry *entry);
+
+/* pulls the control bytes and the first entry of 'hash' into the cache */
+void map_swiss_prefetch(const struct map *__restrict map, unsigned int hash);
+
+void map_swiss_erase(struct map *__restrict map, struct entry *entry);
+
+/* visits the entries whose probe sequence starts at group 'bucket' */
+unsigned int map_swiss_scan(struct map *__restrict map,
+                            unsigned int bucket,
+                            bool (*fn)(const void *, void *, void *),
+                            void *arg);
+
+/* Robin Hood engine, see map_robin.c */
+int map_robin_init(struct map *__restrict map);
+
+void map_robin_clear(struct map *__restrict map);
+
+int map_robin_resize(struct map *__restrict map, unsigned int capacity);
+
+int map_robin_place(struct map *__restrict map, 
+                    const void *key, 
+                    void *data, 
+                    unsigned int hash);
+
+struct entry *map_robin_lookup(const struct map *__restrict map, 
+                               const void *key,
+                               unsigned int hash);
+
+/* moves the following entries back, they may end up in 'entry' */
+void map_robin_erase(struct map *__restrict map, struct entry *entry);
+
+/* slots probed until 'entry' is reached or 'hash' is known to be missing */
+unsigned int map_robin_probe_length(const struct map *__restrict map,
+                                    unsigned int hash,
+                                    const struct entry *entry);
+
+void map_robin_prefetch(const struct map *__restrict map, unsigned int hash);
+
+/* visits the entries whose home slot is 'bucket' */
+unsigned int map_robin_scan(struct map *__restrict map,
+                            unsigned int bucket,
+                            bool (*fn)(const void *, void *, void *),
+                            void *arg);
+
+#endif /* _MAP_P_H_ */
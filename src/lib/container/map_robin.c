@@ -0,0 +1,280 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Robin Hood engine for struct map.
+ * 'dist' holds the probe distance of every slot plus one, 0 marks an
+ * empty slot. An insertion takes the slot of any entry that is closer
+ * to its home slot than the new one and moves that entry on instead,
+ * which keeps all probe distances close to the average. A lookup can
+ * stop as soon as it meets an entry closer to home than itself, the key
+ * would have taken that slot. Removed entries are filled up by shifting
+ * their successors back, so there are no tombstones.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#include "map.h"
+#include "map_p.h"
+#include "macro.h"
+
+static inline unsigned int _home(const struct map *__restrict map, 
+                                 unsigned int hash)
+{
+    return map_hash_mix(hash) & (map->capacity - 1);
+}
+
+static void _place(struct map *__restrict map, 
+                   const void *key, 
+                   void *data, 
+                   unsigned int hash)
+{
+    struct entry *entry;
+    const void *tmp_key;
+    void *tmp_data;
+    unsigned int i, mask, tmp_hash;
+    unsigned int d, tmp_d;
+    
+    mask = map->capacity - 1;
+    i    = _home(map, hash);
+    d    = 1;
+    
+    __builtin_prefetch(map->table + i, 1);
+    
+    while (map->dist[i] != 0) {
+        /* take from the rich: the resident is closer to its home slot */
+        if (map->dist[i] < d) {
+            entry = map->table + i;
+            
+            tmp_key     = entry->key;
+            tmp_data    = entry->data;
+            tmp_hash    = entry->hash;
+            entry->key  = key;
+            entry->data = data;
+            entry->hash = hash;
+            key         = tmp_key;
+            data        = tmp_data;
+            hash        = tmp_hash;
+            
+            tmp_d        = map->dist[i];
+            map->dist[i] = d;
+            d            = tmp_d;
+        }
+        
+        i  = (i + 1) & mask;
+        d += 1;
+    }
+    
+    entry = map->table + i;
+    
+    entry->key   = key;
+    entry->data  = data;
+    entry->hash  = hash;
+    entry->state = MAP_DATA_STATE_AVAILABLE;
+    
+    map->dist[i]  = d;
+    map->size    += 1;
+}
+
+int map_robin_init(struct map *__restrict map)
+{
+    map->dist = calloc(map->capacity, sizeof(*map->dist));
+    if (!map->dist)
+        return -errno;
+    
+    return 0;
+}
+
+void map_robin_clear(struct map *__restrict map)
+{
+    memset(map->dist, 0, map->capacity * sizeof(*map->dist));
+}
+
+int map_robin_resize(struct map *__restrict map, unsigned int capacity)
+{
+    struct entry *old_table;
+    unsigned int *old_dist;
+    unsigned int i, old_capacity;
+    
+    capacity = max(capacity, MAP_DEFAULT_SIZE);
+    
+    if (capacity <= map->size)
+        return -EINVAL;
+    
+    old_table    = map->table;
+    old_dist     = map->dist;
+    old_capacity = map->capacity;
+    
+    map->table = calloc(capacity, sizeof(*map->table));
+    map->dist  = calloc(capacity, sizeof(*map->dist));
+    if (!map->table || !map->dist) {
+        free(map->table);
+        free(map->dist);
+        
+        map->table = old_table;
+        map->dist  = old_dist;
+        
+        return -ENOMEM;
+    }
+    
+    map->capacity = capacity;
+    map->size     = 0;
+    
+    for (i = 0; i < old_capacity; ++i) {
+        if (old_dist[i] != 0)
+            _place(map, old_table[i].key, old_table[i].data, 
+                   old_table[i].hash);
+    }
+    
+    free(old_dist);
+    free(old_table);
+    
+    return 0;
+}
+
+int map_robin_place(struct map *__restrict map, 
+                    const void *key, 
+                    void *data, 
+                    unsigned int hash)
+{
+    if (map->size + 1 >= map->capacity)
+        return -EBADSLT;
+    
+    _place(map, key, data, hash);
+    
+    return 0;
+}
+
+struct entry *map_robin_lookup(const struct map *__restrict map, 
+                               const void *key,
+                               unsigned int hash)
+{
+    unsigned int i, mask;
+    unsigned int d;
+    
+    mask = map->capacity - 1;
+    i    = _home(map, hash);
+    d    = 1;
+    
+    /* overlap the cache misses on 'dist' and 'table' */
+    __builtin_prefetch(map->table + i);
+    
+    /* empty slots have distance 0 and end the search as well */
+    while (map->dist[i] >= d) {
+        if (map->dist[i] == d && map->table[i].hash == hash 
+            && map->key_compare(map->table[i].key, key) == 0)
+            return map->table + i;
+        
+        i  = (i + 1) & mask;
+        d += 1;
+    }
+    
+    return NULL;
+}
+
+void map_robin_erase(struct map *__restrict map, struct entry *entry)
+{
+    unsigned int i, next, mask;
+    
+    mask = map->capacity - 1;
+    i    = entry - map->table;
+    next = (i + 1) & mask;
+    
+    /* entries which aren't in their home slot move one slot closer */
+    while (map->dist[next] > 1) {
+        map->table[i] = map->table[next];
+        map->dist[i]  = map->dist[next] - 1;
+        
+        i    = next;
+        next = (next + 1) & mask;
+    }
+    
+    map->dist[i]        = 0;
+    map->table[i].state = MAP_DATA_STATE_EMPTY;
+    map->size          -= 1;
+}
+
+unsigned int map_robin_probe_length(const struct map *__restrict map,
+                                    unsigned int hash,
+                                    const struct entry *entry)
+{
+    unsigned int i, mask;
+    unsigned int d;
+    
+    if (entry)
+        return map->dist[entry - map->table];
+    
+    mask = map->capacity - 1;
+    i    = _home(map, hash);
+    d    = 1;
+    
+    while (map->dist[i] >= d) {
+        i  = (i + 1) & mask;
+        d += 1;
+    }
+    
+    return d;
+}
+
+void map_robin_prefetch(const struct map *__restrict map, unsigned int hash)
+{
+    unsigned int i;
+    
+    i = _home(map, hash);
+    
+    __builtin_prefetch(map->dist + i);
+    __builtin_prefetch(map->table + i);
+}
+
+unsigned int map_robin_scan(struct map *__restrict map,
+                            unsigned int bucket,
+                            bool (*fn)(const void *, void *, void *),
+                            void *arg)
+{
+    unsigned int i, mask, erased;
+    unsigned int d;
+    
+    mask   = map->capacity - 1;
+    i      = bucket;
+    d      = 1;
+    erased = 0;
+    
+    /* the entries of a home slot follow each other */
+    while (map->dist[i] >= d) {
+        if (map->dist[i] == d && map_scan_visit(map, map->table + i, fn, arg)) {
+            /* the next entry moves into slot 'i' and one step closer */
+            map_robin_erase(map, map->table + i);
+            erased += 1;
+            continue;
+        }
+        
+        i  = (i + 1) & mask;
+        d += 1;
+    }
+    
+    return erased;
+}
@@ -0,0 +1,410 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * SwissTable-style engine for struct map.
+ * Every slot of 'table' has a control byte in 'ctrl' which is either
+ * EMPTY, DELETED or the lowest 7 bits of the (mixed) hash of its key.
+ * Lookups compare 16 control bytes at once and only touch the entries
+ * whose tag matches, so a miss usually costs a single cache line.
+ * The first group of control bytes is mirrored behind the last one, so
+ * a group can be loaded at any slot without wrapping around.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "map.h"
+#include "map_p.h"
+#include "macro.h"
+
+#define GROUP_SIZE 16
+/* tables never shrink below MAP_DEFAULT_SIZE, a group never wraps onto itself */
+typedef char _group_fits_table[(MAP_DEFAULT_SIZE >= GROUP_SIZE) ? 1 : -1];
+
+#define CTRL_EMPTY      0x80
+#define CTRL_DELETED    0xfe
+
+static inline unsigned char _hash_tag(unsigned int h)
+{
+    return h & 0x7f;
+}
+
+static inline unsigned int _hash_pos(unsigned int h)
+{
+    return h >> 7;
+}
+
+/* bit i is set if control byte i of the group equals 'c' */
+static inline unsigned int _group_match(const unsigned char *ctrl, 
+                                        unsigned char c)
+{
+#ifdef __SSE2__
+    __m128i group, match;
+    
+    group = _mm_loadu_si128((const __m128i *) ctrl);
+    match = _mm_cmpeq_epi8(group, _mm_set1_epi8((char) c));
+    
+    return _mm_movemask_epi8(match);
+#else
+    unsigned int i, mask;
+    
+    mask = 0;
+    
+    for (i = 0; i < GROUP_SIZE; ++i)
+        mask |= (unsigned int) (ctrl[i] == c) << i;
+    
+    return mask;
+#endif
+}
+
+/* EMPTY and DELETED are the only control bytes with the high bit set */
+static inline unsigned int _group_match_free(const unsigned char *ctrl)
+{
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) ctrl));
+#else
+    unsigned int i, mask;
+    
+    mask = 0;
+    
+    for (i = 0; i < GROUP_SIZE; ++i)
+        mask |= (unsigned int) (ctrl[i] >> 7) << i;
+    
+    return mask;
+#endif
+}
+
+static inline void _set_ctrl(struct map *__restrict map, 
+                             unsigned int i, 
+                             unsigned char c)
+{
+    map->ctrl[i] = c;
+    
+    if (i < GROUP_SIZE)
+        map->ctrl[map->capacity + i] = c;
+}
+
+static unsigned char *_ctrl_new(unsigned int capacity)
+{
+    unsigned char *ctrl;
+    
+    ctrl = malloc(capacity + GROUP_SIZE);
+    if (!ctrl)
+        return NULL;
+    
+    return memset(ctrl, CTRL_EMPTY, capacity + GROUP_SIZE);
+}
+
+/* first EMPTY or DELETED slot on the probe sequence of 'hash' */
+static unsigned int _find_free(const struct map *__restrict map, 
+                               unsigned int hash)
+{
+    unsigned int pos, step, mask, slots;
+    
+    mask = map->capacity - 1;
+    pos  = _hash_pos(map_hash_mix(hash)) & mask;
+    step = 0;
+    
+    while (1) {
+        slots = _group_match_free(map->ctrl + pos);
+        if (slots)
+            return (pos + __builtin_ctz(slots)) & mask;
+        
+        /* triangular numbers of groups visit every group eventually */
+        step += GROUP_SIZE;
+        pos   = (pos + step) & mask;
+    }
+}
+
+static void _place(struct map *__restrict map, 
+                   const void *key, 
+                   void *data, 
+                   unsigned int hash)
+{
+    struct entry *entry;
+    unsigned int i;
+    
+    i = _find_free(map, hash);
+    
+    if (map->ctrl[i] == CTRL_DELETED)
+        map->tombstones -= 1;
+    
+    _set_ctrl(map, i, _hash_tag(map_hash_mix(hash)));
+    
+    entry = map->table + i;
+    
+    entry->key   = key;
+    entry->data  = data;
+    entry->hash  = hash;
+    entry->state = MAP_DATA_STATE_AVAILABLE;
+    
+    map->size += 1;
+}
+
+int map_swiss_init(struct map *__restrict map)
+{
+    map->ctrl = _ctrl_new(map->capacity);
+    if (!map->ctrl)
+        return -errno;
+    
+    map->tombstones = 0;
+    
+    return 0;
+}
+
+void map_swiss_clear(struct map *__restrict map)
+{
+    memset(map->ctrl, CTRL_EMPTY, map->capacity + GROUP_SIZE);
+    
+    map->tombstones = 0;
+}
+
+int map_swiss_resize(struct map *__restrict map, unsigned int capacity)
+{
+    struct entry *old_table;
+    unsigned char *old_ctrl;
+    unsigned int i, old_capacity;
+    
+    capacity = max(capacity, MAP_DEFAULT_SIZE);
+    
+    /* all entries have to fit and leave at least one slot EMPTY */
+    if (capacity <= map->size)
+        return -EINVAL;
+    
+    old_table    = map->table;
+    old_ctrl     = map->ctrl;
+    old_capacity = map->capacity;
+    
+    map->table = calloc(capacity, sizeof(*map->table));
+    if (!map->table)
+        goto fail;
+    
+    map->ctrl = _ctrl_new(capacity);
+    if (!map->ctrl) {
+        free(map->table);
+        goto fail;
+    }
+    
+    map->capacity   = capacity;
+    map->size       = 0;
+    map->tombstones = 0;
+    
+    /* the stored hashes spare us from calling 'key_hash' again */
+    for (i = 0; i < old_capacity; ++i) {
+        if (old_ctrl[i] & 0x80)
+            continue;
+        
+        _place(map, old_table[i].key, old_table[i].data, old_table[i].hash);
+    }
+    
+    free(old_ctrl);
+    free(old_table);
+    
+    return 0;
+    
+fail:
+    map->table = old_table;
+    map->ctrl  = old_ctrl;
+    
+    return -ENOMEM;
+}
+
+unsigned int map_swiss_grow_capacity(const struct map *__restrict map)
+{
+    /* keep the table at most 7/8 full, probe sequences end at EMPTY slots */
+    if (map->size + map->tombstones < map->capacity - map->capacity / 8)
+        return 0;
+    
+    /* mostly tombstones: rehash in place instead of growing */
+    return (map->size >= map->capacity / 2) ? map->capacity << 1 
+                                            : map->capacity;
+}
+
+int map_swiss_place(struct map *__restrict map, 
+                    const void *key, 
+                    void *data, 
+                    unsigned int hash)
+{
+    if (map->size + 1 >= map->capacity)
+        return -EBADSLT;
+    
+    _place(map, key, data, hash);
+    
+    return 0;
+}
+
+unsigned int map_swiss_probe_length(const struct map *__restrict map,
+                                    unsigned int hash,
+                                    const struct entry *entry)
+{
+    unsigned int pos, step, mask, n;
+    
+    mask = map->capacity - 1;
+    pos  = _hash_pos(map_hash_mix(hash)) & mask;
+    step = 0;
+    n    = 1;
+    
+    while (step <= map->capacity) {
+        /* the group starting at 'pos' may wrap around the end */
+        if (entry && (((unsigned int) (entry - map->table) - pos) & mask) < 
+                     GROUP_SIZE)
+            break;
+        
+        if (!entry && _group_match(map->ctrl + pos, CTRL_EMPTY))
+            break;
+        
+        step += GROUP_SIZE;
+        pos   = (pos + step) & mask;
+        n    += 1;
+    }
+    
+    return n;
+}
+
+void map_swiss_prefetch(const struct map *__restrict map, unsigned int hash)
+{
+    unsigned int pos;
+    
+    pos = _hash_pos(map_hash_mix(hash)) & (map->capacity - 1);
+    
+    __builtin_prefetch(map->ctrl + pos);
+    __builtin_prefetch(map->table + pos);
+}
+
+struct entry *map_swiss_lookup(const struct map *__restrict map, 
+                               const void *key,
+                               unsigned int hash)
+{
+    struct entry *entry;
+    unsigned int mixed, pos, step, mask, match;
+    unsigned char tag;
+    
+    mixed = map_hash_mix(hash);
+    tag   = _hash_tag(mixed);
+    mask  = map->capacity - 1;
+    pos   = _hash_pos(mixed) & mask;
+    step  = 0;
+    
+    /* most hits are in the first group, overlap both cache misses */
+    __builtin_prefetch(map->table + pos);
+    
+    while (1) {
+        match = _group_match(map->ctrl + pos, tag);
+        
+        while (match) {
+            entry = map->table + ((pos + __builtin_ctz(match)) & mask);
+            
+            /* the full hash filters out most of the false positive tags */
+            if (entry->hash == hash && map->key_compare(entry->key, key) == 0)
+                return entry;
+            
+            match &= match - 1;
+        }
+        
+        if (_group_match(map->ctrl + pos, CTRL_EMPTY))
+            return NULL;
+        
+        step += GROUP_SIZE;
+        if (step > map->capacity)
+            return NULL;
+        
+        pos = (pos + step) & mask;
+    }
+}
+
+void map_swiss_erase(struct map *__restrict map, struct entry *entry)
+{
+    unsigned int i, before, empty_before, empty_after;
+    
+    i      = entry - map->table;
+    before = (i - GROUP_SIZE) & (map->capacity - 1);
+    
+    /* 
+     * If no group which covers slot 'i' was ever full, no probe sequence
+     * went past it and the slot can become EMPTY instead of DELETED.
+     */
+    empty_before = _group_match(map->ctrl + before, CTRL_EMPTY);
+    empty_after  = _group_match(map->ctrl + i, CTRL_EMPTY);
+    
+    if (empty_before && empty_after 
+        && __builtin_clz(empty_before << 16) 
+           + __builtin_ctz(empty_after) < GROUP_SIZE) {
+        _set_ctrl(map, i, CTRL_EMPTY);
+        entry->state = MAP_DATA_STATE_EMPTY;
+    } else {
+        _set_ctrl(map, i, CTRL_DELETED);
+        entry->state = MAP_DATA_STATE_REMOVED;
+        map->tombstones += 1;
+    }
+    
+    map->size -= 1;
+}
+
+unsigned int map_swiss_scan(struct map *__restrict map,
+                            unsigned int bucket,
+                            bool (*fn)(const void *, void *, void *),
+                            void *arg)
+{
+    struct entry *entry;
+    unsigned int pos, step, mask, full, last, erased;
+    
+    mask   = map->capacity - 1;
+    pos    = bucket;
+    step   = 0;
+    erased = 0;
+    
+    while (1) {
+        /* decided up front, erasing may turn a slot of the group EMPTY */
+        last = _group_match(map->ctrl + pos, CTRL_EMPTY);
+        full = ~_group_match_free(map->ctrl + pos) & ((1u << GROUP_SIZE) - 1);
+        
+        while (full) {
+            entry = map->table + ((pos + __builtin_ctz(full)) & mask);
+            
+            if ((_hash_pos(map_hash_mix(entry->hash)) & mask) == bucket 
+                && map_scan_visit(map, entry, fn, arg)) {
+                map_swiss_erase(map, entry);
+                erased += 1;
+            }
+            
+            full &= full - 1;
+        }
+        
+        if (last)
+            return erased;
+        
+        step += GROUP_SIZE;
+        if (step > map->capacity)
+            return erased;
+        
+        pos = (pos + step) & mask;
+    }
+}
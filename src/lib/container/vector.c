@@ -30,18 +30,33 @@
 #include <errno.h>
 
 #include "container_p.h"
+#include "macro.h"
 #include "vector.h"
+#include "sort_define.h"
+#include "threadpool.h"
 
 #define VECTOR_DEFAULT_CAPACITY 8
+#define VECTOR_MAX_CAPACITY (1UL << 31)
+/* smaller vectors are sorted by the calling thread alone */
+#define VECTOR_PARALLEL_MIN_SIZE 16384
+/* merge parts per thread, more parts balance uneven splitters better */
+#define VECTOR_PARALLEL_PARTS 4
+/* samples per part taken from every run to pick the splitters */
+#define VECTOR_PARALLEL_OVERSAMPLING 16
 
-static int qsort_compare(const void *a, const void *b, void *arg)
-{
-    struct vector *vec;
-    
-    vec = arg;
-    
-    return vec->data_compare(*(const void **)a, *(const void **)b);
-}
+#define vector_compare(vec, a, b)                                              \
+    (vec)->data_compare((a), (b))
+
+#define vector_long_key(data)                                                  \
+    SORT_KEY_SIGNED(data)
+
+#define vector_string_key(data)                                                \
+    ((const char *) (data))
+
+/* a single indirect call per comparison, qsort_r() needed two */
+SORT_DEFINE_CTX(vector_data, void *, const struct vector *, vector_compare)
+SORT_DEFINE_RADIX(vector_long, void *, vector_long_key)
+SORT_DEFINE_STRING(vector_string, void *, vector_string_key)
 
 struct vector *vector_new(unsigned int capacity)
 {
@@ -170,6 +185,25 @@ bool vector_contains(const struct vector *__restrict vec,
     return vector_index_of(vec, data) != (unsigned int) -1;
 }
 
+/*
+ * Grows 'vec' once so that it can hold 'size' elements. Capacities are
+ * powers of two, so the largest one an unsigned int holds is the limit.
+ */
+static int reserve(struct vector *__restrict vec, unsigned long size)
+{
+    unsigned long capacity;
+    
+    if (size > VECTOR_MAX_CAPACITY)
+        return -EOVERFLOW;
+    
+    if (size <= vec->capacity)
+        return 0;
+    
+    capacity = min(max(size, 2UL * vec->capacity), VECTOR_MAX_CAPACITY);
+    
+    return vector_set_capacity(vec, (unsigned int) capacity);
+}
+
 int vector_insert_front(struct vector *__restrict vec, void *data)
 {
     return vector_insert_at(vec, 0, data);
@@ -201,6 +235,33 @@ int vector_insert_back(struct vector *__restrict vec, void *data)
     return vector_insert_at(vec, vec->size, data);
 }
 
+int vector_insert_range(struct vector *__restrict vec,
+                        unsigned int i,
+                        void *const *data,
+                        unsigned int n)
+{
+    int err;
+    
+    err = reserve(vec, (unsigned long) vec->size + n);
+    if (err < 0)
+        return err;
+    
+    memmove(vec->data + i + n, vec->data + i,
+            (vec->size - i) * sizeof(*vec->data));
+    memcpy(vec->data + i, data, n * sizeof(*vec->data));
+    
+    vec->size += n;
+    
+    return 0;
+}
+
+int vector_append_array(struct vector *__restrict vec,
+                        void *const *data,
+                        unsigned int n)
+{
+    return vector_insert_range(vec, vec->size, data, n);
+}
+
 void *vector_take_front(struct vector *__restrict vec)
 {
     return vector_take_at(vec, 0);
@@ -280,7 +341,366 @@ void **vector_back(struct vector *__restrict vec)
 
 void vector_sort(struct vector *__restrict vec)
 {
-    qsort_r(vec->data, vec->size, sizeof(*vec->data), &qsort_compare, vec);
+    vector_data_sort(vec->data, vec->size, vec);
+}
+
+int vector_sort_stable(struct vector *__restrict vec)
+{
+    return vector_data_sort_stable(vec->data, vec->size, vec);
+}
+
+int vector_sort_long(struct vector *__restrict vec)
+{
+    return vector_long_sort_radix(vec->data, vec->size);
+}
+
+int vector_sort_string(struct vector *__restrict vec)
+{
+    return vector_string_sort_string(vec->data, vec->size);
+}
+
+struct merge_run {
+    void **data;
+    unsigned long size;
+};
+
+/*
+ * A merge of 'n_runs' sorted runs into 'out', split into 'parts' parts.
+ * Part p takes [bounds[p * n_runs + i], bounds[(p + 1) * n_runs + i])
+ * of every run i.
+ */
+struct merge_job {
+    const struct vector *vec;
+    
+    struct merge_run *runs;
+    unsigned int n_runs;
+    
+    unsigned long *bounds;
+    unsigned int parts;
+    
+    /* scratch runs for the merge of every part */
+    struct merge_run *slices;
+    
+    void **out;
+};
+
+/* first index of 'run' whose element is not less (or greater) than 'data' */
+static unsigned long run_bound(const struct vector *__restrict vec,
+                               const struct merge_run *run,
+                               const void *data,
+                               bool upper)
+{
+    unsigned long l, r, m;
+    int res;
+    
+    l = 0;
+    r = run->size;
+    
+    while (l < r) {
+        m   = l + (r - l) / 2;
+        res = vec->data_compare(run->data[m], data);
+        
+        if (res < 0 || (upper && res == 0))
+            l = m + 1;
+        else
+            r = m;
+    }
+    
+    return l;
+}
+
+static void heap_sift(const struct vector *__restrict vec,
+                      struct merge_run *heap,
+                      unsigned int i,
+                      unsigned int n)
+{
+    struct merge_run tmp;
+    unsigned int child;
+    
+    tmp = heap[i];
+    
+    while ((child = 2 * i + 1) < n) {
+        if (child + 1 < n
+            && vec->data_compare(heap[child + 1].data[0],
+                                 heap[child].data[0]) < 0)
+            child += 1;
+        
+        if (vec->data_compare(heap[child].data[0], tmp.data[0]) >= 0)
+            break;
+        
+        heap[i] = heap[child];
+        i       = child;
+    }
+    
+    heap[i] = tmp;
+}
+
+/* k-way merge with a heap of the runs' first elements, consumes 'runs' */
+static void merge_runs(const struct vector *__restrict vec,
+                       struct merge_run *runs,
+                       unsigned int n,
+                       void **out)
+{
+    unsigned int i, k;
+    
+    for (i = 0, k = 0; i < n; ++i) {
+        if (runs[i].size)
+            runs[k++] = runs[i];
+    }
+    
+    for (i = k / 2; i-- > 0;)
+        heap_sift(vec, runs, i, k);
+    
+    while (k > 1) {
+        *out++ = runs[0].data[0];
+        
+        runs[0].data += 1;
+        runs[0].size -= 1;
+        
+        if (runs[0].size == 0)
+            runs[0] = runs[--k];
+        
+        heap_sift(vec, runs, 0, k);
+    }
+    
+    if (k == 1)
+        memcpy(out, runs[0].data, runs[0].size * sizeof(*out));
+}
+
+static void merge_part(long begin, long end, void *arg)
+{
+    struct merge_job *job = arg;
+    struct merge_run *slices;
+    unsigned long *lo, *hi, pos;
+    unsigned int i;
+    
+    for (long p = begin; p < end; ++p) {
+        slices = job->slices + p * job->n_runs;
+        lo     = job->bounds + p * job->n_runs;
+        hi     = lo + job->n_runs;
+        pos    = 0;
+        
+        for (i = 0; i < job->n_runs; ++i) {
+            slices[i].data = job->runs[i].data + lo[i];
+            slices[i].size = hi[i] - lo[i];
+            pos           += lo[i];
+        }
+        
+        merge_runs(job->vec, slices, job->n_runs, job->out + pos);
+    }
+}
+
+/*
+ * Picks splitters from a sample of every run and cuts all runs at them,
+ * so that part p ends close to rank p * total / parts. Elements equal to
+ * a splitter are spread over the runs to reach that rank, which keeps
+ * the parts balanced even if most elements are equal.
+ */
+static int merge_split(struct merge_job *__restrict job, unsigned long total)
+{
+    struct merge_run *runs = job->runs;
+    unsigned long *bounds, *lo, n_samples, need, take, rank, sum_lo, sum_hi;
+    unsigned int i, p, n_runs, per_run;
+    void **samples;
+    
+    n_runs  = job->n_runs;
+    per_run = job->parts * VECTOR_PARALLEL_OVERSAMPLING;
+    
+    bounds  = calloc((job->parts + 1) * n_runs, sizeof(*bounds));
+    samples = malloc(n_runs * per_run * sizeof(*samples));
+    if (!bounds || !samples) {
+        free(bounds);
+        free(samples);
+        return -ENOMEM;
+    }
+    
+    n_samples = 0;
+    
+    for (i = 0; i < n_runs; ++i) {
+        for (p = 0; p < per_run && runs[i].size; ++p)
+            samples[n_samples++] = runs[i].data[(runs[i].size * p) / per_run];
+    }
+    
+    vector_data_sort(samples, n_samples, job->vec);
+    
+    for (p = 1; p < job->parts; ++p) {
+        const void *splitter = samples[(n_samples * p) / job->parts];
+        
+        lo     = bounds + p * n_runs;
+        rank   = (total * p) / job->parts;
+        sum_lo = 0;
+        sum_hi = 0;
+        
+        for (i = 0; i < n_runs; ++i) {
+            lo[i]   = run_bound(job->vec, runs + i, splitter, false);
+            sum_lo += lo[i];
+        }
+        
+        need = (rank > sum_lo) ? rank - sum_lo : 0;
+        
+        for (i = 0; i < n_runs && need; ++i) {
+            sum_hi  = run_bound(job->vec, runs + i, splitter, true);
+            take    = min(sum_hi - lo[i], need);
+            lo[i]  += take;
+            need   -= take;
+        }
+        
+        /* never behind the previous part, the splitters are sorted */
+        for (i = 0; i < n_runs; ++i)
+            lo[i] = max(lo[i], (lo - n_runs)[i]);
+    }
+    
+    lo = bounds + job->parts * n_runs;
+    
+    for (i = 0; i < n_runs; ++i)
+        lo[i] = runs[i].size;
+    
+    free(samples);
+    
+    job->bounds = bounds;
+    
+    return 0;
+}
+
+static int merge_parallel(struct merge_job *__restrict job,
+                          unsigned long total,
+                          struct threadpool *pool)
+{
+    int err;
+    
+    job->parts = 1;
+    
+    if (pool && total >= VECTOR_PARALLEL_MIN_SIZE)
+        job->parts = (threadpool_thread_count(pool) + 1) *
+                     VECTOR_PARALLEL_PARTS;
+    
+    job->slices = malloc(job->parts * job->n_runs * sizeof(*job->slices));
+    if (!job->slices)
+        return -ENOMEM;
+    
+    err = merge_split(job, total);
+    if (err < 0)
+        goto cleanup;
+    
+    if (job->parts == 1)
+        merge_part(0, 1, job);
+    else
+        threadpool_parallel_for(pool, 0, job->parts, 1, &merge_part, job);
+    
+    free(job->bounds);
+    
+cleanup:
+    free(job->slices);
+    
+    return err;
+}
+
+static void sort_runs(long begin, long end, void *arg)
+{
+    struct merge_job *job = arg;
+    
+    for (long i = begin; i < end; ++i)
+        vector_data_sort(job->runs[i].data, job->runs[i].size, job->vec);
+}
+
+int vector_sort_parallel(struct vector *__restrict vec,
+                         struct threadpool *pool)
+{
+    struct merge_job job;
+    struct merge_run *runs;
+    unsigned int i, n_runs;
+    unsigned long chunk;
+    void **buf;
+    int err;
+    
+    n_runs = (pool) ? threadpool_thread_count(pool) + 1 : 1;
+    
+    if (vec->size < VECTOR_PARALLEL_MIN_SIZE || n_runs == 1) {
+        vector_sort(vec);
+        return 0;
+    }
+    
+    runs = malloc(n_runs * sizeof(*runs));
+    buf  = malloc(vec->capacity * sizeof(*buf));
+    if (!runs || !buf) {
+        err = -ENOMEM;
+        goto cleanup;
+    }
+    
+    chunk = vec->size / n_runs;
+    
+    for (i = 0; i < n_runs; ++i) {
+        runs[i].data = vec->data + i * chunk;
+        runs[i].size = (i + 1 < n_runs) ? chunk : vec->size - i * chunk;
+    }
+    
+    job.vec    = vec;
+    job.runs   = runs;
+    job.n_runs = n_runs;
+    job.out    = buf;
+    
+    threadpool_parallel_for(pool, 0, n_runs, 1, &sort_runs, &job);
+    
+    err = merge_parallel(&job, vec->size, pool);
+    if (err < 0)
+        goto cleanup;
+    
+    /* the merged elements are in 'buf', which takes the place of 'data' */
+    free(vec->data);
+    vec->data = buf;
+    buf       = NULL;
+    
+cleanup:
+    free(buf);
+    free(runs);
+    
+    return err;
+}
+
+int vector_merge(struct vector *__restrict dst,
+                 struct vector **src,
+                 unsigned int n,
+                 struct threadpool *pool)
+{
+    struct merge_job job;
+    struct merge_run *runs;
+    unsigned long total;
+    unsigned int i;
+    int err;
+    
+    total = 0;
+    
+    for (i = 0; i < n; ++i)
+        total += src[i]->size;
+    
+    if (total == 0)
+        return 0;
+    
+    err = reserve(dst, dst->size + total);
+    if (err < 0)
+        return err;
+    
+    runs = malloc(n * sizeof(*runs));
+    if (!runs)
+        return -ENOMEM;
+    
+    for (i = 0; i < n; ++i) {
+        runs[i].data = src[i]->data;
+        runs[i].size = src[i]->size;
+    }
+    
+    job.vec    = dst;
+    job.runs   = runs;
+    job.n_runs = n;
+    job.out    = dst->data + dst->size;
+    
+    err = merge_parallel(&job, total, pool);
+    if (err == 0)
+        dst->size += total;
+    
+    free(runs);
+    
+    return err;
 }
 
 int vector_insert_sorted(struct vector *__restrict vec, void *data)
@@ -309,6 +729,50 @@ int vector_insert_sorted(struct vector *__restrict vec, void *data)
     return vector_insert_at(vec, l, data);
 }
 
+int vector_insert_sorted_batch(struct vector *__restrict vec,
+                               void *const *data,
+                               unsigned int n)
+{
+    void **batch, **dst, **old;
+    unsigned int i, j;
+    int err;
+    
+    err = reserve(vec, (unsigned long) vec->size + n);
+    if (err < 0)
+        return err;
+    
+    batch = malloc(n * sizeof(*batch));
+    if (!batch)
+        return (n) ? -ENOMEM : 0;
+    
+    memcpy(batch, data, n * sizeof(*batch));
+    vector_data_sort(batch, n, vec);
+    
+    /*
+     * Merge from the back into the grown vector, so every element moves
+     * at most once. Elements behind the first insertion point stay where
+     * they are once the batch is exhausted. Equal elements of the batch
+     * go behind the ones already in 'vec'.
+     */
+    old = vec->data;
+    dst = vec->data + vec->size + n;
+    i   = vec->size;
+    j   = n;
+    
+    while (j > 0) {
+        if (i > 0 && vec->data_compare(old[i - 1], batch[j - 1]) > 0)
+            *--dst = old[--i];
+        else
+            *--dst = batch[--j];
+    }
+    
+    vec->size += n;
+    
+    free(batch);
+    
+    return 0;
+}
+
 void *vector_take_sorted(struct vector *__restrict vec, void *data)
 {
     unsigned int index;
@@ -332,7 +796,7 @@ unsigned int vector_index_of_sorted(const struct vector *__restrict vec,
     l = 0;
     r = vec->size - 1;
     
-    while(l <= r) {
+    while(l <= r && r != UINT_MAX) {
         m = (l + r) >> 1;
         
         res = vec->data_compare(data, vec->data[m]);
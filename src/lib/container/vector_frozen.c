@@ -0,0 +1,373 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#include "vector_frozen.h"
+#include "macro.h"
+
+/* keys per S-tree node, a node fills one cache line */
+#define NODE_KEYS 8
+#define NODE_SIZE (NODE_KEYS * sizeof(long))
+
+/* 8 pointers are one cache line, the nodes 3 levels below 'k' */
+#define PREFETCH_DISTANCE 8
+
+static void _eytzinger_build(struct vector_frozen *__restrict fz,
+                             void *const *sorted,
+                             unsigned int *i,
+                             unsigned long k)
+{
+    if (k > fz->size)
+        return;
+    
+    _eytzinger_build(fz, sorted, i, 2 * k);
+    
+    fz->data[k]  = sorted[*i];
+    fz->index[k] = *i;
+    *i += 1;
+    
+    _eytzinger_build(fz, sorted, i, 2 * k + 1);
+}
+
+/*
+ * Walks down to a leaf, going right whenever the node is less than
+ * 'data'. The lower bound is the last node where the walk went left,
+ * which is found by stripping the trailing right turns (ones) and the
+ * final left turn from 'k'. Returns 0 if there is none.
+ */
+static unsigned long
+_eytzinger_search(const struct vector_frozen *__restrict fz, const void *data)
+{
+    unsigned long k;
+    
+    k = 1;
+    
+    while (k <= fz->size) {
+        __builtin_prefetch(fz->data + k * PREFETCH_DISTANCE);
+        
+        k = 2 * k + (fz->data_compare(fz->data[k], data) < 0);
+    }
+    
+    return k >> __builtin_ffsl((long) ~k);
+}
+
+struct vector_frozen *vector_frozen_new(const struct vector *__restrict vec)
+{
+    struct vector_frozen *fz;
+    int err;
+    
+    fz = malloc(sizeof(*fz));
+    if (!fz)
+        return NULL;
+    
+    err = vector_frozen_init(fz, vec);
+    if (err < 0) {
+        free(fz);
+        errno = -err;
+        return NULL;
+    }
+    
+    return fz;
+}
+
+void vector_frozen_delete(struct vector_frozen *__restrict fz)
+{
+    vector_frozen_destroy(fz);
+    free(fz);
+}
+
+int vector_frozen_init(struct vector_frozen *__restrict fz,
+                       const struct vector *__restrict vec)
+{
+    unsigned int i;
+    
+    fz->size         = vec->size;
+    fz->data_compare = vec->data_compare;
+    
+    fz->data  = malloc((fz->size + 1) * sizeof(*fz->data));
+    fz->index = malloc((fz->size + 1) * sizeof(*fz->index));
+    if (!fz->data || !fz->index) {
+        free(fz->data);
+        free(fz->index);
+        return -ENOMEM;
+    }
+    
+    /* the root's sentinel, lower bound 0 means "none" */
+    fz->data[0]  = NULL;
+    fz->index[0] = fz->size;
+    
+    i = 0;
+    _eytzinger_build(fz, vec->data, &i, 1);
+    
+    return 0;
+}
+
+void vector_frozen_destroy(struct vector_frozen *__restrict fz)
+{
+    free(fz->data);
+    free(fz->index);
+}
+
+unsigned int
+vector_frozen_lower_bound(const struct vector_frozen *__restrict fz,
+                          const void *data)
+{
+    return fz->index[_eytzinger_search(fz, data)];
+}
+
+unsigned int vector_frozen_index_of(const struct vector_frozen *__restrict fz,
+                                    const void *data)
+{
+    unsigned long k;
+    
+    k = _eytzinger_search(fz, data);
+    if (k == 0 || fz->data_compare(fz->data[k], data) != 0)
+        return (unsigned int) -1;
+    
+    return fz->index[k];
+}
+
+bool vector_frozen_contains(const struct vector_frozen *__restrict fz,
+                            const void *data)
+{
+    unsigned long k;
+    
+    k = _eytzinger_search(fz, data);
+    
+    return k != 0 && fz->data_compare(fz->data[k], data) == 0;
+}
+
+unsigned int vector_frozen_size(const struct vector_frozen *__restrict fz)
+{
+    return fz->size;
+}
+
+/* the children of node 'k' are the nodes (k * 9 + 1) to (k * 9 + 9) */
+static inline unsigned long _stree_child(unsigned long k, unsigned int i)
+{
+    return k * (NODE_KEYS + 1) + i + 1;
+}
+
+static void _stree_build(struct vector_frozen_long *__restrict fz,
+                         void *const *sorted,
+                         unsigned int *i,
+                         unsigned long k)
+{
+    unsigned long pos;
+    
+    if (k >= fz->nodes)
+        return;
+    
+    for (unsigned int j = 0; j < NODE_KEYS; ++j) {
+        _stree_build(fz, sorted, i, _stree_child(k, j));
+        
+        pos = k * NODE_KEYS + j;
+        
+        /* the padding behind the last key is never less than any key */
+        if (*i < fz->size) {
+            fz->keys[pos]  = (long) sorted[*i];
+            fz->index[pos] = *i;
+            *i += 1;
+        } else {
+            fz->keys[pos]  = LONG_MAX;
+            fz->index[pos] = fz->size;
+        }
+    }
+    
+    _stree_build(fz, sorted, i, _stree_child(k, NODE_KEYS));
+}
+
+/* number of keys of the node which are less than 'key' */
+static inline unsigned int _node_rank(const long *node, long key)
+{
+#if defined(__AVX2__)
+    __m256i k, lo, hi;
+    unsigned int mask;
+    
+    k  = _mm256_set1_epi64x(key);
+    lo = _mm256_load_si256((const __m256i *) node);
+    hi = _mm256_load_si256((const __m256i *) (node + 4));
+    
+    mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, lo)))
+         | _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, hi)))
+         << 4;
+    
+    return __builtin_popcount(mask);
+#elif defined(__SSE4_2__)
+    __m128i k;
+    unsigned int mask;
+    
+    k    = _mm_set1_epi64x(key);
+    mask = 0;
+    
+    for (unsigned int i = 0; i < NODE_KEYS; i += 2) {
+        __m128i v = _mm_load_si128((const __m128i *) (node + i));
+        
+        mask |= _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, v))) << i;
+    }
+    
+    return __builtin_popcount(mask);
+#else
+    unsigned int rank;
+    
+    rank = 0;
+    
+    for (unsigned int i = 0; i < NODE_KEYS; ++i)
+        rank += (node[i] < key);
+    
+    return rank;
+#endif
+}
+
+/*
+ * Returns the position of the lower bound of 'key' in 'keys', or -1 if
+ * all keys are less. Within a node the rank selects both the candidate
+ * and the child, so the loop has no data dependent branches.
+ */
+static long _stree_search(const struct vector_frozen_long *__restrict fz,
+                          long key)
+{
+    unsigned long k;
+    unsigned int rank;
+    long pos, res;
+    
+    k   = 0;
+    res = -1;
+    
+    while (k < fz->nodes) {
+        rank = _node_rank(fz->keys + k * NODE_KEYS, key);
+        pos  = k * NODE_KEYS + rank;
+        res  = (rank < NODE_KEYS) ? pos : res;
+        k    = _stree_child(k, rank);
+    }
+    
+    return res;
+}
+
+struct vector_frozen_long *
+vector_frozen_long_new(const struct vector *__restrict vec)
+{
+    struct vector_frozen_long *fz;
+    int err;
+    
+    fz = malloc(sizeof(*fz));
+    if (!fz)
+        return NULL;
+    
+    err = vector_frozen_long_init(fz, vec);
+    if (err < 0) {
+        free(fz);
+        errno = -err;
+        return NULL;
+    }
+    
+    return fz;
+}
+
+void vector_frozen_long_delete(struct vector_frozen_long *__restrict fz)
+{
+    vector_frozen_long_destroy(fz);
+    free(fz);
+}
+
+int vector_frozen_long_init(struct vector_frozen_long *__restrict fz,
+                            const struct vector *__restrict vec)
+{
+    void *keys;
+    unsigned int i;
+    int err;
+    
+    fz->size  = vec->size;
+    fz->nodes = (vec->size + NODE_KEYS - 1) / NODE_KEYS;
+    
+    /* nodes have to be aligned for the SIMD loads */
+    err = posix_memalign(&keys, NODE_SIZE, max(fz->nodes, 1u) * NODE_SIZE);
+    if (err)
+        return -err;
+    
+    fz->keys  = keys;
+    fz->index = malloc(max(fz->nodes, 1u) * NODE_KEYS * sizeof(*fz->index));
+    if (!fz->index) {
+        free(fz->keys);
+        return -ENOMEM;
+    }
+    
+    i = 0;
+    _stree_build(fz, vec->data, &i, 0);
+    
+    return 0;
+}
+
+void vector_frozen_long_destroy(struct vector_frozen_long *__restrict fz)
+{
+    free(fz->keys);
+    free(fz->index);
+}
+
+unsigned int
+vector_frozen_long_lower_bound(const struct vector_frozen_long *__restrict fz,
+                               long key)
+{
+    long pos;
+    
+    pos = _stree_search(fz, key);
+    
+    return (pos < 0) ? fz->size : fz->index[pos];
+}
+
+unsigned int
+vector_frozen_long_index_of(const struct vector_frozen_long *__restrict fz,
+                            long key)
+{
+    long pos;
+    
+    pos = _stree_search(fz, key);
+    if (pos < 0 || fz->keys[pos] != key || fz->index[pos] == fz->size)
+        return (unsigned int) -1;
+    
+    return fz->index[pos];
+}
+
+bool vector_frozen_long_contains(const struct vector_frozen_long *__restrict fz,
+                                 long key)
+{
+    return vector_frozen_long_index_of(fz, key) != (unsigned int) -1;
+}
+
+unsigned int
+vector_frozen_long_size(const struct vector_frozen_long *__restrict fz)
+{
+    return fz->size;
+}
@@ -22,9 +22,190 @@
  * SOFTWARE.
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
 #include <limits.h>
 
 #include "hash.h"
+#include "macro.h"
+
+/*
+ * hash_bytes() follows wyhash by Wang Yi (public domain): 64 bit
+ * multiplications folded into 64 bits, 48 bytes per round.
+ */
+static const uint64_t _secret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+
+static uint64_t _seed;
+
+static inline void _mum(uint64_t *a, uint64_t *b)
+{
+    __uint128_t r = *a;
+    
+    r *= *b;
+    
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+}
+
+static inline uint64_t _mix(uint64_t a, uint64_t b)
+{
+    _mum(&a, &b);
+    
+    return a ^ b;
+}
+
+static inline uint64_t _read8(const unsigned char *p)
+{
+    uint64_t v;
+    
+    memcpy(&v, p, sizeof(v));
+    
+    return v;
+}
+
+static inline uint64_t _read4(const unsigned char *p)
+{
+    uint32_t v;
+    
+    memcpy(&v, p, sizeof(v));
+    
+    return v;
+}
+
+/* 1 to 3 bytes, reads the first, middle and last one */
+static inline uint64_t _read3(const unsigned char *p, size_t len)
+{
+    return ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) |
+           p[len - 1];
+}
+
+static uint64_t _hash_bytes(const void *ptr, size_t len, uint64_t seed)
+{
+    const unsigned char *p;
+    uint64_t a, b, see1, see2;
+    size_t i;
+    
+    p     = ptr;
+    seed ^= _mix(seed ^ _secret[0], _secret[1]);
+    
+    if (likely(len <= 16)) {
+        if (likely(len >= 4)) {
+            /* two overlapping pairs of 4 bytes cover 4 to 16 bytes */
+            a = (_read4(p) << 32) | _read4(p + ((len >> 3) << 2));
+            b = (_read4(p + len - 4) << 32) |
+                _read4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = _read3(p, len);
+            b = 0;
+        } else {
+            a = 0;
+            b = 0;
+        }
+    } else {
+        i = len;
+        
+        if (unlikely(i >= 48)) {
+            see1 = seed;
+            see2 = seed;
+            
+            do {
+                seed = _mix(_read8(p) ^ _secret[1], _read8(p + 8) ^ seed);
+                see1 = _mix(_read8(p + 16) ^ _secret[2],
+                            _read8(p + 24) ^ see1);
+                see2 = _mix(_read8(p + 32) ^ _secret[3],
+                            _read8(p + 40) ^ see2);
+                
+                p += 48;
+                i -= 48;
+            } while (likely(i >= 48));
+            
+            seed ^= see1 ^ see2;
+        }
+        
+        while (unlikely(i > 16)) {
+            seed = _mix(_read8(p) ^ _secret[1], _read8(p + 8) ^ seed);
+            
+            p += 16;
+            i -= 16;
+        }
+        
+        /* the last 16 bytes, overlapping with the ones before */
+        a = _read8(p + i - 16);
+        b = _read8(p + i - 8);
+    }
+    
+    a ^= _secret[1];
+    b ^= seed;
+    
+    _mum(&a, &b);
+    
+    return _mix(a ^ _secret[0] ^ len, b ^ _secret[1]);
+}
+
+void hash_set_seed(unsigned long seed)
+{
+    _seed = seed;
+}
+
+unsigned long hash_get_seed(void)
+{
+    return _seed;
+}
+
+int hash_seed_random(void)
+{
+    unsigned long seed;
+    ssize_t n;
+    int fd, err;
+    
+    fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    
+    n = read(fd, &seed, sizeof(seed));
+    err = (n < 0) ? -errno : 0;
+    
+    close(fd);
+    
+    if (err < 0)
+        return err;
+    
+    if (n != sizeof(seed))
+        return -EIO;
+    
+    _seed = seed;
+    
+    return 0;
+}
+
+unsigned long hash_mix(unsigned long x)
+{
+    /* splitmix64 finalizer, every input bit affects every output bit */
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ul;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebul;
+    x ^= x >> 31;
+    
+    return x;
+}
+
+unsigned int hash_bytes(const void *ptr, size_t len)
+{
+    return (unsigned int) _hash_bytes(ptr, len, _seed);
+}
+
+unsigned long hash_bytes_seed(const void *ptr, size_t len, unsigned long seed)
+{
+    return _hash_bytes(ptr, len, seed);
+}
 
 unsigned int hash_char(const void *key)
 {
@@ -63,41 +244,11 @@ unsigned int hash_long(const void *key)
 
 unsigned int hash_ulong(const void *key)
 {
-    unsigned int hval;
-    
-    hval = 1; 
-    
-    hval += (unsigned long) key;
-    hval += (hval << 10);
-    hval ^= (hval >> 6);
-    hval += ((unsigned long) key >> 32);
-    hval &= 0x0fffffff;
-    
-    hval += (hval << 3);
-    hval ^= (hval >> 11);
-    hval += (hval << 15);
-    
-    return hval;
+    /* the seed goes in first, so equal keys differ between seeds */
+    return (unsigned int) hash_mix((unsigned long) key ^ _seed);
 }
 
 unsigned int hash_string(const void *key)
 {
-    const char *k;
-    unsigned int hval;
-    
-    k = key;
-    hval = 1;
-    
-    while(*k != '\0')
-        hval += *k++;
-    
-    hval += (hval << 10);
-    hval ^= (hval >> 6);
-    hval &= 0x0fffffff;
-    
-    hval += (hval << 3);
-    hval ^= (hval >> 11);
-    hval += (hval << 15);
-    
-    return hval;
-}
\ No newline at end of file
+    return hash_bytes(key, strlen(key));
+}
@@ -0,0 +1,326 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <libvci/cmap.h>
+#include <libvci/map.h>
+#include <libvci/hash.h>
+#include <libvci/compare.h>
+#include <libvci/clock.h>
+#include <libvci/macro.h>
+
+#define STABLE_KEYS 1024
+#define KEYS_PER_THREAD 4096
+
+static unsigned long deleted;
+
+static void count_delete(void *data)
+{
+    (void) data;
+    
+    __atomic_add_fetch(&deleted, 1, __ATOMIC_RELAXED);
+}
+
+static const struct cmap_config cmap_conf = {
+    .size           = CMAP_DEFAULT_SIZE,
+    .upper_bound    = CMAP_DEFAULT_UPPER_BOUND,
+    .stripes        = CMAP_DEFAULT_STRIPES,
+    .key_compare    = &compare_int,
+    .key_hash       = &hash_int,
+    .data_delete    = &count_delete,
+};
+
+void test_basic(void)
+{
+    struct cmap *map;
+    unsigned int ticket;
+    int i, err;
+    
+    map = cmap_new(&cmap_conf);
+    assert(map);
+    
+    for (i = 0; i < 10000; ++i) {
+        err = cmap_insert(map, (void *)(long) i, (void *)(long) i);
+        assert(err == 0);
+    }
+    
+    assert(cmap_insert(map, (void *)(long) 5, NULL) == -EEXIST);
+    assert(cmap_size(map) == 10000);
+    
+    for (i = 0; i < 10000; ++i)
+        assert((int)(long) cmap_retrieve(map, (void *)(long) i) == i);
+    
+    for (i = 0; i < 10000; i += 2)
+        assert((int)(long) cmap_take(map, (void *)(long) i) == i);
+    
+    assert(!cmap_contains(map, (void *)(long) 0));
+    assert(cmap_contains(map, (void *)(long) 1));
+    assert(cmap_take(map, (void *)(long) 0) == NULL);
+    
+    /* data removed while we hold a read lock isn't deleted until we unlock */
+    deleted = 0;
+    ticket  = cmap_read_lock(map);
+    
+    for (i = 1; i < 10000; i += 2)
+        assert(cmap_remove(map, (void *)(long) i) == 0);
+    
+    assert(__atomic_load_n(&deleted, __ATOMIC_RELAXED) == 0);
+    
+    cmap_read_unlock(map, ticket);
+    cmap_synchronize(map);
+    
+    assert(deleted == 5000);
+    assert(cmap_size(map) == 0);
+    assert(cmap_remove(map, (void *)(long) 1) == -ENOENT);
+    
+    cmap_delete(map);
+    
+    fprintf(stdout, "Basic cmap test passed\n");
+}
+
+struct worker {
+    pthread_t thread;
+    struct cmap *cmap;
+    
+    struct map *map;
+    pthread_mutex_t *mutex;
+    
+    unsigned int id;
+    unsigned int ops;
+    /* out of 100 operations */
+    unsigned int writes;
+};
+
+static void *stress_worker(void *arg)
+{
+    struct worker *w = arg;
+    unsigned int i, base;
+    long key;
+    
+    base = STABLE_KEYS + w->id * KEYS_PER_THREAD;
+    
+    for (i = 0; i < w->ops; ++i) {
+        key = base + i % KEYS_PER_THREAD;
+        
+        assert(cmap_insert(w->cmap, (void *) key, (void *) key) == 0);
+        assert(cmap_retrieve(w->cmap, (void *) key) == (void *) key);
+        
+        key = i % STABLE_KEYS;
+        assert(cmap_retrieve(w->cmap, (void *) key) == (void *) key);
+        
+        if (i % KEYS_PER_THREAD == KEYS_PER_THREAD - 1) {
+            for (key = base; key < base + KEYS_PER_THREAD; ++key)
+                assert(cmap_take(w->cmap, (void *) key) == (void *) key);
+        }
+    }
+    
+    return NULL;
+}
+
+void test_concurrent(unsigned int threads, unsigned int ops)
+{
+    struct worker *workers;
+    struct cmap *map;
+    unsigned int i;
+    int err;
+    
+    map = cmap_new(&cmap_conf);
+    assert(map);
+    
+    workers = calloc(threads, sizeof(*workers));
+    assert(workers);
+    
+    for (i = 0; i < STABLE_KEYS; ++i) {
+        err = cmap_insert(map, (void *)(long) i, (void *)(long) i);
+        assert(err == 0);
+    }
+    
+    for (i = 0; i < threads; ++i) {
+        workers[i].cmap = map;
+        workers[i].id   = i;
+        workers[i].ops  = ops;
+        
+        err = pthread_create(&workers[i].thread, NULL, &stress_worker, 
+                             workers + i);
+        assert(err == 0);
+    }
+    
+    for (i = 0; i < threads; ++i)
+        pthread_join(workers[i].thread, NULL);
+    
+    assert(cmap_size(map) == STABLE_KEYS + threads * (ops % KEYS_PER_THREAD));
+    
+    free(workers);
+    cmap_delete(map);
+    
+    fprintf(stdout, "Concurrent cmap test with %u threads passed\n", threads);
+}
+
+static void *bench_worker(void *arg)
+{
+    struct worker *w = arg;
+    unsigned int i, x;
+    long key;
+    
+    x = w->id * 2654435761u + 1;
+    
+    for (i = 0; i < w->ops; ++i) {
+        x   = x * 1103515245 + 12345;
+        key = (x >> 8) % STABLE_KEYS;
+        
+        if ((x >> 24) % 100 >= w->writes) {
+            if (w->cmap) {
+                cmap_retrieve(w->cmap, (void *) key);
+            } else {
+                pthread_mutex_lock(w->mutex);
+                map_retrieve(w->map, (void *) key);
+                pthread_mutex_unlock(w->mutex);
+            }
+            
+            continue;
+        }
+        
+        /* writes replace a key of our own range */
+        key = STABLE_KEYS + w->id * KEYS_PER_THREAD + key;
+        
+        if (w->cmap) {
+            if (cmap_take(w->cmap, (void *) key) == NULL)
+                cmap_insert(w->cmap, (void *) key, (void *) key);
+        } else {
+            pthread_mutex_lock(w->mutex);
+            if (map_take(w->map, (void *) key) == NULL)
+                map_insert(w->map, (void *) key, (void *) key);
+            pthread_mutex_unlock(w->mutex);
+        }
+    }
+    
+    return NULL;
+}
+
+static unsigned long run_bench(struct worker *workers, unsigned int threads)
+{
+    struct clock *c;
+    unsigned long us;
+    unsigned int i;
+    int err;
+    
+    c = clock_new(CLOCK_MONOTONIC);
+    assert(c);
+    
+    clock_start(c);
+    
+    for (i = 0; i < threads; ++i) {
+        err = pthread_create(&workers[i].thread, NULL, &bench_worker, 
+                             workers + i);
+        assert(err == 0);
+    }
+    
+    for (i = 0; i < threads; ++i)
+        pthread_join(workers[i].thread, NULL);
+    
+    us = max(clock_elapsed_us(c), 1ul);
+    
+    clock_delete(c);
+    
+    return us;
+}
+
+/* 95% retrieves against the map behind a mutex and against the cmap */
+void test_performance(unsigned int max_threads, unsigned int ops)
+{
+    const struct map_config map_conf = {
+        .size           = MAP_DEFAULT_SIZE,
+        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
+        .static_size    = false,
+        .key_compare    = &compare_int,
+        .key_hash       = &hash_int,
+        .data_delete    = NULL,
+    };
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    struct worker *workers;
+    struct cmap *cmap;
+    struct map *map;
+    unsigned long us_map, us_cmap;
+    unsigned int i, threads;
+    
+    workers = calloc(max_threads, sizeof(*workers));
+    assert(workers);
+    
+    for (threads = 1; threads <= max_threads; threads <<= 1) {
+        map  = map_new(&map_conf);
+        cmap = cmap_new(&cmap_conf);
+        assert(map);
+        assert(cmap);
+        
+        for (i = 0; i < STABLE_KEYS; ++i) {
+            map_insert(map, (void *)(long) i, (void *)(long) i);
+            cmap_insert(cmap, (void *)(long) i, (void *)(long) i);
+        }
+        
+        for (i = 0; i < threads; ++i) {
+            workers[i].cmap   = NULL;
+            workers[i].map    = map;
+            workers[i].mutex  = &mutex;
+            workers[i].id     = i;
+            workers[i].ops    = ops / threads;
+            workers[i].writes = 5;
+        }
+        
+        us_map = run_bench(workers, threads);
+        
+        for (i = 0; i < threads; ++i)
+            workers[i].cmap = cmap;
+        
+        us_cmap = run_bench(workers, threads);
+        
+        fprintf(stdout, "%2u threads: map + mutex %8lu ops/ms, "
+                "cmap %8lu ops/ms\n", threads, 1000ul * ops / us_map, 
+                1000ul * ops / us_cmap);
+        
+        map_delete(map);
+        cmap_delete(cmap);
+    }
+    
+    free(workers);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int threads, ops;
+    
+    threads = (argc > 1) ? (unsigned int) atoi(argv[1]) : 4;
+    ops     = (argc > 2) ? (unsigned int) atoi(argv[2]) : 1000000;
+    
+    test_basic();
+    test_concurrent(threads, 100000);
+    test_performance(threads, ops);
+    
+    return EXIT_SUCCESS;
+}
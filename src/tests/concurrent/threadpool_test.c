@@ -28,13 +28,17 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <sched.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
 
 #include <libvci/threadpool.h>
+#include <libvci/vector.h>
+#include <libvci/clock.h>
 #include <libvci/macro.h>
 
 #define MAX_EPOLL_EVENTS 10
+#define FAN_OUT 8
 
 struct my_task {
     struct threadpool_task task;
@@ -50,6 +54,39 @@ void my_task_run(struct threadpool_task *task)
     my_task->id = 0xffff;
 }
 
+struct spawn_task {
+    struct threadpool_task task;
+    struct threadpool *pool;
+    unsigned long sum;
+};
+
+void leaf_task_run(struct threadpool_task *task)
+{
+    struct spawn_task *t;
+    
+    t = container_of(task, struct spawn_task, task);
+    
+    for (unsigned int i = 0; i < 64; ++i)
+        t->sum += i;
+}
+
+/* the following FAN_OUT tasks in memory are the children of this task */
+void spawn_task_run(struct threadpool_task *task)
+{
+    struct spawn_task *t;
+    int err;
+    
+    t = container_of(task, struct spawn_task, task);
+    
+    for (unsigned int i = 1; i <= FAN_OUT; ++i) {
+        t[i].task.func = &leaf_task_run;
+        t[i].sum       = 0;
+        
+        err = threadpool_add_task(t->pool, &t[i].task);
+        assert(err == 0);
+    }
+}
+
 static const char _usage[] = {
     "Usage  : %s <number of threads> <number of tasks>\n"
     "Example: %s 10 100\n"
@@ -122,6 +159,137 @@ void test_adding_removing_threads(void)
     threadpool_delete(pool);
 }
 
+void sleep_task_run(struct threadpool_task *task)
+{
+    (void) task;
+    
+    usleep(1000);
+}
+
+void test_elastic(void)
+{
+    const struct threadpool_config conf = {
+        .threads            = 1,
+        .min_threads        = 1,
+        .max_threads        = 4,
+        .elastic            = true,
+        .idle_timeout_ms    = 20,
+        .grow_queue_depth   = 4,
+    };
+    struct threadpool *pool;
+    struct threadpool_task tasks[64];
+    unsigned int i, peak;
+    int err;
+    
+    pool = threadpool_new_config(&conf);
+    assert(pool);
+    assert(threadpool_thread_count(pool) == 1);
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i) {
+        tasks[i].func = &sleep_task_run;
+        
+        err = threadpool_add_task(pool, tasks + i);
+        assert(err == 0);
+    }
+    
+    peak = threadpool_thread_count(pool);
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i)
+        assert(threadpool_take_completed_task(pool));
+    
+    assert(peak > 1 && peak <= 4);
+    
+    /* idle workers retire down to 'min_threads' */
+    for (i = 0; i < 100 && threadpool_thread_count(pool) > 1; ++i)
+        usleep(10000);
+    
+    assert(threadpool_thread_count(pool) == 1);
+    
+    threadpool_delete(pool);
+    
+    /* exit requests don't wait for the queued tasks */
+    pool = threadpool_new(1);
+    assert(pool);
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i) {
+        err = threadpool_add_task(pool, tasks + i);
+        assert(err == 0);
+    }
+    
+    err = threadpool_remove_thread(pool);
+    assert(err == 0);
+    err = threadpool_remove_thread(pool);
+    assert(err == -EINVAL);
+    
+    for (i = 0; i < 100 && threadpool_thread_count(pool) > 0; ++i)
+        usleep(1000);
+    
+    assert(threadpool_thread_count(pool) == 0);
+    assert(threadpool_tasks_queued(pool) > 0);
+    
+    err = threadpool_add_thread(pool);
+    assert(err == 0);
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i)
+        assert(threadpool_take_completed_task(pool));
+    
+    threadpool_delete(pool);
+}
+
+void test_work_stealing(void)
+{
+    const struct threadpool_config conf = {
+        .threads        = 4,
+        .max_threads    = 8,
+        .queue_size     = 16,
+        .mode           = THREADPOOL_MODE_WORK_STEALING,
+    };
+    struct threadpool *pool;
+    struct spawn_task *tasks;
+    int i, err, num_roots, num_tasks;
+    
+    num_roots = 1000;
+    num_tasks = num_roots * (FAN_OUT + 1);
+    
+    pool  = threadpool_new_config(&conf);
+    tasks = calloc(num_tasks, sizeof(*tasks));
+    assert(pool);
+    assert(tasks);
+    
+    for (i = 0; i < 4; ++i) {
+        err = threadpool_add_thread(pool);
+        assert(err == 0);
+    }
+    
+    /* no more free worker slots */
+    assert(threadpool_add_thread(pool) == -EAGAIN);
+    
+    for (i = 0; i < num_tasks; i += FAN_OUT + 1) {
+        tasks[i].task.func = &spawn_task_run;
+        tasks[i].pool      = pool;
+        
+        err = threadpool_add_task(pool, &tasks[i].task);
+        assert(err == 0);
+    }
+    
+    /* workers exiting must hand over the tasks of their deques */
+    for (i = 0; i < 6; ++i) {
+        err = threadpool_remove_thread(pool);
+        assert(err == 0);
+    }
+    
+    for (i = 0; i < num_tasks; ++i)
+        assert(threadpool_take_completed_task(pool));
+    
+    for (i = 0; i < num_tasks; ++i) {
+        if (tasks[i].task.func == &leaf_task_run)
+            assert(tasks[i].sum == 63 * 64 / 2);
+    }
+    
+    threadpool_delete(pool);
+    free(tasks);
+}
+
 void test_usage(int argc, char *argv[])
 {
     struct my_task *my_task;
@@ -169,10 +337,829 @@ void test_usage(int argc, char *argv[])
     threadpool_delete(pool);
 }
 
+void test_batch(int num_threads, int num_tasks)
+{
+    struct threadpool *pool;
+    struct threadpool_task **tasks;
+    struct my_task *my_tasks;
+    eventfd_t tasks_done;
+    unsigned int n;
+    int i, err, fds;
+    
+    pool     = threadpool_new(num_threads);
+    tasks    = calloc(num_tasks, sizeof(*tasks));
+    my_tasks = calloc(num_tasks, sizeof(*my_tasks));
+    assert(pool);
+    assert(tasks);
+    assert(my_tasks);
+    
+    for (i = 0; i < num_tasks; ++i) {
+        my_tasks[i].task.func = &my_task_run;
+        tasks[i] = &my_tasks[i].task;
+    }
+    
+    err = threadpool_add_tasks(pool, tasks, num_tasks);
+    assert(err == 0);
+    
+    epoll_fd = epoll_create(1);
+    assert(epoll_fd >= 0);
+    
+    memset(epoll_events, 0, sizeof(epoll_events));
+    
+    epoll_events[0].data.fd = threadpool_event_fd(pool);
+    epoll_events[0].events  = EPOLLIN;
+    
+    err = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, epoll_events[0].data.fd, 
+                    epoll_events);
+    assert(err == 0);
+    
+    for (i = 0; i < num_tasks;) {
+        fds = epoll_wait(epoll_fd, epoll_events, MAX_EPOLL_EVENTS, -1);
+        assert(fds == 1);
+        
+        err = eventfd_read(threadpool_event_fd(pool), &tasks_done);
+        assert(err == 0);
+        
+        /* tasks[] is not needed anymore, reuse it for completed tasks */
+        n = threadpool_take_completed_tasks(pool, tasks, num_tasks);
+        
+        while (n--) {
+            assert(container_of(tasks[n], struct my_task, task)->id == 0xffff);
+            ++i;
+        }
+    }
+    
+    assert(threadpool_take_completed_tasks(pool, tasks, num_tasks) == 0);
+    
+    close(epoll_fd);
+    threadpool_delete(pool);
+    free(my_tasks);
+    free(tasks);
+}
+
+unsigned int detached_done;
+
+void detached_task_complete(struct threadpool_task *task)
+{
+    struct my_task *my_task;
+    
+    my_task = container_of(task, struct my_task, task);
+    
+    assert(my_task->id == 0xffff);
+    free(my_task);
+    
+    __atomic_add_fetch(&detached_done, 1, __ATOMIC_RELAXED);
+}
+
+void test_detached(int num_threads, int num_tasks)
+{
+    struct threadpool *pool;
+    struct my_task *my_task;
+    struct threadpool_task *task;
+    int i, err, fds;
+    
+    pool = threadpool_new(num_threads);
+    assert(pool);
+    
+    epoll_fd = epoll_create(1);
+    assert(epoll_fd >= 0);
+    
+    memset(epoll_events, 0, sizeof(epoll_events));
+    
+    epoll_events[0].data.fd = threadpool_event_fd(pool);
+    epoll_events[0].events  = EPOLLIN;
+    
+    err = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, epoll_events[0].data.fd, 
+                    epoll_events);
+    assert(err == 0);
+    
+    for (i = 0; i < num_tasks; ++i) {
+        my_task = malloc(sizeof(*my_task));
+        assert(my_task);
+        
+        my_task->task.func = &my_task_run;
+        
+        err = threadpool_add_detached_task(pool, &my_task->task, 
+                                           &detached_task_complete);
+        assert(err == 0);
+    }
+    
+    while (__atomic_load_n(&detached_done, __ATOMIC_RELAXED)
+           < (unsigned int) num_tasks)
+        usleep(1000);
+    
+    /* detached tasks never show up as completed */
+    fds = epoll_wait(epoll_fd, epoll_events, MAX_EPOLL_EVENTS, 0);
+    assert(fds == 0);
+    assert(threadpool_take_completed_tasks(pool, &task, 1) == 0);
+    
+    close(epoll_fd);
+    threadpool_delete(pool);
+}
+
+struct prio_task {
+    struct threadpool_task task;
+    enum threadpool_priority prio;
+    unsigned int *order;
+};
+
+void prio_task_run(struct threadpool_task *task)
+{
+    struct prio_task *t;
+    
+    t = container_of(task, struct prio_task, task);
+    
+    /* with a single worker the tasks run in the order they were dispatched */
+    t->order[t->prio] = __atomic_add_fetch(t->order + THREADPOOL_PRIORITIES, 
+                                           1, __ATOMIC_RELAXED);
+}
+
+void block_task_run(struct threadpool_task *task)
+{
+    (void) task;
+    
+    usleep(50000);
+}
+
+void test_priorities(void)
+{
+    const struct threadpool_config conf = {
+        .threads            = 1,
+        .measure_wait_time  = true,
+        .mode               = THREADPOOL_MODE_SHARED_QUEUE,
+    };
+    struct threadpool_priority_stats stats;
+    struct threadpool *pool;
+    struct threadpool_task block;
+    struct prio_task tasks[THREADPOOL_PRIORITIES];
+    unsigned int order[THREADPOOL_PRIORITIES + 1];
+    unsigned long waited;
+    int i, err;
+    
+    pool = threadpool_new_config(&conf);
+    assert(pool);
+    
+    memset(order, 0, sizeof(order));
+    
+    /* keep the only worker busy until all tasks are queued */
+    block.func = &block_task_run;
+    
+    err = threadpool_add_task(pool, &block);
+    assert(err == 0);
+    
+    usleep(10000);
+    
+    for (i = THREADPOOL_PRIORITIES - 1; i >= 0; --i) {
+        tasks[i].task.func = &prio_task_run;
+        tasks[i].prio      = i;
+        tasks[i].order     = order;
+        
+        err = threadpool_add_task_priority(pool, &tasks[i].task, i);
+        assert(err == 0);
+    }
+    
+    err = threadpool_priority_stats(pool, THREADPOOL_PRIORITY_LOW, &stats);
+    assert(err == 0);
+    assert(stats.queued == 1);
+    
+    for (i = 0; i < THREADPOOL_PRIORITIES + 1; ++i)
+        assert(threadpool_take_completed_task(pool));
+    
+    for (i = 0; i < THREADPOOL_PRIORITIES; ++i)
+        assert(order[i] == (unsigned int) i + 1);
+    
+    err = threadpool_priority_stats(pool, THREADPOOL_PRIORITY_HIGH, &stats);
+    assert(err == 0);
+    assert(stats.queued == 0);
+    assert(stats.dispatched == 1);
+    assert(stats.wait_max_ns > 0);
+    
+    waited = 0;
+    
+    for (i = 0; i < THREADPOOL_WAIT_BUCKETS; ++i)
+        waited += stats.wait_histogram[i];
+    
+    assert(waited == 1);
+    
+    err = threadpool_priority_stats(pool, THREADPOOL_PRIORITIES, &stats);
+    assert(err == -EINVAL);
+    
+    threadpool_delete(pool);
+}
+
+struct fifo_task {
+    struct threadpool_task task;
+    unsigned int *next;
+    unsigned int order;
+};
+
+void fifo_task_run(struct threadpool_task *task)
+{
+    struct fifo_task *t;
+    
+    t = container_of(task, struct fifo_task, task);
+    
+    t->order = (*t->next)++;
+}
+
+void test_fifo(void)
+{
+    const struct threadpool_config conf = {
+        .threads    = 1,
+        .queue_size = 4,
+        .mode       = THREADPOOL_MODE_SHARED_QUEUE,
+    };
+    struct threadpool *pool;
+    struct threadpool_task block;
+    struct fifo_task tasks[32];
+    unsigned int i, next;
+    int err;
+    
+    pool = threadpool_new_config(&conf);
+    assert(pool);
+    
+    block.func = &block_task_run;
+    
+    err = threadpool_add_task(pool, &block);
+    assert(err == 0);
+    
+    usleep(10000);
+    
+    /* most tasks overflow the ring, the worker must still run them in order */
+    next = 0;
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i) {
+        tasks[i].task.func = &fifo_task_run;
+        tasks[i].next      = &next;
+        
+        err = threadpool_add_task(pool, &tasks[i].task);
+        assert(err == 0);
+    }
+    
+    for (i = 0; i < ARRAY_SIZE(tasks) + 1; ++i)
+        assert(threadpool_take_completed_task(pool));
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i)
+        assert(tasks[i].order == i);
+    
+    threadpool_delete(pool);
+}
+
+void test_stats(int num_threads, int num_tasks)
+{
+    const struct threadpool_config conf = {
+        .threads            = num_threads,
+        .measure_busy_time  = true,
+        .trace_size         = 100,
+        .mode               = THREADPOOL_MODE_WORK_STEALING,
+    };
+    struct threadpool *pool;
+    struct threadpool_stats stats;
+    struct threadpool_worker_stats worker_stats;
+    struct threadpool_trace_event *events;
+    struct spawn_task *tasks;
+    unsigned int i, n, max_events;
+    unsigned long expected;
+    FILE *file;
+    int err, num_roots;
+    
+    num_roots  = max(num_tasks / (FAN_OUT + 1), 1);
+    num_tasks  = num_roots * (FAN_OUT + 1);
+    max_events = 128 * num_threads;
+    
+    pool   = threadpool_new_config(&conf);
+    tasks  = calloc(num_tasks, sizeof(*tasks));
+    events = calloc(max_events, sizeof(*events));
+    assert(pool);
+    assert(tasks);
+    assert(events);
+    
+    for (i = 0; i < (unsigned int) num_tasks; i += FAN_OUT + 1) {
+        tasks[i].task.func = &spawn_task_run;
+        tasks[i].pool      = pool;
+        
+        err = threadpool_add_task(pool, &tasks[i].task);
+        assert(err == 0);
+    }
+    
+    for (i = 0; i < (unsigned int) num_tasks; ++i)
+        assert(threadpool_take_completed_task(pool));
+    
+    threadpool_stats(pool, &stats);
+    
+    assert(stats.threads == (unsigned int) num_threads);
+    assert(stats.queued == 0);
+    assert(stats.queue_max > 0);
+    assert(stats.workers.tasks == (unsigned long) num_tasks);
+    assert(stats.workers.busy_ns > 0);
+    
+    /* at most 128 events per worker are kept */
+    expected = 0;
+    
+    for (i = 0; threadpool_worker_stats(pool, i, &worker_stats) == 0; ++i)
+        expected += min(worker_stats.tasks, 128UL);
+    
+    assert(i == (unsigned int) num_threads);
+    
+    n = threadpool_trace(pool, events, max_events);
+    assert(n == expected);
+    
+    for (i = 0; i < n; ++i) {
+        assert(events[i].worker < (unsigned int) num_threads);
+        assert(events[i].enqueued_ns <= events[i].started_ns);
+        assert(events[i].started_ns <= events[i].finished_ns);
+    }
+    
+    file = fopen("/dev/null", "w");
+    assert(file);
+    
+    err = threadpool_trace_dump(pool, file);
+    assert(err == 0);
+    
+    fclose(file);
+    
+    threadpool_delete(pool);
+    free(events);
+    free(tasks);
+}
+
+struct future_task {
+    struct threadpool_task task;
+    struct future_task *parent;
+    unsigned int *gate;
+    unsigned int value;
+    pthread_t thread;
+};
+
+void future_task_run(struct threadpool_task *task)
+{
+    struct future_task *t;
+    
+    t = container_of(task, struct future_task, task);
+    
+    while (t->gate && !__atomic_load_n(t->gate, __ATOMIC_ACQUIRE))
+        usleep(100);
+    
+    t->thread = pthread_self();
+    t->value  = (t->parent) ? t->parent->value + 1 : 1;
+}
+
+void test_futures(int num_threads)
+{
+    struct threadpool *pool;
+    struct future_task tasks[8], next, late;
+    struct threadpool_future futures[ARRAY_SIZE(tasks)], *group[8];
+    struct threadpool_future next_future, all;
+    unsigned int i, gate;
+    int err;
+    
+    pool = threadpool_new(num_threads);
+    assert(pool);
+    
+    memset(tasks, 0, sizeof(tasks));
+    memset(&next, 0, sizeof(next));
+    memset(&late, 0, sizeof(late));
+    
+    gate = 0;
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i) {
+        err = threadpool_future_init(futures + i);
+        assert(err == 0);
+        
+        group[i] = futures + i;
+    }
+    
+    err = threadpool_future_init(&next_future);
+    assert(err == 0);
+    err = threadpool_future_init(&all);
+    assert(err == 0);
+    
+    /* the first task is held back until the gate opens */
+    tasks[0].task.func = &future_task_run;
+    tasks[0].gate      = &gate;
+    
+    err = threadpool_add_task_future(pool, &tasks[0].task, futures);
+    assert(err == 0);
+    
+    next.task.func = &future_task_run;
+    next.parent    = tasks;
+    
+    err = threadpool_future_then(pool, futures, &next.task, &next_future);
+    assert(err == 0);
+    
+    for (i = 1; i < ARRAY_SIZE(tasks); ++i) {
+        tasks[i].task.func = &future_task_run;
+        
+        err = threadpool_add_task_future(pool, &tasks[i].task, futures + i);
+        assert(err == 0);
+    }
+    
+    err = threadpool_when_all(pool, group, ARRAY_SIZE(group), &all);
+    assert(err == 0);
+    
+    err = threadpool_future_wait_timeout(futures, 10);
+    assert(err == -ETIMEDOUT);
+    assert(!threadpool_future_done(futures));
+    assert(!threadpool_future_done(&next_future));
+    assert(!threadpool_future_done(&all));
+    
+    __atomic_store_n(&gate, 1, __ATOMIC_RELEASE);
+    
+    threadpool_future_wait(&all);
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i) {
+        assert(threadpool_future_done(futures + i));
+        assert(tasks[i].value == 1);
+    }
+    
+    err = threadpool_future_wait_timeout(&next_future, 1000);
+    assert(err == 0);
+    
+    /* continuations run on the parent's worker right after the parent */
+    assert(next.value == 2);
+    assert(pthread_equal(next.thread, tasks[0].thread));
+    
+    /* a continuation of a future that is done is just added to the pool */
+    late.task.func = &future_task_run;
+    late.parent    = &next;
+    
+    err = threadpool_future_then(pool, &next_future, &late.task, NULL);
+    assert(err == 0);
+    
+    assert(threadpool_take_completed_task(pool) == &late.task);
+    assert(late.value == 3);
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i)
+        threadpool_future_destroy(futures + i);
+    
+    threadpool_future_destroy(&next_future);
+    threadpool_future_destroy(&all);
+    
+    threadpool_delete(pool);
+}
+
+struct cpu_task {
+    struct threadpool_task task;
+    int cpu;
+};
+
+void cpu_task_run(struct threadpool_task *task)
+{
+    container_of(task, struct cpu_task, task)->cpu = sched_getcpu();
+}
+
+void test_affinity(void)
+{
+    struct threadpool_config conf = {
+        .threads        = 4,
+        .pin_threads    = true,
+        .numa           = true,
+        .mode           = THREADPOOL_MODE_WORK_STEALING,
+    };
+    struct threadpool *pool, empty;
+    struct cpu_task tasks[16];
+    cpu_set_t cpus;
+    unsigned int i, nodes;
+    int err;
+    
+    /* use a single cpu, so we know where the tasks have to run */
+    err = sched_getaffinity(0, sizeof(cpus), &cpus);
+    assert(err == 0);
+    
+    for (i = 0; !CPU_ISSET(i, &cpus); ++i)
+        ;
+    
+    CPU_ZERO(&cpus);
+    CPU_SET(i, &cpus);
+    
+    conf.cpus = &cpus;
+    
+    pool = threadpool_new_config(&conf);
+    assert(pool);
+    
+    nodes = threadpool_node_count(pool);
+    assert(nodes == 1);
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i) {
+        tasks[i].task.func = &cpu_task_run;
+        tasks[i].cpu       = -1;
+        
+        err = threadpool_add_task_node(pool, &tasks[i].task, i % nodes);
+        assert(err == 0);
+    }
+    
+    err = threadpool_add_task_node(pool, &tasks[0].task, nodes);
+    assert(err == -EINVAL);
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i)
+        assert(threadpool_take_completed_task(pool));
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i)
+        assert(CPU_ISSET(tasks[i].cpu, &cpus));
+    
+    threadpool_delete(pool);
+    
+    /* no cpu to pin the workers on */
+    CPU_ZERO(&cpus);
+    
+    err = threadpool_init_config(&empty, &conf);
+    assert(err == -EINVAL);
+}
+
+#define PARALLEL_SIZE 100000
+
+struct particle {
+    double pos[3];
+    double vel[3];
+    double mass;
+};
+
+void mark_range(long begin, long end, void *arg)
+{
+    unsigned char *marks;
+    
+    marks = arg;
+    
+    while (begin < end)
+        __atomic_add_fetch(&marks[begin++], 1, __ATOMIC_RELAXED);
+}
+
+void sum_range(long begin, long end, void *acc, void *arg)
+{
+    (void) arg;
+    
+    while (begin < end)
+        *(long *) acc += begin++;
+}
+
+void sum_combine(void *acc, const void *partial, void *arg)
+{
+    (void) arg;
+    
+    *(long *) acc += *(const long *) partial;
+}
+
+struct nested_task {
+    struct threadpool_task task;
+    struct threadpool *pool;
+    long sum;
+};
+
+void nested_task_run(struct threadpool_task *task)
+{
+    struct nested_task *t;
+    int err;
+    
+    t = container_of(task, struct nested_task, task);
+    
+    err = threadpool_parallel_reduce(t->pool, 0, PARALLEL_SIZE, 64, 
+                                     &sum_range, &sum_combine, 
+                                     &t->sum, sizeof(t->sum), NULL);
+    assert(err == 0);
+}
+
+void test_parallel(int num_threads)
+{
+    const struct threadpool_config conf = {
+        .threads        = num_threads,
+        .mode           = THREADPOOL_MODE_WORK_STEALING,
+    };
+    const long expected = (long) PARALLEL_SIZE * (PARALLEL_SIZE - 1) / 2;
+    struct threadpool *pool;
+    struct nested_task tasks[4];
+    unsigned char *marks;
+    unsigned int i;
+    long sum;
+    int err;
+    
+    pool  = threadpool_new_config(&conf);
+    marks = calloc(PARALLEL_SIZE, sizeof(*marks));
+    assert(pool);
+    assert(marks);
+    
+    err = threadpool_parallel_for(pool, 0, PARALLEL_SIZE, 0, 
+                                  &mark_range, marks);
+    assert(err == 0);
+    
+    for (i = 0; i < PARALLEL_SIZE; ++i)
+        assert(marks[i] == 1);
+    
+    sum = 0;
+    
+    err = threadpool_parallel_reduce(pool, 0, PARALLEL_SIZE, 0,
+                                     &sum_range, &sum_combine, 
+                                     &sum, sizeof(sum), NULL);
+    assert(err == 0);
+    assert(sum == expected);
+    
+    err = threadpool_parallel_reduce(pool, 0, PARALLEL_SIZE, 0,
+                                     &sum_range, &sum_combine,
+                                     &sum, 0, NULL);
+    assert(err == -EINVAL);
+    
+    /* empty ranges leave the identity alone */
+    err = threadpool_parallel_reduce(pool, 10, 10, 0,
+                                     &sum_range, &sum_combine, 
+                                     &sum, sizeof(sum), NULL);
+    assert(err == 0);
+    assert(sum == expected);
+    
+    /* workers waiting for their own parallel loops must not deadlock */
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i) {
+        tasks[i].task.func = &nested_task_run;
+        tasks[i].pool      = pool;
+        tasks[i].sum       = 0;
+        
+        err = threadpool_add_task(pool, &tasks[i].task);
+        assert(err == 0);
+    }
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i)
+        assert(threadpool_take_completed_task(pool));
+    
+    for (i = 0; i < ARRAY_SIZE(tasks); ++i)
+        assert(tasks[i].sum == expected);
+    
+    threadpool_delete(pool);
+    free(marks);
+}
+
+void momentum_range(long begin, long end, void *acc, void *arg)
+{
+    struct vector *vec;
+    struct particle *p;
+    double *sum;
+    
+    vec = arg;
+    sum = acc;
+    
+    for (; begin < end; ++begin) {
+        p = *vector_at(vec, begin);
+        
+        sum[0] += p->mass * p->vel[0];
+        sum[1] += p->mass * p->vel[1];
+        sum[2] += p->mass * p->vel[2];
+    }
+}
+
+void momentum_combine(void *acc, const void *partial, void *arg)
+{
+    const double *b;
+    double *a;
+    
+    (void) arg;
+    
+    a = acc;
+    b = partial;
+    
+    a[0] += b[0];
+    a[1] += b[1];
+    a[2] += b[2];
+}
+
+void test_parallel_performance(int num_threads, int num_elements)
+{
+    struct threadpool *pool;
+    struct particle *particles;
+    struct vector *vec;
+    struct clock *c;
+    double seq[3], par[3];
+    unsigned long seq_us, par_us;
+    int i, err;
+    
+    pool      = threadpool_new(num_threads);
+    vec       = vector_new(num_elements);
+    particles = calloc(num_elements, sizeof(*particles));
+    c         = clock_new(CLOCK_MONOTONIC);
+    assert(pool);
+    assert(vec);
+    assert(particles);
+    assert(c);
+    
+    for (i = 0; i < num_elements; ++i) {
+        particles[i].mass   = i % 7 + 1;
+        particles[i].vel[0] = i % 3;
+        particles[i].vel[1] = i % 5;
+        particles[i].vel[2] = -(i % 11);
+        
+        err = vector_insert_back(vec, particles + i);
+        assert(err == 0);
+    }
+    
+    memset(seq, 0, sizeof(seq));
+    memset(par, 0, sizeof(par));
+    
+    clock_start(c);
+    momentum_range(0, num_elements, seq, vec);
+    clock_stop(c);
+    
+    seq_us = clock_elapsed_us(c);
+    
+    clock_start(c);
+    
+    err = threadpool_parallel_reduce(pool, 0, num_elements, 0, 
+                                     &momentum_range, &momentum_combine,
+                                     par, sizeof(par), vec);
+    assert(err == 0);
+    
+    clock_stop(c);
+    
+    par_us = clock_elapsed_us(c);
+    
+    /* all values are small integers, so the sums are exact */
+    assert(memcmp(seq, par, sizeof(seq)) == 0);
+    
+    fprintf(stdout, 
+            "Momentum of %d particles: sequential %lu us, "
+            "parallel_reduce %lu us\n",
+            num_elements, seq_us, par_us);
+    
+    clock_delete(c);
+    vector_delete(vec);
+    free(particles);
+    threadpool_delete(pool);
+}
+
+double run_benchmark(enum threadpool_mode mode, int num_threads, int num_roots)
+{
+    const struct threadpool_config conf = {
+        .threads        = num_threads,
+        .max_threads    = num_threads,
+        .mode           = mode,
+    };
+    struct threadpool *pool;
+    struct spawn_task *tasks;
+    struct clock *c;
+    unsigned long elapsed;
+    int i, err, num_tasks;
+    
+    num_tasks = num_roots * (FAN_OUT + 1);
+    
+    pool  = threadpool_new_config(&conf);
+    tasks = calloc(num_tasks, sizeof(*tasks));
+    c     = clock_new(CLOCK_MONOTONIC);
+    assert(pool);
+    assert(tasks);
+    assert(c);
+    
+    clock_start(c);
+    
+    for (i = 0; i < num_tasks; i += FAN_OUT + 1) {
+        tasks[i].task.func = &spawn_task_run;
+        tasks[i].pool      = pool;
+        
+        err = threadpool_add_task(pool, &tasks[i].task);
+        assert(err == 0);
+    }
+    
+    for (i = 0; i < num_tasks; ++i)
+        threadpool_take_completed_task(pool);
+    
+    clock_stop(c);
+    
+    elapsed = clock_elapsed_us(c);
+    
+    clock_delete(c);
+    threadpool_delete(pool);
+    free(tasks);
+    
+    return num_tasks * 1e6 / (elapsed + 1);
+}
+
+void test_performance(int num_threads, int num_tasks)
+{
+    double shared, stealing;
+    int num_roots;
+    
+    num_roots = max(num_tasks / (FAN_OUT + 1), 1);
+    
+    shared   = run_benchmark(THREADPOOL_MODE_SHARED_QUEUE, 
+                             num_threads, num_roots);
+    stealing = run_benchmark(THREADPOOL_MODE_WORK_STEALING, 
+                             num_threads, num_roots);
+    
+    fprintf(stdout, 
+            "Shared queue : %.0f tasks/s\n"
+            "Work stealing: %.0f tasks/s\n",
+            shared, stealing);
+}
+
 int main(int argc, char *argv[])
 {
     test_adding_removing_threads();
+    test_elastic();
+    test_work_stealing();
+    test_priorities();
+    test_fifo();
+    test_affinity();
     test_usage(argc, argv);
+    test_batch(atoi(argv[1]), atoi(argv[2]));
+    test_detached(atoi(argv[1]), atoi(argv[2]));
+    test_futures(atoi(argv[1]));
+    test_stats(atoi(argv[1]), atoi(argv[2]));
+    test_performance(atoi(argv[1]), atoi(argv[2]));
+    test_parallel(atoi(argv[1]));
+    test_parallel_performance(atoi(argv[1]), 1 << 22);
     
     fprintf(stdout, 
             "Tests finished. %s threads executed %s tasks\n", 
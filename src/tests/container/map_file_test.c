@@ -0,0 +1,340 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include <libvci/map.h>
+#include <libvci/map_file.h>
+#include <libvci/hash.h>
+#include <libvci/compare.h>
+#include <libvci/clock.h>
+#include <libvci/macro.h>
+
+static char path[64];
+
+static size_t string_size(const void *data)
+{
+    return strlen(data) + 1;
+}
+
+static void map_file_int_test(unsigned int num, enum map_engine engine)
+{
+    const struct map_config map_conf = {
+        .size               = MAP_DEFAULT_SIZE,
+        .lower_bound        = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound        = MAP_DEFAULT_UPPER_BOUND,
+        .static_size        = false,
+        .key_compare        = &compare_int,
+        .key_hash           = &hash_int,
+        .data_delete        = NULL,
+        .engine             = engine,
+        .incremental_resize = true,
+    };
+    struct map_file *file;
+    struct map *map;
+    const unsigned long *val;
+    size_t size;
+    int err;
+    
+    map = map_new(&map_conf);
+    assert(map);
+    
+    /* a resize is still running, map_for_each() has to cover both tables */
+    for (unsigned int i = 0; i < num; ++i) {
+        err = map_insert(map, (void *)(long) (i * 3), (void *)(long) i);
+        assert(err == 0);
+    }
+    
+    err = map_file_write(map, path, MAP_FILE_KEY_INT, NULL);
+    assert(err == 0);
+    
+    map_delete(map);
+    
+    file = map_file_new(path);
+    assert(file);
+    assert(map_file_size(file) == num);
+    assert(map_file_key_type(file) == MAP_FILE_KEY_INT);
+    
+    for (unsigned int i = 0; i < 3 * num; ++i) {
+        val = map_file_retrieve(file, (void *)(long) i, &size);
+        
+        if (i % 3 == 0) {
+            assert(val && size == sizeof(*val) && *val == i / 3);
+            assert(map_file_contains(file, (void *)(long) i));
+        } else {
+            assert(!val);
+            assert(!map_file_contains(file, (void *)(long) i));
+        }
+    }
+    
+    map_file_delete(file);
+}
+
+static void map_file_string_test(unsigned int num)
+{
+    const struct map_config map_conf = {
+        .size           = MAP_DEFAULT_SIZE,
+        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
+        .static_size    = false,
+        .key_compare    = &compare_string,
+        .key_hash       = &hash_string,
+        .data_delete    = &free,
+        .engine         = MAP_ENGINE_SWISS,
+    };
+    struct map_file *file;
+    struct map *map;
+    char (*keys)[32], buf[32];
+    const char *val;
+    size_t size;
+    int err;
+    
+    keys = malloc(num * sizeof(*keys));
+    map  = map_new(&map_conf);
+    assert(keys);
+    assert(map);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        sprintf(keys[i], "key %u", i);
+        sprintf(buf, "value %u", i * i);
+        
+        err = map_insert(map, keys[i], strdup(buf));
+        assert(err == 0);
+    }
+    
+    /* the empty string is a valid key */
+    err = map_insert(map, "", strdup(""));
+    assert(err == 0);
+    
+    err = map_file_write(map, path, MAP_FILE_KEY_STRING, &string_size);
+    assert(err == 0);
+    
+    map_delete(map);
+    
+    file = map_file_new(path);
+    assert(file);
+    assert(map_file_size(file) == num + 1);
+    assert(map_file_key_type(file) == MAP_FILE_KEY_STRING);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        sprintf(buf, "value %u", i * i);
+        
+        val = map_file_retrieve(file, keys[i], &size);
+        assert(val && size == strlen(buf) + 1 && strcmp(val, buf) == 0);
+        assert(((unsigned long) val & 7) == 0);
+        
+        sprintf(buf, "key %u", i + num);
+        assert(!map_file_contains(file, buf));
+    }
+    
+    val = map_file_retrieve(file, "", &size);
+    assert(val && size == 1 && *val == '\0');
+    
+    map_file_delete(file);
+    free(keys);
+}
+
+static void map_file_invalid_test(void)
+{
+    const struct map_config map_conf = {
+        .size           = MAP_DEFAULT_SIZE,
+        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
+        .static_size    = false,
+        .key_compare    = &compare_int,
+        .key_hash       = &hash_int,
+        .data_delete    = NULL,
+    };
+    struct map_file file;
+    struct map *map;
+    FILE *fp;
+    int err;
+    
+    map = map_new(&map_conf);
+    assert(map);
+    
+    for (unsigned int i = 0; i < 100; ++i) {
+        err = map_insert(map, (void *)(long) i, (void *)(long) i);
+        assert(err == 0);
+    }
+    
+    err = map_file_write(map, path, MAP_FILE_KEY_INT, NULL);
+    assert(err == 0);
+    
+    map_delete(map);
+    
+    /* valid until it gets damaged */
+    err = map_file_init(&file, path);
+    assert(err == 0);
+    map_file_destroy(&file);
+    
+    err = truncate(path, 100);
+    assert(err == 0);
+    
+    err = map_file_init(&file, path);
+    assert(err == -EINVAL);
+    
+    fp = fopen(path, "w");
+    assert(fp);
+    fprintf(fp, "not a map file, but long enough for a header.......\n");
+    fclose(fp);
+    
+    err = map_file_init(&file, path);
+    assert(err == -EINVAL);
+    
+    unlink(path);
+    
+    err = map_file_init(&file, path);
+    assert(err == -ENOENT);
+}
+
+static void map_file_empty_test(void)
+{
+    const struct map_config map_conf = {
+        .size           = MAP_DEFAULT_SIZE,
+        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
+        .static_size    = false,
+        .key_compare    = &compare_string,
+        .key_hash       = &hash_string,
+        .data_delete    = NULL,
+    };
+    struct map_file file;
+    struct map *map;
+    int err;
+    
+    map = map_new(&map_conf);
+    assert(map);
+    
+    err = map_file_write(map, path, MAP_FILE_KEY_STRING, NULL);
+    assert(err == 0);
+    
+    map_delete(map);
+    
+    err = map_file_init(&file, path);
+    assert(err == 0);
+    assert(map_file_size(&file) == 0);
+    assert(!map_file_contains(&file, "key"));
+    
+    map_file_destroy(&file);
+}
+
+static void map_file_performance(unsigned int num)
+{
+    const struct map_config map_conf = {
+        .size           = MAP_DEFAULT_SIZE,
+        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
+        .static_size    = false,
+        .key_compare    = &compare_string,
+        .key_hash       = &hash_string,
+        .data_delete    = NULL,
+        .engine         = MAP_ENGINE_SWISS,
+    };
+    struct map_file *file;
+    struct map *map;
+    struct clock *c;
+    char (*keys)[32];
+    unsigned long build, load, sum;
+    int err;
+    
+    keys = malloc(num * sizeof(*keys));
+    c    = clock_new(CLOCK_MONOTONIC);
+    assert(keys);
+    assert(c);
+    
+    for (unsigned int i = 0; i < num; ++i)
+        sprintf(keys[i], "key %u", i);
+    
+    clock_start(c);
+    
+    map = map_new(&map_conf);
+    assert(map);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        err = map_insert(map, keys[i], (void *)(long) i);
+        assert(err == 0);
+    }
+    
+    build = clock_elapsed_us(c);
+    
+    err = map_file_write(map, path, MAP_FILE_KEY_STRING, NULL);
+    assert(err == 0);
+    
+    map_delete(map);
+    
+    clock_reset(c);
+    
+    file = map_file_new(path);
+    assert(file);
+    
+    load = clock_elapsed_us(c);
+    
+    fprintf(stdout, "%u string keys: map_insert() %lu us, map_file_new() "
+            "%lu us\n", num, build, load);
+    
+    clock_reset(c);
+    
+    sum = 0;
+    
+    for (unsigned int i = 0; i < num; ++i)
+        sum += *(const unsigned long *) map_file_retrieve(file, keys[i], NULL);
+    
+    assert(sum == (unsigned long) num * (num - 1) / 2);
+    
+    fprintf(stdout, "%u lookups in the mapped file: %lu us\n",
+            num, clock_elapsed_us(c));
+    
+    map_file_delete(file);
+    clock_delete(c);
+    free(keys);
+}
+
+int main(int argc, char *argv[])
+{
+    enum map_engine engine;
+    
+    sprintf(path, "/tmp/map_file_test.%d", (int) getpid());
+    
+    for (engine = MAP_ENGINE_QUADRATIC; engine <= MAP_ENGINE_ROBIN_HOOD; ++engine)
+        map_file_int_test(10000, engine);
+    
+    map_file_string_test(10000);
+    map_file_empty_test();
+    map_file_invalid_test();
+    
+    if (argc == 2) {
+        map_file_performance((unsigned int) atoi(argv[1]));
+        unlink(path);
+    }
+    
+    fprintf(stdout, "Tests finished successfully.\n");
+    
+    return EXIT_SUCCESS;
+}
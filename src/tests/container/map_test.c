@@ -26,11 +26,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 
 #include <fcntl.h>
 #include <sys/stat.h>
 
 #include <libvci/map.h>
+#include <libvci/map_define.h>
 #include <libvci/hash.h>
 #include <libvci/compare.h>
 #include <libvci/clock.h>
@@ -61,7 +63,28 @@ void inspect_map(const struct map *__restrict map)
             map->size, map->capacity, 100 * map->size / map->capacity);
 }
 
-void map_test_insert_remove(void)
+/* hash_string() collides on anagrams like "key 12" and "key 21" */
+static unsigned int hash_fnv(const void *key)
+{
+    const unsigned char *k = key;
+    unsigned int hval = 2166136261u;
+    
+    while (*k != '\0')
+        hval = (hval ^ *k++) * 16777619u;
+    
+    return hval;
+}
+
+MAP_DEFINE(int_map, int, int, MAP_DEFINE_HASH_INT, MAP_DEFINE_EQ)
+MAP_DEFINE(string_map, const char *, int, hash_fnv, MAP_DEFINE_EQ_STRING)
+
+static const char *engine_names[] = {
+    [MAP_ENGINE_QUADRATIC]  = "quadratic",
+    [MAP_ENGINE_SWISS]      = "swiss",
+    [MAP_ENGINE_ROBIN_HOOD] = "robin hood",
+};
+
+void map_test_insert_remove(enum map_engine engine)
 {
     const struct map_config map_conf = {
         .size           = MAP_DEFAULT_SIZE,
@@ -71,6 +94,7 @@ void map_test_insert_remove(void)
         .key_compare    = &compare_int,
         .key_hash       = &hash_long,
         .data_delete    = NULL,
+        .engine         = engine,
     };
     struct map *map;
     unsigned int num_elements;
@@ -94,7 +118,7 @@ void map_test_insert_remove(void)
     map_delete(map);
 }
 
-void map_test_performance(unsigned int num)
+void map_test_performance(unsigned int num, enum map_engine engine)
 {
     const struct map_config map_conf = {
         .size           = MAP_DEFAULT_SIZE,
@@ -104,6 +128,7 @@ void map_test_performance(unsigned int num)
         .key_compare    = &compare_int,
         .key_hash       = &hash_int,
         .data_delete    = NULL,
+        .engine         = engine,
     };
     struct map *map;
     struct clock *c;
@@ -114,6 +139,8 @@ void map_test_performance(unsigned int num)
     assert(map);
     assert(c);
     
+    fprintf(stdout, "Engine: %s\n", engine_names[engine]);
+    
     clock_start(c);
     
     for (unsigned int i = 0; i < num; ++i) {
@@ -136,6 +163,15 @@ void map_test_performance(unsigned int num)
     
     clock_reset(c);
     
+    for (unsigned int i = num; i < 2 * num; ++i)
+        assert(!map_retrieve(map, (void *)(long) i));
+    
+    fprintf(stdout, "Elapsed time for %u failing lookups: %lu us\n",
+            num,
+            clock_elapsed_us(c));
+    
+    clock_reset(c);
+    
     for (unsigned int i = 0; i < num; ++i)
         assert((unsigned int)(long) map_take(map, (void *)(long) i) == i);
     
@@ -171,7 +207,7 @@ void map_test_performance(unsigned int num)
     map_delete(map);
 }
 
-void map_stress_test(void)
+void map_stress_test(enum map_engine engine)
 {
     struct map *map;
     const struct map_config map_conf = {
@@ -182,6 +218,7 @@ void map_stress_test(void)
         .key_compare    = &compare_int,
         .key_hash       = &hash_ulong,
         .data_delete    = NULL,
+        .engine         = engine,
     };
     int err, i, num_elements;
     
@@ -225,7 +262,7 @@ void map_stress_test(void)
     map_delete(map);
 }
 
-void map_string_test(void)
+void map_string_test(enum map_engine engine)
 {
     char *strings[] = {
         "I",            "1",
@@ -244,6 +281,7 @@ void map_string_test(void)
         .key_compare    = &compare_string,
         .key_hash       = &hash_string,
         .data_delete    = NULL,
+        .engine         = engine,
     };
     int err;
     
@@ -263,16 +301,705 @@ void map_string_test(void)
     map_delete(map);
 }
 
-int main(int argc, char *argv[])
+void map_churn_test(enum map_engine engine, bool static_size)
+{
+    const struct map_config map_conf = {
+        .size           = 1024,
+        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
+        .static_size    = static_size,
+        .key_compare    = &compare_int,
+        .key_hash       = &hash_int,
+        .data_delete    = NULL,
+        .engine         = engine,
+    };
+    struct map_stats stats;
+    struct map *map;
+    unsigned int capacity;
+    int i, err;
+    
+    map = map_new(&map_conf);
+    assert(map);
+    
+    for (i = 0; i < 1000; ++i) {
+        err = map_insert(map, (void *)(long) i, (void *)(long) i);
+        assert(err == 0);
+    }
+    
+    capacity = map->capacity;
+    
+    /* a sliding window of keys must not make the table grow forever */
+    for (i = 1000; i < 100000; ++i) {
+        assert((int)(long) map_take(map, (void *)(long) (i - 1000)) == i - 1000);
+        
+        err = map_insert(map, (void *)(long) i, (void *)(long) i);
+        assert(err == 0);
+    }
+    
+    assert(map_size(map) == 1000);
+    assert(map->capacity <= 2 * capacity);
+    
+    for (i = 99000; i < 100000; ++i)
+        assert((int)(long) map_retrieve(map, (void *)(long) i) == i);
+    
+    for (i = 0; i < 99000; i += 7)
+        assert(!map_contains(map, (void *)(long) i));
+    
+    /* tombstones are cleaned up, even if the map can't grow */
+    map_stats(map, &stats);
+    
+    fprintf(stdout, "Engine: %s%s - after churn: %u entries, %u tombstones, "
+            "capacity %u, probes %.2f (max %u), missing key probes %.2f\n",
+            engine_names[engine], (static_size) ? " (static)" : "", 
+            stats.size, stats.tombstones, stats.capacity, stats.probe_avg, 
+            stats.probe_max, stats.probe_miss_avg);
+    
+    assert(stats.size == 1000);
+    assert(stats.size + stats.tombstones < stats.capacity);
+    assert(stats.probe_miss_avg < 8.0);
+    
+    map_delete(map);
+}
+
+static unsigned int scan_deleted;
+
+static bool scan_mark(const void *key, void *data, void *arg)
+{
+    unsigned char *seen = arg;
+    
+    (void) data;
+    
+    if (seen[(long) key] < UCHAR_MAX)
+        seen[(long) key] += 1;
+    
+    return false;
+}
+
+static bool scan_take_even(const void *key, void *data, void *arg)
 {
+    (void) data;
+    (void) arg;
+    
+    return ((long) key & 1) == 0;
+}
 
-    map_test_insert_remove();
+static void scan_delete(void *data)
+{
+    (void) data;
     
-    if (argc == 2)
-        map_test_performance((unsigned int) atoi(argv[1]));
+    scan_deleted += 1;
+}
+
+void map_scan_test(enum map_engine engine, bool incremental)
+{
+    const struct map_config map_conf = {
+        .size               = MAP_DEFAULT_SIZE,
+        .lower_bound        = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound        = MAP_DEFAULT_UPPER_BOUND,
+        .static_size        = false,
+        .key_compare        = &compare_int,
+        .key_hash           = &hash_int,
+        .data_delete        = &scan_delete,
+        .engine             = engine,
+        .incremental_resize = incremental,
+    };
+    const unsigned int num = 20000;
+    unsigned char *seen;
+    unsigned long cursor;
+    unsigned int i, next, calls;
+    struct map *map;
+    int err;
+    
+    map  = map_new(&map_conf);
+    seen = calloc(4 * num, sizeof(*seen));
+    assert(map);
+    assert(seen);
+    
+    for (i = 0; i < num; ++i) {
+        err = map_insert(map, (void *)(long) i, (void *)(long) i);
+        assert(err == 0);
+    }
+    
+    /* finish a running resize, then every entry is visited exactly once */
+    map_rehash(map, 0);
+    
+    cursor = 0;
+    calls  = 0;
+    
+    do {
+        cursor = map_scan(map, cursor, &scan_mark, seen);
+        calls += 1;
+    } while (cursor != 0);
+    
+    for (i = 0; i < num; ++i)
+        assert(seen[i] == 1);
+    
+    /* one bucket per call without a resize running */
+    assert(calls == map->capacity);
+    
+    /* keep growing the map between the slices of a scan */
+    memset(seen, 0, 4 * num);
+    
+    cursor = 0;
+    next   = num;
+    
+    do {
+        cursor = map_scan(map, cursor, &scan_mark, seen);
+        
+        for (i = 0; i < 4 && next < 4 * num; ++i, ++next) {
+            err = map_insert(map, (void *)(long) next, (void *)(long) next);
+            assert(err == 0);
+        }
+    } while (cursor != 0);
     
-    map_stress_test();
-    map_string_test();
+    for (i = 0; i < num; ++i)
+        assert(seen[i] >= 1);
+    
+    assert(map_size(map) > 2 * num);
+    
+    /* and shrinking it */
+    memset(seen, 0, 4 * num);
+    
+    cursor = 0;
+    
+    do {
+        cursor = map_scan(map, cursor, &scan_mark, seen);
+        
+        for (i = 0; i < 16 && next > num; ++i) {
+            next -= 1;
+            assert((unsigned int)(long) map_take(map, (void *)(long) next) 
+                   == next);
+        }
+    } while (cursor != 0);
+    
+    for (i = 0; i < num; ++i)
+        assert(seen[i] >= 1);
+    
+    assert(map_size(map) == num);
+    
+    /* take out entries while scanning, which shrinks the map as well */
+    scan_deleted = 0;
+    cursor       = 0;
+    
+    do {
+        cursor = map_scan(map, cursor, &scan_take_even, NULL);
+    } while (cursor != 0);
+    
+    assert(scan_deleted == num / 2);
+    assert(map_size(map) == num / 2);
+    
+    for (i = 0; i < num; ++i)
+        assert(map_contains(map, (void *)(long) i) == (i & 1));
+    
+    cursor = 0;
+    
+    do {
+        cursor = map_scan(map, cursor, &scan_take_even, NULL);
+    } while (cursor != 0);
+    
+    assert(scan_deleted == num / 2);
+    
+    map_delete(map);
+    free(seen);
+}
+
+static unsigned int hash_constant(const void *key)
+{
+    (void) key;
+    
+    return 42;
+}
+
+/* more keys on one probe run than fit in 16 bits of probe distance */
+void map_collision_test(void)
+{
+    const struct map_config map_conf = {
+        .size               = MAP_DEFAULT_SIZE,
+        .lower_bound        = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound        = MAP_DEFAULT_UPPER_BOUND,
+        .static_size        = false,
+        .key_compare        = &compare_int,
+        .key_hash           = &hash_constant,
+        .data_delete        = NULL,
+        .engine             = MAP_ENGINE_ROBIN_HOOD,
+        .incremental_resize = false,
+    };
+    const int num = 70000;
+    struct map *map;
+    int i, err;
+    
+    map = map_new(&map_conf);
+    assert(map);
+    
+    for (i = 0; i < num; ++i) {
+        err = map_insert(map, (void *)(long) i, (void *)(long) i);
+        assert(err == 0);
+    }
+    
+    assert(map_size(map) == (unsigned int) num);
+    
+    /* the keys at the end of the run were lost once the distance wrapped */
+    for (i = num - 1; i >= 0; i -= 61)
+        assert((int)(long) map_retrieve(map, (void *)(long) i) == i);
+    
+    map_delete(map);
+}
+
+void map_incremental_test(enum map_engine engine)
+{
+    const struct map_config map_conf = {
+        .size               = MAP_DEFAULT_SIZE,
+        .lower_bound        = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound        = MAP_DEFAULT_UPPER_BOUND,
+        .static_size        = false,
+        .key_compare        = &compare_int,
+        .key_hash           = &hash_int,
+        .data_delete        = NULL,
+        .engine             = engine,
+        .incremental_resize = true,
+    };
+    struct map_stats stats;
+    struct map *map;
+    struct entry *e;
+    unsigned int count, migrations;
+    int i, err;
+    
+    map = map_new(&map_conf);
+    assert(map);
+    
+    migrations = 0;
+    
+    for (i = 0; i < 50000; ++i) {
+        err = map_insert(map, (void *)(long) i, (void *)(long) i);
+        assert(err == 0);
+        
+        if (!map->old)
+            continue;
+        
+        /* both tables have to be visible while a resize is running */
+        migrations += 1;
+        
+        if (migrations % 64 == 0) {
+            count = 0;
+            
+            map_for_each(map, e)
+                count += 1;
+            
+            assert(count == map_size(map));
+            assert(map_contains(map, (void *)(long) 0));
+            assert(map_contains(map, (void *)(long) i));
+            
+            map_stats(map, &stats);
+            
+            assert(stats.size == map_size(map));
+            assert(stats.capacity == map->capacity + map->old->capacity);
+            assert(stats.probe_avg >= 1.0);
+        }
+    }
+    
+    assert(migrations > 0);
+    assert(map_size(map) == 50000);
+    
+    for (i = 0; i < 50000; ++i)
+        assert((int)(long) map_retrieve(map, (void *)(long) i) == i);
+    
+    for (i = 0; i < 50000; i += 2)
+        assert((int)(long) map_take(map, (void *)(long) i) == i);
+    
+    assert(map_size(map) == 25000);
+    
+    for (i = 0; i < 50000; ++i)
+        assert(map_contains(map, (void *)(long) i) == (i & 1));
+    
+    for (i = 1; i < 50000; i += 2)
+        assert((int)(long) map_take(map, (void *)(long) i) == i);
+    
+    assert(map_empty(map));
+    
+    /* clearing in the middle of a resize must release the old table */
+    for (i = 0; i < 5000 && !map->old; ++i)
+        map_insert(map, (void *)(long) i, (void *)(long) i);
+    
+    assert(map->old);
+    map_clear(map);
+    assert(map_empty(map));
+    
+    map_delete(map);
+}
+
+void map_latency_test(unsigned int num, enum map_engine engine)
+{
+    struct map_config map_conf = {
+        .size           = MAP_DEFAULT_SIZE,
+        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
+        .static_size    = false,
+        .key_compare    = &compare_int,
+        .key_hash       = &hash_int,
+        .data_delete    = NULL,
+        .engine         = engine,
+    };
+    struct map *map;
+    struct clock *c;
+    unsigned long ns, max_ns, total_ns;
+    int err;
+    
+    c = clock_new(CLOCK_MONOTONIC);
+    assert(c);
+    
+    for (int incremental = 0; incremental < 2; ++incremental) {
+        map_conf.incremental_resize = incremental;
+        
+        map = map_new(&map_conf);
+        assert(map);
+        
+        max_ns   = 0;
+        total_ns = 0;
+        
+        for (unsigned int i = 0; i < num; ++i) {
+            clock_start(c);
+            err = map_insert(map, (void *)(long) i, (void *)(long) i);
+            ns = clock_elapsed_ns(c);
+            assert(err == 0);
+            
+            max_ns    = max(max_ns, ns);
+            total_ns += ns;
+        }
+        
+        fprintf(stdout, "Engine: %s - %s resize: %u insertions in %lu us, "
+                "slowest insertion %lu us\n", engine_names[engine], 
+                (incremental) ? "incremental" : "full", num, total_ns / 1000,
+                max_ns / 1000);
+        
+        map_delete(map);
+    }
+    
+    clock_delete(c);
+}
+
+void map_batch_test(enum map_engine engine, bool incremental)
+{
+    const struct map_config map_conf = {
+        .size               = MAP_DEFAULT_SIZE,
+        .lower_bound        = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound        = MAP_DEFAULT_UPPER_BOUND,
+        .static_size        = false,
+        .key_compare        = &compare_int,
+        .key_hash           = &hash_int,
+        .data_delete        = NULL,
+        .engine             = engine,
+        .incremental_resize = incremental,
+    };
+    const void *keys[1000];
+    void *data[1000];
+    struct map *map;
+    unsigned int i;
+    int err;
+    
+    map = map_new(&map_conf);
+    assert(map);
+    
+    for (i = 0; i < 1000; ++i) {
+        keys[i] = (void *)(long) i;
+        data[i] = (void *)(long) (i + 1);
+    }
+    
+    /* in chunks, so some batches start in the middle of a migration */
+    for (i = 0; i < 1000; i += 100) {
+        err = map_insert_batch(map, keys + i, data + i, 100);
+        assert(err == 0);
+    }
+    
+    assert(map_size(map) == 1000);
+    
+    for (i = 0; i < 1000; ++i) {
+        keys[i] = (void *)(long) (2 * i);
+        data[i] = NULL;
+    }
+    
+    /* every second key is missing */
+    assert(map_retrieve_batch(map, keys, data, 1000) == 500);
+    
+    for (i = 0; i < 1000; ++i)
+        assert(data[i] == ((i < 500) ? (void *)(long) (2 * i + 1) : NULL));
+    
+    map_delete(map);
+}
+
+void map_batch_performance(unsigned int num, enum map_engine engine)
+{
+    const struct map_config map_conf = {
+        .size           = MAP_DEFAULT_SIZE,
+        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
+        .static_size    = false,
+        .key_compare    = &compare_int,
+        .key_hash       = &hash_int,
+        .data_delete    = NULL,
+        .engine         = engine,
+    };
+    struct map *map;
+    struct clock *c;
+    const void **keys;
+    void **data;
+    unsigned long us[4];
+    unsigned int i;
+    int err;
+    
+    map  = map_new(&map_conf);
+    c    = clock_new(CLOCK_PROCESS_CPUTIME_ID);
+    keys = malloc(num * sizeof(*keys));
+    data = malloc(num * sizeof(*data));
+    assert(map && c && keys && data);
+    
+    /* visit the keys in a scattered order, so the table is out of cache */
+    for (i = 0; i < num; ++i) {
+        keys[i] = (void *)(long) ((i * 2654435761ul) % num);
+        data[i] = (void *) keys[i];
+    }
+    
+    clock_start(c);
+    for (i = 0; i < num; ++i)
+        map_insert(map, keys[i], data[i]);
+    us[0] = clock_elapsed_us(c);
+    
+    clock_start(c);
+    for (i = 0; i < num; ++i)
+        data[i] = map_retrieve(map, keys[i]);
+    us[1] = clock_elapsed_us(c);
+    
+    map_clear(map);
+    map_rehash(map, 0);
+    
+    clock_start(c);
+    err = map_insert_batch(map, keys, data, num);
+    us[2] = clock_elapsed_us(c);
+    assert(err == 0);
+    
+    clock_start(c);
+    i = map_retrieve_batch(map, keys, data, num);
+    us[3] = clock_elapsed_us(c);
+    assert(i == num);
+    
+    fprintf(stdout, "Engine: %s - %u keys: map_insert %lu us, "
+            "map_insert_batch %lu us, map_retrieve %lu us, "
+            "map_retrieve_batch %lu us\n", engine_names[engine], num, 
+            us[0], us[2], us[1], us[3]);
+    
+    free(data);
+    free(keys);
+    clock_delete(c);
+    map_delete(map);
+}
+
+void map_define_test(void)
+{
+    struct int_map imap;
+    struct string_map smap;
+    char (*keys)[16];
+    unsigned int i, count;
+    int val, err;
+    
+    err = int_map_init(&imap, 0);
+    assert(err == 0);
+    
+    for (i = 0; i < 10000; ++i) {
+        err = int_map_insert(&imap, i, i);
+        assert(err == 0);
+    }
+    
+    /* existing keys get their value replaced */
+    assert(int_map_insert(&imap, 7, 70) == 0);
+    assert(*int_map_retrieve(&imap, 7) == 70);
+    assert(int_map_size(&imap) == 10000);
+    
+    for (i = 0; i < 10000; i += 2) {
+        assert(int_map_take(&imap, i, &val));
+        assert(val == (int) i);
+    }
+    
+    assert(!int_map_take(&imap, 0, NULL));
+    
+    for (i = 0; i < 10000; ++i)
+        assert(int_map_contains(&imap, i) == (i & 1));
+    
+    count = 0;
+    map_define_for_each(&imap, i) {
+        assert(imap.entries[i].key & 1);
+        count += 1;
+    }
+    
+    assert(count == 5000);
+    
+    /* reuses the tombstones instead of growing */
+    for (i = 0; i < 100000; ++i) {
+        assert(int_map_insert(&imap, 20000 + i, i) == 0);
+        assert(int_map_take(&imap, 20000 + i, NULL));
+    }
+    
+    assert(imap.capacity <= 16384);
+    
+    int_map_clear(&imap);
+    assert(int_map_size(&imap) == 0);
+    assert(!int_map_contains(&imap, 1));
+    
+    int_map_destroy(&imap);
+    
+    keys = malloc(1000 * sizeof(*keys));
+    assert(keys);
+    
+    err = string_map_init(&smap, 1000);
+    assert(err == 0);
+    
+    for (i = 0; i < 1000; ++i) {
+        sprintf(keys[i], "key %u", i);
+        assert(string_map_insert(&smap, keys[i], i) == 0);
+    }
+    
+    for (i = 0; i < 1000; ++i)
+        assert(*string_map_retrieve(&smap, keys[i]) == (int) i);
+    
+    assert(!string_map_contains(&smap, "key 1000"));
+    assert(string_map_contains(&smap, "key 999"));
+    
+    string_map_destroy(&smap);
+    free(keys);
+}
+
+void map_define_performance(unsigned int num)
+{
+    struct map_config map_conf = {
+        .size           = MAP_DEFAULT_SIZE,
+        .lower_bound    = MAP_DEFAULT_LOWER_BOUND,
+        .upper_bound    = MAP_DEFAULT_UPPER_BOUND,
+        .static_size    = false,
+        .key_compare    = &compare_int,
+        .key_hash       = &hash_int,
+        .data_delete    = NULL,
+        .engine         = MAP_ENGINE_SWISS,
+    };
+    struct int_map imap;
+    struct string_map smap;
+    struct map *map;
+    struct clock *c;
+    char (*keys)[16];
+    unsigned long sum, us[4];
+    unsigned int i;
+    int err;
+    
+    c = clock_new(CLOCK_PROCESS_CPUTIME_ID);
+    assert(c);
+    
+    map = map_new(&map_conf);
+    assert(map);
+    
+    err = int_map_init(&imap, 0);
+    assert(err == 0);
+    
+    sum = 0;
+    
+    clock_start(c);
+    for (i = 0; i < num; ++i)
+        map_insert(map, (void *)(long) i, (void *)(long) i);
+    us[0] = clock_elapsed_us(c);
+    
+    clock_start(c);
+    for (i = 0; i < num; ++i)
+        sum += (unsigned long) map_retrieve(map, (void *)(long) i);
+    us[1] = clock_elapsed_us(c);
+    
+    clock_start(c);
+    for (i = 0; i < num; ++i)
+        int_map_insert(&imap, i, i);
+    us[2] = clock_elapsed_us(c);
+    
+    clock_start(c);
+    for (i = 0; i < num; ++i)
+        sum += *int_map_retrieve(&imap, i);
+    us[3] = clock_elapsed_us(c);
+    
+    fprintf(stdout, "int keys: struct map %lu / %lu us, MAP_DEFINE %lu / %lu "
+            "us (insert / lookup)\n", us[0], us[1], us[2], us[3]);
+    
+    map_delete(map);
+    int_map_destroy(&imap);
+    
+    keys = malloc(num * sizeof(*keys));
+    assert(keys);
+    
+    for (i = 0; i < num; ++i)
+        sprintf(keys[i], "key %u", i);
+    
+    map_conf.key_compare = &compare_string;
+    map_conf.key_hash    = &hash_fnv;
+    
+    map = map_new(&map_conf);
+    assert(map);
+    
+    err = string_map_init(&smap, 0);
+    assert(err == 0);
+    
+    clock_start(c);
+    for (i = 0; i < num; ++i)
+        map_insert(map, keys[i], (void *)(long) i);
+    us[0] = clock_elapsed_us(c);
+    
+    clock_start(c);
+    for (i = 0; i < num; ++i)
+        sum += (unsigned long) map_retrieve(map, keys[i]);
+    us[1] = clock_elapsed_us(c);
+    
+    clock_start(c);
+    for (i = 0; i < num; ++i)
+        string_map_insert(&smap, keys[i], i);
+    us[2] = clock_elapsed_us(c);
+    
+    clock_start(c);
+    for (i = 0; i < num; ++i)
+        sum += *string_map_retrieve(&smap, keys[i]);
+    us[3] = clock_elapsed_us(c);
+    
+    fprintf(stdout, "string keys: struct map %lu / %lu us, MAP_DEFINE %lu / "
+            "%lu us (insert / lookup) [%lu]\n", us[0], us[1], us[2], us[3], 
+            sum);
+    
+    map_delete(map);
+    string_map_destroy(&smap);
+    free(keys);
+    clock_delete(c);
+}
+
+int main(int argc, char *argv[])
+{
+    enum map_engine engine;
+    
+    for (engine = MAP_ENGINE_QUADRATIC; engine <= MAP_ENGINE_ROBIN_HOOD; ++engine) {
+        map_test_insert_remove(engine);
+        
+        if (argc == 2) {
+            map_test_performance((unsigned int) atoi(argv[1]), engine);
+            map_latency_test((unsigned int) atoi(argv[1]), engine);
+        }
+        
+        map_stress_test(engine);
+        map_string_test(engine);
+        map_churn_test(engine, false);
+        map_churn_test(engine, true);
+        map_incremental_test(engine);
+        map_scan_test(engine, false);
+        map_scan_test(engine, true);
+        map_batch_test(engine, false);
+        map_batch_test(engine, true);
+        
+        if (argc == 2)
+            map_batch_performance((unsigned int) atoi(argv[1]), engine);
+    }
+    
+    map_collision_test();
+    map_define_test();
+    
+    if (argc == 2)
+        map_define_performance((unsigned int) atoi(argv[1]));
     
     return EXIT_SUCCESS;
 }
\ No newline at end of file
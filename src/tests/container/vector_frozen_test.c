@@ -0,0 +1,268 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include <libvci/vector.h>
+#include <libvci/vector_frozen.h>
+#include <libvci/compare.h>
+#include <libvci/random.h>
+#include <libvci/clock.h>
+#include <libvci/macro.h>
+
+static unsigned int lower_bound(struct vector *__restrict vec, long key)
+{
+    unsigned int l, r, m;
+    
+    l = 0;
+    r = vector_size(vec);
+    
+    while (l < r) {
+        m = l + (r - l) / 2;
+        
+        if ((long) *vector_at(vec, m) < key)
+            l = m + 1;
+        else
+            r = m;
+    }
+    
+    return l;
+}
+
+/* 'range' small enough gives many duplicates */
+static struct vector *sorted_longs(struct random *__restrict r,
+                                   unsigned int num,
+                                   long range)
+{
+    struct vector *vec;
+    long key;
+    int err;
+    
+    vec = vector_new(num);
+    assert(vec);
+    
+    vector_set_data_compare(vec, &compare_long);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        key = (long) random_uint(r) % range - range / 2;
+        
+        err = vector_insert_back(vec, (void *) key);
+        assert(err == 0);
+    }
+    
+    err = vector_sort_long(vec);
+    assert(err == 0);
+    
+    return vec;
+}
+
+static void check_key(struct vector *__restrict vec,
+                      struct vector_frozen *__restrict fz,
+                      struct vector_frozen_long *__restrict fzl,
+                      long key)
+{
+    unsigned int i, expect;
+    bool found;
+    
+    expect = lower_bound(vec, key);
+    found  = expect < vector_size(vec) && (long) *vector_at(vec, expect) == key;
+    
+    assert(vector_frozen_lower_bound(fz, (void *) key) == expect);
+    assert(vector_frozen_long_lower_bound(fzl, key) == expect);
+    
+    i = vector_frozen_index_of(fz, (void *) key);
+    assert(i == (found ? expect : (unsigned int) -1));
+    assert(vector_frozen_contains(fz, (void *) key) == found);
+    
+    i = vector_frozen_long_index_of(fzl, key);
+    assert(i == (found ? expect : (unsigned int) -1));
+    assert(vector_frozen_long_contains(fzl, key) == found);
+}
+
+static void vector_frozen_long_test(void)
+{
+    static const unsigned int sizes[] = {
+        0, 1, 2, 7, 8, 9, 63, 64, 72, 73, 81, 1000, 100000
+    };
+    struct vector_frozen *fz;
+    struct vector_frozen_long *fzl;
+    struct vector *vec;
+    struct random *r;
+    long range;
+    
+    r = random_new();
+    assert(r);
+    
+    for (unsigned int s = 0; s < ARRAY_SIZE(sizes); ++s) {
+        for (range = 4; range <= (long) UINT_MAX; range *= 256) {
+            vec = sorted_longs(r, sizes[s], range);
+            fz  = vector_frozen_new(vec);
+            fzl = vector_frozen_long_new(vec);
+            assert(fz && fzl);
+            
+            assert(vector_frozen_size(fz) == sizes[s]);
+            assert(vector_frozen_long_size(fzl) == sizes[s]);
+            
+            /* every key, its neighbours and the extremes */
+            for (unsigned int i = 0; i < sizes[s]; ++i) {
+                long key = (long) *vector_at(vec, i);
+                
+                check_key(vec, fz, fzl, key - 1);
+                check_key(vec, fz, fzl, key);
+                check_key(vec, fz, fzl, key + 1);
+            }
+            
+            check_key(vec, fz, fzl, LONG_MIN);
+            check_key(vec, fz, fzl, LONG_MAX);
+            
+            vector_frozen_long_delete(fzl);
+            vector_frozen_delete(fz);
+            vector_delete(vec);
+        }
+    }
+    
+    random_delete(r);
+}
+
+static void vector_frozen_string_test(unsigned int num)
+{
+    struct vector_frozen *fz;
+    struct vector *vec;
+    char **strings, buf[32];
+    unsigned int i;
+    
+    vec     = vector_new(num);
+    strings = malloc(num * sizeof(*strings));
+    assert(vec && strings);
+    
+    vector_set_data_compare(vec, &compare_string);
+    
+    /* only even numbers, so the odd ones are missing */
+    for (i = 0; i < num; ++i) {
+        sprintf(buf, "key/%08u", 2 * i);
+        strings[i] = strdup(buf);
+        assert(strings[i]);
+        
+        vector_insert_back(vec, strings[i]);
+    }
+    
+    fz = vector_frozen_new(vec);
+    assert(fz);
+    
+    for (i = 0; i < 2 * num; ++i) {
+        sprintf(buf, "key/%08u", i);
+        
+        assert(vector_frozen_lower_bound(fz, buf) == (i + 1) / 2);
+        
+        if (i % 2 == 0)
+            assert(vector_frozen_index_of(fz, buf) == i / 2);
+        else
+            assert(!vector_frozen_contains(fz, buf));
+    }
+    
+    vector_frozen_delete(fz);
+    
+    for (i = 0; i < num; ++i)
+        free(strings[i]);
+    
+    free(strings);
+    vector_delete(vec);
+}
+
+static void vector_frozen_performance(unsigned int num)
+{
+    static const char *names[] = {
+        "vector_index_of_sorted()", "vector_frozen_contains()",
+        "vector_frozen_long_contains()"
+    };
+    const unsigned int queries = 10000000;
+    struct vector_frozen *fz;
+    struct vector_frozen_long *fzl;
+    struct vector *vec;
+    struct random *r;
+    struct clock *c;
+    unsigned long ms, sum;
+    long *keys;
+    
+    r    = random_new();
+    c    = clock_new(CLOCK_MONOTONIC);
+    keys = malloc(queries * sizeof(*keys));
+    assert(r && c && keys);
+    
+    vec = sorted_longs(r, num, 2L * num);
+    fz  = vector_frozen_new(vec);
+    fzl = vector_frozen_long_new(vec);
+    assert(fz && fzl);
+    
+    for (unsigned int i = 0; i < queries; ++i)
+        keys[i] = (long) random_uint(r) % (2L * num) - num;
+    
+    fprintf(stdout, "%u lookups in %u sorted elements:\n", queries, num);
+    
+    for (unsigned int engine = 0; engine < ARRAY_SIZE(names); ++engine) {
+        sum = 0;
+        
+        clock_reset(c);
+        clock_start(c);
+        
+        for (unsigned int i = 0; i < queries; ++i) {
+            void *key = (void *) keys[i];
+            
+            if (engine == 0)
+                sum += vector_index_of_sorted(vec, key) != (unsigned int) -1;
+            else if (engine == 1)
+                sum += vector_frozen_contains(fz, key);
+            else
+                sum += vector_frozen_long_contains(fzl, keys[i]);
+        }
+        
+        ms = clock_elapsed_ms(c);
+        
+        fprintf(stdout, "  %-30s %6lu ms (%lu hits)\n", names[engine], ms, sum);
+    }
+    
+    vector_frozen_long_delete(fzl);
+    vector_frozen_delete(fz);
+    vector_delete(vec);
+    free(keys);
+    clock_delete(c);
+    random_delete(r);
+}
+
+int main(int argc, char *argv[])
+{
+    vector_frozen_long_test();
+    vector_frozen_string_test(10000);
+    
+    if (argc == 2)
+        vector_frozen_performance((unsigned int) atoi(argv[1]));
+    
+    fprintf(stdout, "Tests finished successfully.\n");
+    
+    return EXIT_SUCCESS;
+}
@@ -30,10 +30,33 @@
 #include <assert.h>
 
 #include <libvci/vector.h>
+#include <libvci/vector_define.h>
 #include <libvci/clock.h>
 #include <libvci/macro.h>
 #include <libvci/random.h>
 #include <libvci/compare.h>
+#include <libvci/threadpool.h>
+
+struct record {
+    unsigned int key;
+    unsigned int payload[3];
+};
+
+#define record_compare(a, b)                                                   \
+    VECTOR_DEFINE_CMP((a).key, (b).key)
+
+#define record_key(r)                                                          \
+    ((unsigned long) (r).key)
+
+#define identity(s)                                                            \
+    (s)
+
+VECTOR_DEFINE(int_vector, int, VECTOR_DEFINE_CMP)
+VECTOR_DEFINE(record_vector, struct record, record_compare)
+SORT_DEFINE(uint_array, unsigned int, VECTOR_DEFINE_CMP)
+SORT_DEFINE_RADIX(uint_array, unsigned int, (unsigned long))
+SORT_DEFINE_RADIX(record_array, struct record, record_key)
+SORT_DEFINE_STRING(string_array, char *, identity)
 
 static void check_sorted_vector(struct vector *__restrict v)
 {
@@ -139,6 +162,149 @@ void test_insert(void)
     vector_delete(vec);
 }
 
+void test_insert_range(void)
+{
+    struct vector *vec;
+    void *a[] = { (void *) 100, (void *) 101, (void *) 102 };
+    long expect[] = { 0, 100, 101, 102, 1, 2, 3, 100, 101, 102 };
+    int err;
+    
+    vec = vector_new(0);
+    assert(vec);
+    
+    for (long i = 0; i < 4; ++i)
+        vector_insert_back(vec, (void *) i);
+    
+    err = vector_insert_range(vec, 1, a, ARRAY_SIZE(a));
+    assert(err == 0);
+    err = vector_append_array(vec, a, ARRAY_SIZE(a));
+    assert(err == 0);
+    err = vector_append_array(vec, a, 0);
+    assert(err == 0);
+    
+    assert(vector_size(vec) == ARRAY_SIZE(expect));
+    
+    for (unsigned int i = 0; i < ARRAY_SIZE(expect); ++i)
+        assert((long) *vector_at(vec, i) == expect[i]);
+    
+    vector_delete(vec);
+}
+
+void test_insert_sorted_batch(unsigned int num)
+{
+    struct vector *vec, *ref;
+    struct random *r;
+    void **batch;
+    int err;
+    
+    vec   = vector_new(0);
+    ref   = vector_new(0);
+    r     = random_new();
+    batch = malloc(num * sizeof(*batch));
+    assert(vec && ref && r && batch);
+    
+    vector_set_data_compare(vec, &compare_uint);
+    vector_set_data_compare(ref, &compare_uint);
+    
+    /* batches below, above, inside and mixed with the present elements */
+    for (unsigned int k = 0; k < 5; ++k) {
+        unsigned int offset = (k == 1) ? num : 0;
+        unsigned int range  = (k == 3) ? 8 : num;
+        
+        for (unsigned int i = 0; i < num; ++i) {
+            batch[i] = (void *)(long) (offset + random_uint(r) % range);
+            
+            if (k == 2)
+                batch[i] = (void *)(long) (i % 2);
+            
+            err = vector_insert_sorted(ref, batch[i]);
+            assert(err == 0);
+        }
+        
+        err = vector_insert_sorted_batch(vec, batch, (k == 4) ? 0 : num);
+        assert(err == 0);
+        
+        if (k == 4)
+            continue;
+        
+        assert(vector_size(vec) == vector_size(ref));
+        
+        for (unsigned int i = 0; i < vector_size(ref); ++i)
+            assert(*vector_at(vec, i) == *vector_at(ref, i));
+    }
+    
+    free(batch);
+    random_delete(r);
+    vector_delete(ref);
+    vector_delete(vec);
+}
+
+void test_insert_sorted_batch_performance(unsigned int num)
+{
+    struct vector *vec;
+    struct random *r;
+    struct clock *c;
+    void **input, **batch;
+    unsigned int k;
+    int err;
+    
+    vec   = vector_new(num);
+    r     = random_new();
+    c     = clock_new(CLOCK_MONOTONIC);
+    input = malloc(num * sizeof(*input));
+    batch = malloc(num * sizeof(*batch));
+    assert(vec && r && c && input && batch);
+    
+    vector_set_data_compare(vec, &compare_uint);
+    
+    for (unsigned int i = 0; i < num; ++i)
+        input[i] = (void *)(long) random_uint(r);
+    
+    fprintf(stdout, "Inserting into a sorted vector of %u elements:\n", num);
+    
+    for (k = 16; k <= num / 4; k *= 16) {
+        unsigned long ms[2];
+        
+        for (unsigned int i = 0; i < k; ++i)
+            batch[i] = (void *)(long) random_uint(r);
+        
+        for (unsigned int batched = 0; batched < 2; ++batched) {
+            vector_clear(vec);
+            
+            err = vector_append_array(vec, input, num);
+            assert(err == 0);
+            
+            vector_sort(vec);
+            
+            clock_reset(c);
+            clock_start(c);
+            
+            if (batched) {
+                err = vector_insert_sorted_batch(vec, batch, k);
+                assert(err == 0);
+            } else {
+                for (unsigned int i = 0; i < k; ++i) {
+                    err = vector_insert_sorted(vec, batch[i]);
+                    assert(err == 0);
+                }
+            }
+            
+            ms[batched] = clock_elapsed_ms(c);
+            
+            check_sorted_vector(vec);
+        }
+        
+        fprintf(stdout, "  %8u elements: vector_insert_sorted() %6lu ms, "
+                "vector_insert_sorted_batch() %6lu ms\n", k, ms[0], ms[1]);
+    }
+    
+    free(batch);
+    free(input);
+    clock_delete(c);
+    random_delete(r);
+    vector_delete(vec);
+}
+
 void test_take(void)
 {
     struct vector *vec;
@@ -236,16 +402,735 @@ void test_sorted_simple(void)
     vector_delete(v);
 }
 
+static int compare_record(const void *a, const void *b)
+{
+    const struct record *r1 = a, *r2 = b;
+    
+    return (r1->key > r2->key) - (r1->key < r2->key);
+}
+
+static void check_sorted_int_vector(struct int_vector *__restrict vec)
+{
+    for (unsigned int i = 1; i < int_vector_size(vec); ++i)
+        assert(*int_vector_at(vec, i - 1) <= *int_vector_at(vec, i));
+}
+
+static void test_vector_define_sort(unsigned int num)
+{
+    struct int_vector vec;
+    struct random *r;
+    long sum, check;
+    int err;
+    
+    r = random_new();
+    assert(r);
+    
+    err = int_vector_init(&vec, 0);
+    assert(err == 0);
+    
+    /* random, few distinct, sorted, reversed and organ pipe input */
+    for (unsigned int pattern = 0; pattern < 5; ++pattern) {
+        int_vector_clear(&vec);
+        sum = 0;
+        
+        for (unsigned int i = 0; i < num; ++i) {
+            int val;
+            
+            switch (pattern) {
+            case 0:
+                val = (int) random_uint(r);
+                break;
+            case 1:
+                val = random_uint(r) % 10;
+                break;
+            case 2:
+                val = i;
+                break;
+            case 3:
+                val = num - i;
+                break;
+            default:
+                val = (i < num / 2) ? i : num - i;
+                break;
+            }
+            
+            err = int_vector_insert_back(&vec, val);
+            assert(err == 0);
+            
+            sum += val;
+        }
+        
+        int_vector_sort(&vec);
+        check_sorted_int_vector(&vec);
+        
+        check = 0;
+        
+        for (unsigned int i = 0; i < int_vector_size(&vec); ++i)
+            check += *int_vector_at(&vec, i);
+        
+        assert(int_vector_size(&vec) == num && check == sum);
+    }
+    
+    int_vector_destroy(&vec);
+    random_delete(r);
+}
+
+void test_vector_define(void)
+{
+    struct int_vector vec;
+    int *p, val, a[] = { 0, -1, 8, 5, 1, 2, 9, 3, 6, 4, 7, 5 };
+    int err;
+    
+    err = int_vector_init(&vec, 0);
+    assert(err == 0);
+    assert(int_vector_empty(&vec));
+    
+    for (unsigned int i = 0; i < ARRAY_SIZE(a); ++i) {
+        err = int_vector_insert_sorted(&vec, a[i]);
+        assert(err == 0);
+    }
+    
+    check_sorted_int_vector(&vec);
+    assert(int_vector_size(&vec) == ARRAY_SIZE(a));
+    
+    assert(int_vector_index_of_sorted(&vec, -1) == 0);
+    assert(int_vector_index_of_sorted(&vec, 9) == ARRAY_SIZE(a) - 1);
+    assert(int_vector_index_of_sorted(&vec, 10) == (unsigned int) -1);
+    assert(int_vector_index_of_sorted(&vec, -2) == (unsigned int) -1);
+    assert(*int_vector_at(&vec, int_vector_index_of_sorted(&vec, 5)) == 5);
+    
+    assert(int_vector_take_sorted(&vec, 5, &val) && val == 5);
+    assert(int_vector_contains_sorted(&vec, 5));
+    assert(int_vector_take_sorted(&vec, 5, NULL));
+    assert(!int_vector_contains_sorted(&vec, 5));
+    assert(!int_vector_take_sorted(&vec, 5, NULL));
+    
+    err = int_vector_insert_front(&vec, -10);
+    assert(err == 0);
+    err = int_vector_insert_back(&vec, 10);
+    assert(err == 0);
+    err = int_vector_insert_at(&vec, 1, -5);
+    assert(err == 0);
+    
+    assert(*int_vector_front(&vec) == -10 && *int_vector_back(&vec) == 10);
+    assert(int_vector_index_of(&vec, -5) == 1);
+    
+    assert(int_vector_take_front(&vec) == -10);
+    assert(int_vector_take_back(&vec) == 10);
+    assert(int_vector_take_at(&vec, 0) == -5);
+    
+    assert(int_vector_take(&vec, 4, &val) && val == 4);
+    assert(!int_vector_contains(&vec, 4));
+    
+    vector_define_for_each(&vec, p)
+        assert(*p != 4 && *p != 5);
+    
+    err = int_vector_squeeze(&vec);
+    assert(err == 0);
+    assert(int_vector_size(&vec) == ARRAY_SIZE(a) - 3);
+    
+    int_vector_destroy(&vec);
+    
+    /* a full vector of the largest capacity must fail instead of wrapping */
+    err = int_vector_init(&vec, 0);
+    assert(err == 0);
+    
+    vec.size     = VECTOR_DEFINE_MAX_CAPACITY;
+    vec.capacity = VECTOR_DEFINE_MAX_CAPACITY;
+    
+    err = int_vector_insert_back(&vec, 1);
+    assert(err == -EOVERFLOW);
+    err = int_vector_insert_at(&vec, 0, 1);
+    assert(err == -EOVERFLOW);
+    assert(vec.size == VECTOR_DEFINE_MAX_CAPACITY);
+    
+    int_vector_destroy(&vec);
+    
+    test_vector_define_sort(1000);
+    test_vector_define_sort(100000);
+}
+
+void test_vector_define_performance(unsigned int num)
+{
+    struct record_vector records;
+    struct record rec, *p;
+    struct vector *vec;
+    struct random *r;
+    struct clock *c;
+    unsigned int found;
+    int err;
+    
+    vec = vector_new(num);
+    r   = random_new();
+    c   = clock_new(CLOCK_MONOTONIC);
+    assert(vec);
+    assert(r);
+    assert(c);
+    
+    err = record_vector_init(&records, num);
+    assert(err == 0);
+    
+    vector_set_data_compare(vec, &compare_record);
+    vector_set_data_delete(vec, &free);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        rec.key        = random_uint(r);
+        rec.payload[0] = i;
+        
+        p = malloc(sizeof(*p));
+        assert(p);
+        *p = rec;
+        
+        err = vector_insert_back(vec, p);
+        assert(err == 0);
+        
+        err = record_vector_insert_back(&records, rec);
+        assert(err == 0);
+    }
+    
+    clock_start(c);
+    vector_sort(vec);
+    
+    fprintf(stdout, "struct vector: sorting %u records: %lu ms\n",
+            num, clock_elapsed_ms(c));
+    
+    clock_reset(c);
+    record_vector_sort(&records);
+    
+    fprintf(stdout, "VECTOR_DEFINE: sorting %u records: %lu ms\n",
+            num, clock_elapsed_ms(c));
+    
+    for (unsigned int i = 1; i < num; ++i)
+        assert(records.data[i - 1].key <= records.data[i].key);
+    
+    clock_reset(c);
+    found = 0;
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        rec.key = records.data[(i * 7919u) % num].key;
+        found  += vector_contains_sorted(vec, &rec);
+    }
+    
+    assert(found == num);
+    
+    fprintf(stdout, "struct vector: %u sorted lookups: %lu ms\n",
+            num, clock_elapsed_ms(c));
+    
+    clock_reset(c);
+    found = 0;
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        rec.key = records.data[(i * 7919u) % num].key;
+        found  += record_vector_contains_sorted(&records, rec);
+    }
+    
+    assert(found == num);
+    
+    fprintf(stdout, "VECTOR_DEFINE: %u sorted lookups: %lu ms\n",
+            num, clock_elapsed_ms(c));
+    
+    record_vector_destroy(&records);
+    clock_delete(c);
+    random_delete(r);
+    vector_delete(vec);
+}
+
+/* what vector_sort() did before, through qsort_r() */
+static const struct vector *qsort_vector;
+
+static int qsort_compare(const void *a, const void *b)
+{
+    return qsort_vector->data_compare(*(void * const *) a,
+                                      *(void * const *) b);
+}
+
+static int compare_string_ptr(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static int compare_long_ptr(const void *a, const void *b)
+{
+    long x = *(const long *) a, y = *(const long *) b;
+    
+    return (x > y) - (x < y);
+}
+
+static int compare_uint_ptr(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+    
+    return (x > y) - (x < y);
+}
+
+/* random, few distinct, sorted, reversed and organ pipe input */
+static long sort_input(struct random *r, unsigned int pattern,
+                       unsigned int i, unsigned int num)
+{
+    switch (pattern) {
+    case 0:
+        return (long) random_uint(r) - (long) random_uint(r) * 4096;
+    case 1:
+        return random_uint(r) % 10;
+    case 2:
+        return i;
+    case 3:
+        return -(long) i;
+    default:
+        return (i < num / 2) ? i : num - i;
+    }
+}
+
+void test_sort_engines(unsigned int num)
+{
+    struct vector *vec;
+    struct record_vector records;
+    struct random *r;
+    long *ref;
+    char **strings, **sorted;
+    int err;
+    
+    vec = vector_new(num);
+    r   = random_new();
+    ref = malloc(num * sizeof(*ref));
+    assert(vec);
+    assert(r);
+    assert(ref);
+    
+    vector_set_data_compare(vec, &compare_long);
+    
+    for (unsigned int pattern = 0; pattern < 5; ++pattern) {
+        for (unsigned int engine = 0; engine < 3; ++engine) {
+            vector_clear(vec);
+            
+            for (unsigned int i = 0; i < num; ++i) {
+                ref[i] = sort_input(r, pattern, i, num);
+                
+                err = vector_insert_back(vec, (void *) ref[i]);
+                assert(err == 0);
+            }
+            
+            qsort(ref, num, sizeof(*ref), &compare_long_ptr);
+            
+            if (engine == 0) {
+                vector_sort(vec);
+            } else if (engine == 1) {
+                err = vector_sort_stable(vec);
+                assert(err == 0);
+            } else {
+                err = vector_sort_long(vec);
+                assert(err == 0);
+            }
+            
+            for (unsigned int i = 0; i < num; ++i)
+                assert((long) *vector_at(vec, i) == ref[i]);
+        }
+    }
+    
+    /* strings with long common prefixes and duplicates */
+    strings = malloc(num * sizeof(*strings));
+    sorted  = malloc(num * sizeof(*sorted));
+    assert(strings);
+    assert(sorted);
+    
+    vector_clear(vec);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        char buf[64];
+        
+        switch (i % 3) {
+        case 0:
+            sprintf(buf, "%u", random_uint(r) % 1000);
+            break;
+        case 1:
+            sprintf(buf, "common/prefix/of/some/length/%u", random_uint(r));
+            break;
+        default:
+            sprintf(buf, "%.*s", (int) (i % 40),
+                    "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+            break;
+        }
+        
+        strings[i] = strdup(buf);
+        assert(strings[i]);
+        
+        err = vector_insert_back(vec, strings[i]);
+        assert(err == 0);
+    }
+    
+    memcpy(sorted, strings, num * sizeof(*sorted));
+    qsort(sorted, num, sizeof(*sorted), &compare_string_ptr);
+    
+    err = vector_sort_string(vec);
+    assert(err == 0);
+    
+    for (unsigned int i = 0; i < num; ++i)
+        assert(strcmp(*vector_at(vec, i), sorted[i]) == 0);
+    
+    /* the same through the typed interface */
+    memcpy(sorted, strings, num * sizeof(*sorted));
+    
+    err = string_array_sort_string(sorted, num);
+    assert(err == 0);
+    
+    for (unsigned int i = 0; i < num; ++i)
+        assert(strcmp(*vector_at(vec, i), sorted[i]) == 0);
+    
+    for (unsigned int i = 0; i < num; ++i)
+        free(strings[i]);
+    
+    /* equal keys have to keep their order */
+    err = record_vector_init(&records, num);
+    assert(err == 0);
+    
+    for (unsigned int radix = 0; radix < 2; ++radix) {
+        record_vector_clear(&records);
+        
+        for (unsigned int i = 0; i < num; ++i) {
+            struct record rec = { random_uint(r) % 100, { i, 0, 0 } };
+            
+            err = record_vector_insert_back(&records, rec);
+            assert(err == 0);
+        }
+        
+        if (radix)
+            err = record_array_sort_radix(records.data, records.size);
+        else
+            err = record_vector_sort_stable(&records);
+        
+        assert(err == 0);
+        
+        for (unsigned int i = 1; i < num; ++i) {
+            struct record *a = records.data + i - 1, *b = records.data + i;
+            
+            assert(a->key < b->key ||
+                   (a->key == b->key && a->payload[0] < b->payload[0]));
+        }
+    }
+    
+    record_vector_destroy(&records);
+    free(sorted);
+    free(strings);
+    free(ref);
+    random_delete(r);
+    vector_delete(vec);
+}
+
+void test_sort_performance(unsigned int num)
+{
+    struct vector *vec;
+    struct random *r;
+    struct clock *c;
+    unsigned int *input, *a;
+    char **strings;
+    unsigned long ms;
+    int err;
+    
+    vec     = vector_new(num);
+    r       = random_new();
+    c       = clock_new(CLOCK_MONOTONIC);
+    input   = malloc(num * sizeof(*input));
+    a       = malloc(num * sizeof(*a));
+    strings = malloc(num * sizeof(*strings));
+    assert(vec && r && c && input && a && strings);
+    
+    vector_set_data_compare(vec, &compare_uint);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        char buf[32];
+        
+        input[i] = random_uint(r);
+        
+        sprintf(buf, "key/%u", input[i]);
+        strings[i] = strdup(buf);
+        assert(strings[i]);
+    }
+    
+    fprintf(stdout, "Sorting %u elements:\n", num);
+    
+    /* pointer vectors, the old vector_sort() went through qsort_r() */
+    for (unsigned int engine = 0; engine < 4; ++engine) {
+        static const char *names[] = {
+            "qsort_r() trampoline", "vector_sort()", "vector_sort_stable()",
+            "vector_sort_long()",
+        };
+        
+        vector_clear(vec);
+        
+        for (unsigned int i = 0; i < num; ++i)
+            vector_insert_back(vec, (void *)(long) input[i]);
+        
+        clock_reset(c);
+        clock_start(c);
+        
+        switch (engine) {
+        case 0:
+            qsort_vector = vec;
+            qsort(vec->data, num, sizeof(*vec->data), &qsort_compare);
+            break;
+        case 1:
+            vector_sort(vec);
+            break;
+        case 2:
+            err = vector_sort_stable(vec);
+            assert(err == 0);
+            break;
+        default:
+            err = vector_sort_long(vec);
+            assert(err == 0);
+            break;
+        }
+        
+        ms = clock_elapsed_ms(c);
+        
+        check_sorted_vector(vec);
+        
+        fprintf(stdout, "  struct vector, %-22s %6lu ms\n", names[engine], ms);
+    }
+    
+    for (unsigned int engine = 0; engine < 3; ++engine) {
+        static const char *names[] = {
+            "qsort()", "SORT_DEFINE", "SORT_DEFINE_RADIX"
+        };
+        
+        memcpy(a, input, num * sizeof(*a));
+        
+        clock_reset(c);
+        clock_start(c);
+        
+        if (engine == 0) {
+            qsort(a, num, sizeof(*a), &compare_uint_ptr);
+        } else if (engine == 1) {
+            uint_array_sort(a, num);
+        } else {
+            err = uint_array_sort_radix(a, num);
+            assert(err == 0);
+        }
+        
+        ms = clock_elapsed_ms(c);
+        
+        for (unsigned int i = 1; i < num; ++i)
+            assert(a[i - 1] <= a[i]);
+        
+        fprintf(stdout, "  unsigned int[], %-20s %6lu ms\n", names[engine], ms);
+    }
+    
+    for (unsigned int engine = 0; engine < 3; ++engine) {
+        static const char *names[] = {
+            "qsort_r() trampoline", "vector_sort()", "vector_sort_string()"
+        };
+        
+        vector_clear(vec);
+        vector_set_data_compare(vec, &compare_string);
+        
+        for (unsigned int i = 0; i < num; ++i)
+            vector_insert_back(vec, strings[i]);
+        
+        clock_reset(c);
+        clock_start(c);
+        
+        if (engine == 0) {
+            qsort_vector = vec;
+            qsort(vec->data, num, sizeof(*vec->data), &qsort_compare);
+        } else if (engine == 1) {
+            vector_sort(vec);
+        } else {
+            err = vector_sort_string(vec);
+            assert(err == 0);
+        }
+        
+        ms = clock_elapsed_ms(c);
+        
+        for (unsigned int i = 1; i < num; ++i)
+            assert(strcmp(*vector_at(vec, i - 1), *vector_at(vec, i)) <= 0);
+        
+        fprintf(stdout, "  strings, %-27s %6lu ms\n", names[engine], ms);
+    }
+    
+    for (unsigned int i = 0; i < num; ++i)
+        free(strings[i]);
+    
+    free(strings);
+    free(a);
+    free(input);
+    clock_delete(c);
+    random_delete(r);
+    vector_delete(vec);
+}
+
+static void fill_vector(struct vector *__restrict vec,
+                        struct random *__restrict r,
+                        unsigned int num,
+                        unsigned int range)
+{
+    int err;
+    
+    vector_clear(vec);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        err = vector_insert_back(vec, (void *)(long) (random_uint(r) % range));
+        assert(err == 0);
+    }
+}
+
+void test_sort_parallel(unsigned int num)
+{
+    struct vector *vec, *ref, *src[5];
+    struct threadpool *pool;
+    struct random *r;
+    unsigned long sum;
+    int err;
+    
+    vec  = vector_new(0);
+    ref  = vector_new(0);
+    r    = random_new();
+    pool = threadpool_new(3);
+    assert(vec && ref && r && pool);
+    
+    vector_set_data_compare(vec, &compare_uint);
+    vector_set_data_compare(ref, &compare_uint);
+    
+    /* many duplicates must not unbalance or break the merge */
+    for (unsigned int k = 0; k < 4; ++k) {
+        static const unsigned int ranges[] = { 1, 16, 4096, UINT_MAX };
+        
+        fill_vector(vec, r, num, ranges[k]);
+        
+        vector_clear(ref);
+        
+        for (unsigned int i = 0; i < num; ++i)
+            vector_insert_back(ref, *vector_at(vec, i));
+        
+        vector_sort(ref);
+        
+        err = vector_sort_parallel(vec, pool);
+        assert(err == 0);
+        assert(vector_size(vec) == num);
+        
+        for (unsigned int i = 0; i < num; ++i)
+            assert(*vector_at(vec, i) == *vector_at(ref, i));
+    }
+    
+    /* without a pool vector_sort_parallel() falls back to vector_sort() */
+    fill_vector(vec, r, num, num);
+    
+    err = vector_sort_parallel(vec, NULL);
+    assert(err == 0);
+    check_sorted_vector(vec);
+    
+    for (unsigned int i = 0; i < ARRAY_SIZE(src); ++i) {
+        src[i] = vector_new(0);
+        assert(src[i]);
+        
+        vector_set_data_compare(src[i], &compare_uint);
+        
+        /* one empty and one single element source */
+        fill_vector(src[i], r, (i == 0) ? 0 : (i == 1) ? 1 : num / i, num);
+        vector_sort(src[i]);
+    }
+    
+    for (unsigned int parallel = 0; parallel < 2; ++parallel) {
+        vector_clear(vec);
+        vector_insert_back(vec, (void *) 0);
+        
+        err = vector_merge(vec, src, ARRAY_SIZE(src),
+                           (parallel) ? pool : NULL);
+        assert(err == 0);
+        
+        sum = 1;
+        
+        for (unsigned int i = 0; i < ARRAY_SIZE(src); ++i)
+            sum += vector_size(src[i]);
+        
+        assert(vector_size(vec) == sum);
+        check_sorted_vector(vec);
+    }
+    
+    for (unsigned int i = 0; i < ARRAY_SIZE(src); ++i)
+        vector_delete(src[i]);
+    
+    threadpool_delete(pool);
+    random_delete(r);
+    vector_delete(ref);
+    vector_delete(vec);
+}
+
+void test_sort_parallel_performance(unsigned int num)
+{
+    struct vector *vec;
+    struct threadpool *pool;
+    struct random *r;
+    struct clock *c;
+    unsigned long ms, base;
+    long cpus;
+    int err;
+    
+    vec  = vector_new(num);
+    r    = random_new();
+    c    = clock_new(CLOCK_MONOTONIC);
+    assert(vec && r && c);
+    
+    vector_set_data_compare(vec, &compare_uint);
+    
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpus = max(cpus, 4L);
+    base = 0;
+    
+    fprintf(stdout, "Sorting %u elements in parallel:\n", num);
+    
+    /* the calling thread works as well, so 't' threads need 't - 1' workers */
+    for (long t = 1; t <= cpus; t *= 2) {
+        pool = (t > 1) ? threadpool_new((int) t - 1) : NULL;
+        assert(t == 1 || pool);
+        
+        fill_vector(vec, r, num, UINT_MAX);
+        
+        clock_reset(c);
+        clock_start(c);
+        
+        err = vector_sort_parallel(vec, pool);
+        assert(err == 0);
+        
+        ms = clock_elapsed_ms(c);
+        
+        check_sorted_vector(vec);
+        
+        if (t == 1)
+            base = max(ms, 1UL);
+        
+        fprintf(stdout, "  %2ld threads %6lu ms, speedup %.2f\n",
+                t, ms, (double) base / max(ms, 1UL));
+        
+        if (pool)
+            threadpool_delete(pool);
+    }
+    
+    clock_delete(c);
+    random_delete(r);
+    vector_delete(vec);
+}
+
 int main(int argc, char *argv[])
 {
-    (void) argc;
-    (void) argv;
     test_sort_vector();
     test_sort_large_vector();
     test_insert();
+    test_insert_range();
     test_take();
     test_sorted();
     test_sorted_simple();
+    test_vector_define();
+    test_sort_engines(1000);
+    test_sort_engines(100000);
+    test_sort_parallel(200000);
+    test_insert_sorted_batch(1000);
+    
+    if (argc == 2) {
+        test_vector_define_performance((unsigned int) atoi(argv[1]));
+        test_sort_performance((unsigned int) atoi(argv[1]));
+        test_sort_parallel_performance((unsigned int) atoi(argv[1]));
+        test_insert_sorted_batch_performance((unsigned int) atoi(argv[1]));
+    }
     
     return EXIT_SUCCESS;
 }
\ No newline at end of file
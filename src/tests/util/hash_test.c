@@ -0,0 +1,278 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Steffen Nuessle
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <libvci/hash.h>
+#include <libvci/clock.h>
+#include <libvci/macro.h>
+
+#define BUCKET_BITS 16
+
+/* hash_ulong() and hash_string() before the switch to hash_mix() / hash_bytes() */
+static unsigned int legacy_ulong(const void *key)
+{
+    unsigned int hval;
+    
+    hval = 1;
+    
+    hval += (unsigned long) key;
+    hval += (hval << 10);
+    hval ^= (hval >> 6);
+    hval += ((unsigned long) key >> 32);
+    hval &= 0x0fffffff;
+    
+    hval += (hval << 3);
+    hval ^= (hval >> 11);
+    hval += (hval << 15);
+    
+    return hval;
+}
+
+static unsigned int legacy_string(const void *key)
+{
+    const char *k;
+    unsigned int hval;
+    
+    k = key;
+    hval = 1;
+    
+    while(*k != '\0')
+        hval += *k++;
+    
+    hval += (hval << 10);
+    hval ^= (hval >> 6);
+    hval &= 0x0fffffff;
+    
+    hval += (hval << 3);
+    hval ^= (hval >> 11);
+    hval += (hval << 15);
+    
+    return hval;
+}
+
+static int compare_hash(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+    
+    return (x > y) - (x < y);
+}
+
+struct quality {
+    unsigned int collisions;
+    unsigned int bucket_max;
+};
+
+/* full 32 bit collisions and the worst bucket when indexing by the low bits */
+static struct quality evaluate(unsigned int *hashes, unsigned int num)
+{
+    struct quality q = { 0, 0 };
+    unsigned int *buckets;
+    
+    buckets = calloc(1u << BUCKET_BITS, sizeof(*buckets));
+    assert(buckets);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        unsigned int b = hashes[i] & ((1u << BUCKET_BITS) - 1);
+    
+        if (++buckets[b] > q.bucket_max)
+            q.bucket_max = buckets[b];
+    }
+    
+    qsort(hashes, num, sizeof(*hashes), &compare_hash);
+    
+    for (unsigned int i = 1; i < num; ++i)
+        q.collisions += (hashes[i] == hashes[i - 1]);
+    
+    free(buckets);
+    
+    return q;
+}
+
+static void print_quality(const char *name, struct quality q, unsigned int num)
+{
+    fprintf(stdout, "  %-22s collisions: %8u   max bucket: %6u (avg %.1f)\n",
+            name, q.collisions, q.bucket_max,
+            (double) num / (1u << BUCKET_BITS));
+}
+
+static void hash_quality_test(unsigned int num)
+{
+    unsigned int *h1, *h2;
+    struct quality q1, q2;
+    char (*keys)[32];
+    
+    h1   = malloc(num * sizeof(*h1));
+    h2   = malloc(num * sizeof(*h2));
+    keys = malloc(num * sizeof(*keys));
+    assert(h1 && h2 && keys);
+    
+    fprintf(stdout, "%u integers packing two coordinates (x << 32 | y):\n",
+            num);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        void *key = (void *)((unsigned long) (i / 1000) << 32 | (i % 1000));
+    
+        h1[i] = legacy_ulong(key);
+        h2[i] = hash_ulong(key);
+    }
+    
+    q1 = evaluate(h1, num);
+    q2 = evaluate(h2, num);
+    
+    print_quality("legacy hash_ulong", q1, num);
+    print_quality("hash_ulong", q2, num);
+    
+    /* the old function only added the upper half at the end */
+    assert(q1.collisions > num / 100);
+    assert(q2.collisions < num / 1000 + 10);
+    
+    fprintf(stdout, "%u strings \"key %%u\":\n", num);
+    
+    for (unsigned int i = 0; i < num; ++i) {
+        sprintf(keys[i], "key %u", i);
+    
+        h1[i] = legacy_string(keys[i]);
+        h2[i] = hash_string(keys[i]);
+    }
+    
+    q1 = evaluate(h1, num);
+    q2 = evaluate(h2, num);
+    
+    print_quality("legacy hash_string", q1, num);
+    print_quality("hash_string", q2, num);
+    
+    /* the old function only summed up the characters */
+    assert(q1.collisions > num / 2);
+    assert(q2.collisions < num / 1000 + 10);
+    
+    free(keys);
+    free(h2);
+    free(h1);
+}
+
+static void hash_bytes_test(void)
+{
+    static const char text[] = "The quick brown fox jumps over the lazy dog, "
+                               "then runs through the forest and sleeps.";
+    char buf[sizeof(text) + 8];
+    unsigned long seed;
+    unsigned int h;
+    
+    /* results must not depend on the alignment of the input */
+    for (size_t len = 0; len < sizeof(text); ++len) {
+        h = hash_bytes(text, len);
+    
+        for (size_t off = 1; off < 8; ++off) {
+            memcpy(buf + off, text, len);
+            assert(hash_bytes(buf + off, len) == h);
+        }
+    
+        if (len > 0)
+            assert(hash_bytes(text, len - 1) != h);
+    }
+    
+    assert(hash_string(text) == hash_bytes(text, strlen(text)));
+    assert(hash_string("abc") != hash_string("cba"));
+    assert(hash_string("ab") != hash_string("ba"));
+    
+    seed = hash_get_seed();
+    h    = hash_string(text);
+    
+    hash_set_seed(seed + 1);
+    assert(hash_string(text) != h);
+    
+    assert(hash_seed_random() == 0);
+    
+    hash_set_seed(seed);
+    assert(hash_string(text) == h);
+}
+
+static void hash_performance_test(void)
+{
+    static const size_t sizes[] = { 8, 64, 1024, 65536 };
+    const size_t total = 256 * 1024 * 1024;
+    struct clock *c;
+    unsigned char *data;
+    unsigned int sum;
+    
+    data = malloc(sizes[ARRAY_SIZE(sizes) - 1]);
+    c    = clock_new(CLOCK_PROCESS_CPUTIME_ID);
+    assert(data);
+    assert(c);
+    
+    for (size_t i = 0; i < sizes[ARRAY_SIZE(sizes) - 1]; ++i)
+        data[i] = (unsigned char) (i * 31);
+    
+    for (unsigned int i = 0; i < ARRAY_SIZE(sizes); ++i) {
+        size_t len = sizes[i];
+        size_t n = total / len;
+        unsigned long us;
+    
+        sum = 0;
+    
+        clock_reset(c);
+        clock_start(c);
+    
+        for (size_t j = 0; j < n; ++j) {
+            /* vary the first byte so no call can be hoisted */
+            data[0] = (unsigned char) j;
+            sum = sum * 31 + hash_bytes(data, len);
+        }
+    
+        us = clock_elapsed_us(c);
+    
+        fprintf(stdout, "hash_bytes(%6zu): %8.1f MiB/s  %6.1f ns/call "
+                "(checksum %08x)\n", len,
+                (double) total / (1 << 20) / ((double) us / 1e6),
+                (double) us * 1e3 / n, sum);
+    }
+    
+    clock_delete(c);
+    free(data);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int num;
+    
+    if (argc == 2)
+        num = atoi(argv[1]);
+    else
+        num = 1000000;
+    
+    hash_bytes_test();
+    hash_quality_test(num);
+    
+    if (argc == 2)
+        hash_performance_test();
+    
+    fprintf(stdout, "Tests finished successfully.\n");
+    
+    return EXIT_SUCCESS;
+}